@@ -0,0 +1,550 @@
+// Benchmarks for render, layout, hit-test and event dispatch on the headless SDL dummy driver.
+//
+// Build:
+//   cmake -S . -B build && cmake --build build --target gui_bench
+//
+// Usage:
+//   gui_bench [--widgets N] [--depth D] [--iterations K] [--text-mb M] [--filter substring]
+//
+// Every case prints the median and p99 time per iteration so runs can be
+// compared between releases.
+
+#include "gui.hpp"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace gui;
+
+namespace {
+
+struct Options {
+    int widgets = 2000;
+    int depth = 6;
+    int iterations = 200;
+    int textMegabytes = 100;
+    std::string filter;
+};
+
+// Leaf widget that exposes emit() so bubbling can be measured from the deepest level
+class Probe : public Widget {
+public:
+    explicit Probe(const std::string& id) : Widget(id) {}
+    void render() override {}
+    void fire(const Event& event) { emit(event); }
+};
+
+// Synthetic widget tree: containers with a vertical layout down to `depth`,
+// leaves cycling through labels, buttons and probes
+struct SyntheticTree {
+    std::vector<Container*> containers;
+    std::vector<Widget*> leaves;
+    std::vector<Probe*> probes;
+    int widgetCount = 0;
+};
+
+static void buildTree(Widget& parent, int depth, int fanout, int& remaining, SyntheticTree& tree) {
+    for (int i = 0; i < fanout && remaining > 0; ++i) {
+        std::string id = "w" + std::to_string(tree.widgetCount++);
+        --remaining;
+        
+        if (depth > 1) {
+            auto container = utils::create<Container>(id);
+            container->setSize(400, 400);
+            Container* raw = container.get();
+            tree.containers.push_back(raw);
+            parent.add(std::move(container));
+            buildTree(*raw, depth - 1, fanout, remaining, tree);
+            raw->setLayout(std::make_unique<VerticalLayout>(2, 2));
+            continue;
+        }
+        
+        switch (tree.widgetCount % 3) {
+            case 0: {
+                auto label = utils::create<Label>("Label " + id, id);
+                tree.leaves.push_back(label.get());
+                parent.add(std::move(label));
+                break;
+            }
+            case 1: {
+                auto button = utils::create<Button>("Button " + id, id);
+                tree.leaves.push_back(button.get());
+                parent.add(std::move(button));
+                break;
+            }
+            default: {
+                auto probe = utils::create<Probe>(id);
+                tree.leaves.push_back(probe.get());
+                tree.probes.push_back(probe.get());
+                parent.add(std::move(probe));
+                break;
+            }
+        }
+    }
+}
+
+static SyntheticTree populate(Window& window, const Options& options) {
+    SyntheticTree tree;
+    int depth = std::max(1, options.depth);
+    int fanout = std::max(2, static_cast<int>(std::ceil(std::pow(options.widgets, 1.0 / depth))));
+    int remaining = options.widgets;
+    while (remaining > 0) {
+        buildTree(window, depth, fanout, remaining, tree);
+    }
+    return tree;
+}
+
+// Form-like screen for the construction cases: containers with a vertical
+// layout, leaves cycling through labels, buttons and text inputs. The same
+// screen is built through code and described as JSON for UILayout.
+static void buildScreen(Widget& parent, int depth, int fanout, int& remaining, int& counter) {
+    for (int i = 0; i < fanout && remaining > 0; ++i) {
+        std::string id = "s" + std::to_string(counter++);
+        --remaining;
+        
+        if (depth > 1) {
+            auto container = utils::create<Container>(id);
+            container->setSize(400, 400);
+            Container* raw = container.get();
+            parent.add(std::move(container));
+            buildScreen(*raw, depth - 1, fanout, remaining, counter);
+            raw->setLayout(std::make_unique<VerticalLayout>(2, 2));
+        } else if (counter % 3 == 0) {
+            parent.add(utils::create<Label>("Label " + id, id));
+        } else if (counter % 3 == 1) {
+            parent.add(utils::create<Button>("Button " + id, id));
+        } else {
+            parent.add(utils::create<TextInput>("Input " + id, id));
+        }
+    }
+}
+
+static void describeScreen(std::string& json, int depth, int fanout, int& remaining, int& counter) {
+    for (int i = 0; i < fanout && remaining > 0; ++i) {
+        std::string id = "s" + std::to_string(counter++);
+        --remaining;
+        if (i > 0) json += ',';
+        
+        if (depth > 1) {
+            json += "{\"type\":\"Container\",\"id\":\"" + id + "\",\"width\":400,\"height\":400,"
+                    "\"layout\":{\"type\":\"vertical\",\"spacing\":2,\"padding\":2},\"children\":[";
+            describeScreen(json, depth - 1, fanout, remaining, counter);
+            json += "]}";
+        } else if (counter % 3 == 0) {
+            json += "{\"type\":\"Label\",\"id\":\"" + id + "\",\"text\":\"Label " + id + "\"}";
+        } else if (counter % 3 == 1) {
+            json += "{\"type\":\"Button\",\"id\":\"" + id + "\",\"text\":\"Button " + id + "\"}";
+        } else {
+            json += "{\"type\":\"TextInput\",\"id\":\"" + id + "\",\"placeholder\":\"Input " + id + "\"}";
+        }
+    }
+}
+
+static int screenFanout(const Options& options) {
+    int depth = std::max(1, options.depth);
+    return std::max(2, static_cast<int>(std::ceil(std::pow(options.widgets, 1.0 / depth))));
+}
+
+struct Result {
+    double medianUs;
+    double p99Us;
+    double opsPerIteration;
+};
+
+static Result measure(int iterations, double opsPerIteration, const std::function<void()>& body) {
+    using Clock = std::chrono::steady_clock;
+    
+    // Warm caches before sampling
+    for (int i = 0; i < std::max(1, iterations / 10); ++i) {
+        body();
+    }
+    
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    for (int i = 0; i < iterations; ++i) {
+        auto start = Clock::now();
+        body();
+        samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    
+    std::sort(samples.begin(), samples.end());
+    size_t p99 = std::min(samples.size() - 1, static_cast<size_t>(std::ceil(samples.size() * 0.99)) - 1);
+    return {samples[samples.size() / 2], samples[p99], opsPerIteration};
+}
+
+struct BenchCase {
+    const char* name;
+    double opsPerIteration;
+    std::function<void()> body;
+    int iterations = 0; // 0 uses --iterations
+};
+
+// Log-like text: short and long lines, the latter forcing several wrapped rows
+static std::string generateLog(size_t bytes) {
+    static const char* words[] = {"device", "poll", "ok", "timeout", "retry", "sensor", "value", "=", "42", "warn"};
+    std::string text;
+    text.reserve(bytes + 512);
+    std::mt19937 rng(7);
+    size_t line = 0;
+    while (text.size() < bytes) {
+        text += "2024-01-01T00:00:00 [" + std::to_string(line++) + "]";
+        int wordCount = line % 17 == 0 ? 60 : 6 + static_cast<int>(rng() % 10);
+        for (int i = 0; i < wordCount; ++i) {
+            text += ' ';
+            text += words[rng() % 10];
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+static void report(const char* name, const Result& result) {
+    double opsPerSecond = result.medianUs > 0 ? result.opsPerIteration / (result.medianUs / 1e6) : 0;
+    std::printf("%-28s %12.2f %12.2f %14.0f\n", name, result.medianUs, result.p99Us, opsPerSecond);
+}
+
+static Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--widgets") == 0) options.widgets = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--depth") == 0) options.depth = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--iterations") == 0) options.iterations = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--text-mb") == 0) options.textMegabytes = std::atoi(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--filter") == 0) options.filter = argv[i + 1];
+    }
+    options.iterations = std::max(1, options.iterations);
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    
+    // Headless: no display, software renderer
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    
+    Window window("gui_bench", 1280, 800);
+    SyntheticTree tree = populate(window, options);
+    window.show();
+    
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pointX(0, window.getWidth() - 1);
+    std::uniform_int_distribution<int> pointY(0, window.getHeight() - 1);
+    std::vector<std::pair<int, int>> points(256);
+    for (auto& point : points) {
+        point = {pointX(rng), pointY(rng)};
+    }
+    
+    // The last-built leaf is the worst case for a depth-first search
+    std::string lastLeafId = tree.leaves.empty() ? "" : tree.leaves.back()->getId();
+    
+    // Root handler so bubbling does real work at the top of the tree
+    size_t deliveredEvents = 0;
+    window.on(EventType::Click, [&deliveredEvents](const Event&) { ++deliveredEvents; });
+    
+    std::vector<Label*> labels;
+    for (Widget* leaf : tree.leaves) {
+        if (auto* label = dynamic_cast<Label*>(leaf)) {
+            labels.push_back(label);
+        }
+    }
+    
+    // Large text view, kept out of the widget tree so the tree cases stay comparable
+    Window textWindow("gui_bench text", 1280, 800);
+    auto textViewOwner = utils::create<TextView>("log");
+    TextView* textView = textViewOwner.get();
+    textView->setSize(1200, 760);
+    textWindow.add(std::move(textViewOwner));
+    std::string logText = generateLog(static_cast<size_t>(std::max(1, options.textMegabytes)) << 20);
+    int reflowStep = 0;
+    
+    // Same text on disk for the file-backed source
+    const std::string logPath = "gui_bench_log.txt";
+    {
+        std::FILE* file = std::fopen(logPath.c_str(), "wb");
+        if (file) {
+            std::fwrite(logText.data(), 1, logText.size(), file);
+            std::fclose(file);
+        }
+    }
+    
+    // The same screen as a compiled layout file
+    const std::string layoutPath = "gui_bench_screen.layout";
+    {
+        std::string json = "[";
+        int remaining = options.widgets;
+        int counter = 0;
+        while (remaining > 0) {
+            if (counter > 0) json += ',';
+            describeScreen(json, std::max(1, options.depth), screenFanout(options), remaining, counter);
+        }
+        json += "]";
+        UILayout::compile(json).save(layoutPath);
+    }
+    UILayout screenLayout;
+    screenLayout.load(layoutPath);
+    
+    // A live copy of the screen for the snapshot cases
+    Container workspace("workspace");
+    {
+        int remaining = options.widgets;
+        int counter = 0;
+        while (remaining > 0) {
+            buildScreen(workspace, std::max(1, options.depth), screenFanout(options), remaining, counter);
+        }
+    }
+    UILayout workspaceSnapshot = UILayout::capture(workspace);
+    
+    const int kPointerBurst = 1000;
+    
+    // Independent console windows for the parallel rendering cases; frames are not paced here
+    const int kConsoleWindows = 4;
+    std::vector<std::unique_ptr<Window>> consoles;
+    for (int i = 0; i < kConsoleWindows; ++i) {
+        auto console = std::make_unique<Window>("gui_bench console " + std::to_string(i), 1280, 800);
+        populate(*console, options);
+        console->show();
+        consoles.push_back(std::move(console));
+    }
+    InputPipeline::setFrameRate(1000000);
+    
+    // A dense panel of static labels for the subtree cache cases. Promotion is
+    // off so the unchanged trees above are always drawn widget by widget.
+    SubtreeCache::setPromotion(0, 0);
+    const int kPanelColumns = 8;
+    const int kPanelRows = 50;
+    Window panelWindow("gui_bench panel", 1280, 800);
+    auto panelOwner = utils::create<Container>("panel");
+    Container* panel = panelOwner.get();
+    panel->setPosition(8, 8).setSize(kPanelColumns * 150, kPanelRows * 15);
+    std::vector<Label*> panelLabels;
+    for (int row = 0; row < kPanelRows; ++row) {
+        for (int column = 0; column < kPanelColumns; ++column) {
+            auto label = utils::create<Label>("Field " + std::to_string(row * kPanelColumns + column));
+            label->setPosition(column * 150, row * 15);
+            panelLabels.push_back(label.get());
+            panel->add(std::move(label));
+        }
+    }
+    panelWindow.add(std::move(panelOwner));
+    panelWindow.show();
+    size_t panelEdits = 0;
+    auto cachePanel = [&](bool cache) {
+        if (panel->isCachedAsTexture() != cache) panel->setCacheAsTexture(cache);
+    };
+    
+    // A long form in sections of rows, moved under a fixed viewport as a
+    // scrolled container would; only the sections on screen should be drawn
+    const int kFormSections = 200;
+    const int kSectionRows = 25;
+    const int kRowHeight = 30;
+    Window formWindow("gui_bench form", 1280, 800);
+    auto viewportOwner = utils::create<Container>("viewport");
+    viewportOwner->setPosition(8, 8).setSize(1200, 760);
+    auto formOwner = utils::create<Container>("form");
+    Container* form = formOwner.get();
+    form->setSize(1200, kFormSections * kSectionRows * kRowHeight);
+    int formWidgets = 1;
+    for (int section = 0; section < kFormSections; ++section) {
+        auto sectionOwner = utils::create<Container>();
+        sectionOwner->setPosition(0, section * kSectionRows * kRowHeight).setSize(1200, kSectionRows * kRowHeight);
+        for (int row = 0; row < kSectionRows; ++row) {
+            std::string name = "Field " + std::to_string(section * kSectionRows + row);
+            auto rowOwner = utils::create<Container>();
+            rowOwner->setPosition(0, row * kRowHeight).setSize(1200, kRowHeight);
+            rowOwner->add(utils::create<Label>(name));
+            auto input = utils::create<TextInput>(name);
+            input->setPosition(200, 2).setSize(400, kRowHeight - 4);
+            rowOwner->add(std::move(input));
+            sectionOwner->add(std::move(rowOwner));
+            formWidgets += 3;
+        }
+        form->add(std::move(sectionOwner));
+        ++formWidgets;
+    }
+    viewportOwner->add(std::move(formOwner));
+    formWindow.add(std::move(viewportOwner));
+    formWindow.show();
+    auto renderFormAt = [&](int scrollY) {
+        form->setPosition(0, -scrollY);
+        formWindow.render();
+    };
+    
+    // Per-window frame and raster time summed per mode, serial first
+    std::vector<double> consoleFrameMs[2] = {std::vector<double>(kConsoleWindows), std::vector<double>(kConsoleWindows)};
+    std::vector<double> consoleRasterMs[2] = {std::vector<double>(kConsoleWindows), std::vector<double>(kConsoleWindows)};
+    int consoleFrames[2] = {0, 0};
+    auto renderConsoles = [&](bool parallel) {
+        Window::setParallelRendering(parallel);
+        for (auto& console : consoles) {
+            console->invalidate();
+        }
+        Window::renderPending();
+        for (int i = 0; i < kConsoleWindows; ++i) {
+            Window::FrameStats frame = consoles[i]->getFrameStats();
+            consoleFrameMs[parallel][i] += frame.lastMs;
+            consoleRasterMs[parallel][i] += frame.rasterMs;
+        }
+        ++consoleFrames[parallel];
+    };
+    
+    std::vector<BenchCase> cases = {
+        {"Window::render", 1, [&]() {
+            window.render();
+        }},
+        {"findWidgetAt", static_cast<double>(points.size()), [&]() {
+            for (const auto& point : points) {
+                Window::findWidgetAt(&window, point.first, point.second);
+            }
+        }},
+        {"Widget::find (deepest)", 1, [&]() {
+            window.find(lastLeafId);
+        }},
+        {"Layout::apply", static_cast<double>(tree.containers.size()), [&]() {
+            for (Container* container : tree.containers) {
+                container->applyLayout();
+            }
+        }},
+        {"emit (bubble to root)", static_cast<double>(tree.probes.size()), [&]() {
+            for (Probe* probe : tree.probes) {
+                probe->fire(Event{EventType::Click, probe, {}});
+            }
+        }},
+        // Capture, target and bubble through every ancestor; nothing handles it
+        {"dispatchEvent (3 phases)", static_cast<double>(tree.probes.size()), [&]() {
+            for (Probe* probe : tree.probes) {
+                Event event{EventType::Click, probe, {}};
+                Window::dispatchEvent(event);
+            }
+        }},
+        {"drawText (labels)", static_cast<double>(labels.size()), [&]() {
+            for (Label* label : labels) {
+                label->render();
+            }
+        }},
+        // Includes copying the text into the source and building the line index
+        {"TextView open", 1, [&]() {
+            textView->setText(logText);
+            textView->render();
+        }, 5},
+        {"TextView scroll page", 1, [&]() {
+            textView->scrollRows(40);
+            textView->render();
+        }},
+        {"TextView reflow", 1, [&]() {
+            textView->setSize(reflowStep++ % 2 ? 1200 : 900, 760);
+            textView->render();
+        }},
+        // Maps the file and builds the sparse line index
+        {"MappedFileSource open", 1, [&]() {
+            MappedFileSource source(logPath);
+            source.getLine(source.getLineCount() / 2);
+        }, 5},
+        // Construction, layout and teardown of a whole screen
+        {"screen build (code)", static_cast<double>(options.widgets), [&]() {
+            Container screen("screen");
+            int remaining = options.widgets;
+            int counter = 0;
+            while (remaining > 0) {
+                buildScreen(screen, std::max(1, options.depth), screenFanout(options), remaining, counter);
+            }
+        }, 20},
+        {"screen build (UILayout)", static_cast<double>(screenLayout.getWidgetCount()), [&]() {
+            Container screen("screen");
+            screenLayout.instantiate(screen);
+        }, 20},
+        {"UILayout load", 1, [&]() {
+            UILayout layout;
+            layout.load(layoutPath);
+        }, 20},
+        {"snapshot capture", static_cast<double>(options.widgets), [&]() {
+            UILayout::capture(workspace);
+        }, 20},
+        {"snapshot restore", static_cast<double>(workspaceSnapshot.getWidgetCount()), [&]() {
+            Container screen("screen");
+            workspaceSnapshot.instantiate(screen);
+        }, 20},
+        {"console windows (serial)", static_cast<double>(kConsoleWindows), [&]() {
+            renderConsoles(false);
+        }},
+        {"console windows (parallel)", static_cast<double>(kConsoleWindows), [&]() {
+            renderConsoles(true);
+        }},
+        {"static panel (direct)", static_cast<double>(panelLabels.size()), [&]() {
+            cachePanel(false);
+            panelWindow.render();
+        }},
+        {"static panel (cached)", static_cast<double>(panelLabels.size()), [&]() {
+            cachePanel(true);
+            panelWindow.render();
+        }},
+        // One label changes per frame, so the texture is redrawn and blitted each time
+        {"static panel (edited)", static_cast<double>(panelLabels.size()), [&]() {
+            cachePanel(true);
+            panelLabels[panelEdits++ % panelLabels.size()]->setText("Edited");
+            panelWindow.render();
+        }},
+        {"form frame (top)", 1, [&]() {
+            renderFormAt(0);
+        }},
+        {"form frame (scrolled)", 1, [&]() {
+            renderFormAt(form->getHeight() / 2);
+        }},
+        // A high-rate mouse: the burst is coalesced into one MouseMove and at most one frame
+        {"pointer burst", static_cast<double>(kPointerBurst), [&]() {
+            for (int i = 0; i < kPointerBurst; ++i) {
+                SDL_Event motion{};
+                motion.type = SDL_MOUSEMOTION;
+                motion.motion.windowID = SDL_GetWindowID(window.getSDLWindow());
+                motion.motion.x = points[i % points.size()].first;
+                motion.motion.y = points[i % points.size()].second;
+                SDL_PushEvent(&motion);
+            }
+            Window::processEvents();
+        }},
+    };
+    
+    std::printf("%s", Startup::formatReport().c_str());
+    std::printf("widgets=%d containers=%zu leaves=%zu depth=%d iterations=%d\n",
+                tree.widgetCount, tree.containers.size(), tree.leaves.size(), options.depth, options.iterations);
+    std::printf("%-28s %12s %12s %14s\n", "case", "median us", "p99 us", "ops/s");
+    
+    for (const BenchCase& benchCase : cases) {
+        if (!options.filter.empty() && std::string(benchCase.name).find(options.filter) == std::string::npos) {
+            continue;
+        }
+        int iterations = benchCase.iterations > 0 ? benchCase.iterations : options.iterations;
+        report(benchCase.name, measure(iterations, benchCase.opsPerIteration, benchCase.body));
+        // Only the parallel console case renders through display lists
+        Window::setParallelRendering(false);
+    }
+    
+    std::printf("%s", InputPipeline::formatStats().c_str());
+    for (int parallel = 0; parallel < 2 && consoleFrames[1] > 0; ++parallel) {
+        for (int i = 0; i < kConsoleWindows; ++i) {
+            int frames = std::max(consoleFrames[parallel], 1);
+            std::printf("console %d %-8s frame %8.3f ms avg, raster %8.3f ms\n", i, parallel ? "parallel" : "serial",
+                        consoleFrameMs[parallel][i] / frames, consoleRasterMs[parallel][i] / frames);
+        }
+    }
+    if (consoleFrames[1] > 0) {
+        std::printf("parallel scaling %.2fx over %d windows\n", Window::getParallelScaling(), kConsoleWindows);
+    }
+    std::printf("%s", SubtreeCache::formatStats().c_str());
+    Window::FrameStats formFrame = formWindow.getFrameStats();
+    std::printf("form %d widgets: %zu drawn, %zu culled last frame\n",
+                formWidgets, formFrame.widgetsDrawn, formFrame.widgetsCulled);
+    
+    std::remove(logPath.c_str());
+    std::remove(layoutPath.c_str());
+    return 0;
+}
@@ -1,16 +1,57 @@
 #include "gui.hpp"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include <stdexcept>
 #include <iostream>
 #include <algorithm>
 #include <queue>
 #include <chrono>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#undef MessageBox
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GUI_HAVE_SSE2 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace gui {
 
-// Internal rendering context
+struct DisplayList;
+
+// Internal rendering context: the current window's renderer and the font the
+// text helpers use. Windows own their renderers and bind them in makeCurrent().
 struct RenderContext {
     SDL_Renderer* renderer;
+    // Set while a frame is recorded for parallel rendering; the helpers draw into it
+    DisplayList* recording;
     TTF_Font* font;
     SDL_Color textColor;
     SDL_Color backgroundColor;
@@ -18,47 +59,225 @@ struct RenderContext {
     SDL_Color buttonColor;
     SDL_Color buttonHoverColor;
     SDL_Color buttonPressedColor;
+    // Clip rects in window coordinates, innermost last; see pushClip
+    std::vector<SDL_Rect> clipStack;
+    size_t widgetsDrawn;
+    size_t widgetsCulled;
     
-    RenderContext() : renderer(nullptr), font(nullptr),
+    RenderContext() : renderer(nullptr), recording(nullptr), font(nullptr),
         textColor{0, 0, 0, 255},
         backgroundColor{240, 240, 240, 255},
         borderColor{180, 180, 180, 255},
         buttonColor{225, 225, 225, 255},
         buttonHoverColor{210, 210, 210, 255},
-        buttonPressedColor{195, 195, 195, 255} {}
+        buttonPressedColor{195, 195, 195, 255}, widgetsDrawn(0), widgetsCulled(0) {}
 };
 
 static RenderContext g_context;
 static bool g_sdlInitialized = false;
 static bool g_eventLoopRunning = false;
 
+// Display lists for parallel rendering; see Window::setParallelRendering.
+// While a window is recorded the drawing helpers append commands instead of
+// calling its renderer, and a render worker later rasterizes them into the
+// window's frame surface without touching the renderer or SDL_ttf.
+struct DisplayCommand {
+    enum Kind : uint8_t {
+        Fill,
+        Outline,
+        Line,   // from (rect.x, rect.y) to (rect.w, rect.h)
+        Clip,   // rect.w < 0 turns clipping off
+        Blit
+    };
+    Kind kind;
+    SDL_Color color;        // draw color, or the color and alpha modulation of a blit
+    SDL_Rect rect;
+    SDL_Rect source;        // blits only, inside the surface
+    SDL_Surface* surface;   // blits only, ARGB8888
+};
+
+struct DisplayList {
+    std::vector<DisplayCommand> commands;
+    std::vector<SDL_Surface*> surfaces;   // a reference per blit, dropped on the UI thread once rasterized
+    
+    void reset() {
+        for (SDL_Surface* surface : surfaces) {
+            SDL_FreeSurface(surface);
+        }
+        surfaces.clear();
+        commands.clear();
+    }
+};
+
+// Render workers; jobs is only replaced while they are idle
+struct RenderWorkerState {
+    // UI thread only
+    bool enabled = false;
+    double scalingTotal = 0;
+    size_t parallelFrames = 0;
+    
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::vector<std::thread> threads;
+    std::vector<std::function<void()>> jobs;
+    size_t nextJob = 0;
+    size_t finishedJobs = 0;
+    bool stopping = false;
+    
+    ~RenderWorkerState() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+static RenderWorkerState g_renderWorkers;
+
+static const SDL_Color kNoModulation = {255, 255, 255, 255};
+
+static void recordCommand(DisplayCommand::Kind kind, const SDL_Color& color, const SDL_Rect& rect) {
+    g_context.recording->commands.push_back(DisplayCommand{kind, color, rect, SDL_Rect{}, nullptr});
+}
+
+// Records a blit of surface pixels, scaled into dest like SDL_RenderCopy; the
+// list holds a reference to the surface until the frame has been rasterized
+static void recordBlit(SDL_Surface* surface, const SDL_Rect* source, const SDL_Rect& dest, const SDL_Color& color) {
+    SDL_Rect from = source ? *source : SDL_Rect{0, 0, surface->w, surface->h};
+    if (from.w <= 0 || from.h <= 0 || dest.w <= 0 || dest.h <= 0 || from.x < 0 || from.y < 0 ||
+        from.x + from.w > surface->w || from.y + from.h > surface->h) {
+        return;
+    }
+    if (surface->format->format == SDL_PIXELFORMAT_ARGB8888) {
+        ++surface->refcount;
+    } else if (!(surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0))) {
+        return;
+    }
+    g_context.recording->surfaces.push_back(surface);
+    g_context.recording->commands.push_back(DisplayCommand{DisplayCommand::Blit, color, dest, from, surface});
+}
+
+// Pixels of cached textures, kept while parallel rendering is on so display
+// lists can blit what the renderer would have copied
+struct TexturePixels {
+    SDL_Renderer* renderer;
+    SDL_Surface* surface;
+};
+
+static std::unordered_map<SDL_Texture*, TexturePixels> g_texturePixels;
+
+// Takes the surface, which stays with the texture while parallel rendering is on
+static SDL_Texture* createCachedTexture(SDL_Renderer* renderer, SDL_Surface* surface) {
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
+    if (texture && g_renderWorkers.enabled) {
+        g_texturePixels[texture] = TexturePixels{renderer, surface};
+    } else {
+        SDL_FreeSurface(surface);
+    }
+    return texture;
+}
+
+static void destroyCachedTexture(SDL_Texture* texture) {
+    auto it = g_texturePixels.find(texture);
+    if (it != g_texturePixels.end()) {
+        SDL_FreeSurface(it->second.surface);
+        g_texturePixels.erase(it);
+    }
+    SDL_DestroyTexture(texture);
+}
+
+static SDL_Surface* cachedTexturePixels(SDL_Texture* texture) {
+    auto it = g_texturePixels.find(texture);
+    return it != g_texturePixels.end() ? it->second.surface : nullptr;
+}
+
+// False for a texture created before parallel rendering was turned on, which
+// has to be created again to be recorded
+static bool isCachedTextureDrawable(SDL_Texture* texture) {
+    return !g_context.recording || cachedTexturePixels(texture);
+}
+
+// Drops kept pixels: a renderer's before it is destroyed along with its
+// textures, or all of them when renderer is null
+static void releaseTexturePixels(SDL_Renderer* renderer) {
+    for (auto it = g_texturePixels.begin(); it != g_texturePixels.end();) {
+        if (renderer && it->second.renderer != renderer) {
+            ++it;
+            continue;
+        }
+        SDL_FreeSurface(it->second.surface);
+        it = g_texturePixels.erase(it);
+    }
+}
+
+static void drawCachedTexture(SDL_Texture* texture, const SDL_Rect& dest) {
+    if (g_context.recording) {
+        if (SDL_Surface* pixels = cachedTexturePixels(texture)) {
+            recordBlit(pixels, nullptr, dest, kNoModulation);
+        }
+        return;
+    }
+    SDL_RenderCopy(g_context.renderer, texture, nullptr, &dest);
+}
+
+// Startup pipeline; see Startup in gui.hpp
+struct StartupState {
+    std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+    std::thread loader;
+    bool loading = false;        // loader started and not yet joined; read and written by the UI thread
+    TTF_Font* font = nullptr;    // default font, handed over when the loader is joined
+    std::string error;
+    std::string glyphCacheFile;
+    std::string prewarmCharacters;
+    Startup::Report report{};
+};
+
+static StartupState g_startup;
+
+static TTF_Font* loadStartupFonts();
+static void startFontLoader();
+static void joinFontLoader();
+static void finishStartup();
+
+// Prebuilt glyphs; see GlyphCache
+static bool drawCachedGlyphs(const std::string& text, int x, int y, const SDL_Color& color);
+static bool measureCachedGlyphs(const std::string& text, int& w, int& h);
+static bool cachedGlyphAdvance(TTF_Font* font, uint32_t codepoint, int& advance);
+static void bindGlyphSet(TTF_Font* font);
+static void unbindGlyphSets();
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
 // Helper functions
 static void initSDL() {
     if (!g_sdlInitialized) {
+        auto start = std::chrono::steady_clock::now();
         if (SDL_Init(SDL_INIT_VIDEO) < 0) {
             throw std::runtime_error("SDL initialization failed: " + std::string(SDL_GetError()));
         }
         
-        if (TTF_Init() < 0) {
-            throw std::runtime_error("SDL_ttf initialization failed: " + std::string(TTF_GetError()));
-        }
-        
-        g_context.font = TTF_OpenFont("Arial.ttf", 14);
-        if (!g_context.font) {
-            // Fallback to a default font path
-            g_context.font = TTF_OpenFont("/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf", 14);
-            if (!g_context.font) {
-                g_context.font = TTF_OpenFont("C:\\Windows\\Fonts\\arial.ttf", 14);
-            }
-        }
-        
         g_sdlInitialized = true;
+        g_startup.report.sdlInitMs = millisecondsSince(start);
+        
+        // SDL_ttf and the fonts come up on the loader thread while the window is created
+        startFontLoader();
     }
 }
 
 static void drawRect(int x, int y, int w, int h, const SDL_Color& color, bool filled = true) {
-    SDL_SetRenderDrawColor(g_context.renderer, color.r, color.g, color.b, color.a);
     SDL_Rect rect = {x, y, w, h};
+    if (g_context.recording) {
+        recordCommand(filled ? DisplayCommand::Fill : DisplayCommand::Outline, color, rect);
+        return;
+    }
+    SDL_SetRenderDrawColor(g_context.renderer, color.r, color.g, color.b, color.a);
     if (filled) {
         SDL_RenderFillRect(g_context.renderer, &rect);
     } else {
@@ -67,11 +286,20 @@ static void drawRect(int x, int y, int w, int h, const SDL_Color& color, bool fi
 }
 
 static void drawText(const std::string& text, int x, int y, const SDL_Color& color) {
+    finishStartup();
     if (!g_context.font || text.empty()) return;
+    GUI_PROFILE_SCOPE("drawText");
+    if (drawCachedGlyphs(text, x, y, color)) return;
     
-    SDL_Surface* surface = TTF_RenderText_Blended(g_context.font, text.c_str(), color);
+    SDL_Surface* surface = TTF_RenderUTF8_Blended(g_context.font, text.c_str(), color);
     if (!surface) return;
     
+    if (g_context.recording) {
+        recordBlit(surface, nullptr, SDL_Rect{x, y, surface->w, surface->h}, kNoModulation);
+        SDL_FreeSurface(surface);
+        return;
+    }
+    
     SDL_Texture* texture = SDL_CreateTextureFromSurface(g_context.renderer, surface);
     if (texture) {
         SDL_Rect destRect = {x, y, surface->w, surface->h};
@@ -82,546 +310,7562 @@ static void drawText(const std::string& text, int x, int y, const SDL_Color& col
     SDL_FreeSurface(surface);
 }
 
+static void drawLine(int x1, int y1, int x2, int y2, const SDL_Color& color) {
+    if (g_context.recording) {
+        recordCommand(DisplayCommand::Line, color, SDL_Rect{x1, y1, x2, y2});
+        return;
+    }
+    SDL_SetRenderDrawColor(g_context.renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderDrawLine(g_context.renderer, x1, y1, x2, y2);
+}
+
 static void getTextSize(const std::string& text, int& w, int& h) {
+    finishStartup();
     if (!g_context.font || text.empty()) {
         w = h = 0;
         return;
     }
-    TTF_SizeText(g_context.font, text.c_str(), &w, &h);
+    if (measureCachedGlyphs(text, w, h)) return;
+    TTF_SizeUTF8(g_context.font, text.c_str(), &w, &h);
 }
 
-// Static member initialization
-std::vector<Window*> Window::windows;
+// Profiler implementation
+struct ProfilerState {
+    std::vector<Profiler::Sample> samples;
+    uint64_t sampleCursor = 0; // total samples ever recorded
+    Profiler::Frame frames[Profiler::kFrameHistory];
+    uint64_t frameCount = 0;
+    uint64_t frameStartNs = 0;
+    uint64_t frameFirstSample = 0;
+    uint64_t frameBusyNs = 0;
+    uint32_t depth = 0;
+    uint64_t childNs[Profiler::kMaxDepth];
+};
 
-// Widget implementation
-Widget::Widget(const std::string& id) 
-    : id(id), x(0), y(0), width(100), height(30), 
-      visible(true), enabled(true), parent(nullptr) {}
+static ProfilerState g_profiler;
 
-Widget& Widget::setPosition(int x, int y) {
-    this->x = x;
-    this->y = y;
-    return *this;
+uint64_t Profiler::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
 }
 
-Widget& Widget::setSize(int width, int height) {
-    this->width = width;
-    this->height = height;
-    return *this;
+void Profiler::setEnabled(bool enabled) {
+    if (enabled && !Profiler::enabled) {
+        if (g_profiler.samples.empty()) {
+            g_profiler.samples.resize(kSampleCapacity);
+        }
+        g_profiler.frameStartNs = now();
+        g_profiler.frameFirstSample = g_profiler.sampleCursor;
+        g_profiler.frameBusyNs = 0;
+    }
+    Profiler::enabled = enabled;
 }
 
-Widget& Widget::setVisible(bool visible) {
-    this->visible = visible;
-    return *this;
+void Profiler::beginScope() {
+    uint32_t depth = g_profiler.depth++;
+    if (depth < kMaxDepth) {
+        g_profiler.childNs[depth] = 0;
+    }
 }
 
-Widget& Widget::setEnabled(bool enabled) {
-    this->enabled = enabled;
-    return *this;
+void Profiler::endScope(const char* name, const Widget* widget, uint64_t startNs) {
+    uint64_t durationNs = now() - startNs;
+    if (g_profiler.depth == 0) return; // profiler was cleared while the scope was open
+    
+    uint32_t depth = --g_profiler.depth;
+    uint64_t childNs = depth < kMaxDepth ? g_profiler.childNs[depth] : 0;
+    if (depth == 0) {
+        g_profiler.frameBusyNs += durationNs;
+    } else if (depth - 1 < kMaxDepth) {
+        g_profiler.childNs[depth - 1] += durationNs;
+    }
+    
+    if (g_profiler.samples.empty()) return;
+    Sample& sample = g_profiler.samples[g_profiler.sampleCursor % kSampleCapacity];
+    sample.name = name;
+    sample.widget = widget ? widget->getHandle() : WidgetHandle();
+    sample.startNs = startNs;
+    sample.durationNs = durationNs;
+    sample.selfNs = durationNs > childNs ? durationNs - childNs : 0;
+    sample.depth = depth;
+    ++g_profiler.sampleCursor;
 }
 
-Widget& Widget::add(std::unique_ptr<Widget> child) {
-    child->parent = this;
-    children.push_back(std::move(child));
-    return *this;
+void Profiler::endFrame() {
+    if (!enabled) return;
+    
+    uint64_t endNs = now();
+    Frame& frame = g_profiler.frames[g_profiler.frameCount % kFrameHistory];
+    frame.index = g_profiler.frameCount;
+    frame.startNs = g_profiler.frameStartNs;
+    frame.durationNs = endNs - g_profiler.frameStartNs;
+    frame.busyNs = g_profiler.frameBusyNs;
+    frame.firstSample = g_profiler.frameFirstSample;
+    frame.sampleCount = g_profiler.sampleCursor - g_profiler.frameFirstSample;
+    ++g_profiler.frameCount;
+    
+    g_profiler.frameStartNs = endNs;
+    g_profiler.frameFirstSample = g_profiler.sampleCursor;
+    g_profiler.frameBusyNs = 0;
 }
 
-Widget* Widget::find(const std::string& id) {
-    if (this->id == id) return this;
-    
-    for (auto& child : children) {
-        if (Widget* found = child->find(id)) {
-            return found;
-        }
+std::vector<Profiler::Frame> Profiler::getFrames() {
+    std::vector<Frame> result;
+    uint64_t first = g_profiler.frameCount > kFrameHistory ? g_profiler.frameCount - kFrameHistory : 0;
+    for (uint64_t i = first; i < g_profiler.frameCount; ++i) {
+        result.push_back(g_profiler.frames[i % kFrameHistory]);
     }
-    return nullptr;
+    return result;
 }
 
-Widget& Widget::on(EventType type, EventHandler handler) {
-    eventHandlers[type].push_back(handler);
-    return *this;
+// Calls fn for every retained sample recorded since sequence number `since`, oldest first
+template <typename Fn>
+static void forEachRetainedSample(Fn fn, uint64_t since = 0) {
+    uint64_t end = g_profiler.sampleCursor;
+    uint64_t begin = end > Profiler::kSampleCapacity ? end - Profiler::kSampleCapacity : 0;
+    begin = std::max(begin, since);
+    for (uint64_t i = begin; i < end; ++i) {
+        fn(g_profiler.samples[i % Profiler::kSampleCapacity]);
+    }
 }
 
-void Widget::emit(const Event& event) {
-    auto it = eventHandlers.find(event.type);
-    if (it != eventHandlers.end()) {
-        for (auto& handler : it->second) {
-            handler(event);
-        }
+std::vector<Profiler::WidgetTiming> Profiler::getSlowestWidgets(size_t count, size_t frameWindow) {
+    frameWindow = std::min<uint64_t>({frameWindow, g_profiler.frameCount, kFrameHistory});
+    uint64_t since = g_profiler.sampleCursor;
+    if (frameWindow > 0) {
+        since = g_profiler.frames[(g_profiler.frameCount - frameWindow) % kFrameHistory].firstSample;
     }
     
-    // Bubble up to parent
-    if (parent && event.type != EventType::WindowClose) {
-        parent->emit(event);
-    }
-}
-
-// Button implementation
-Button::Button(const std::string& text, const std::string& id) 
-    : Widget(id), text(text) {
-    // Auto-size based on text
-    if (!text.empty() && g_context.font) {
-        int textW, textH;
-        getTextSize(text, textW, textH);
-        width = textW + 20;  // Add padding
-        height = textH + 10;
+    std::unordered_map<Widget*, std::pair<uint64_t, uint64_t>> totals; // self ns, calls
+    forEachRetainedSample([&](const Sample& sample) {
+        if (Widget* widget = sample.widget.get()) {
+            auto& total = totals[widget];
+            total.first += sample.selfNs;
+            ++total.second;
+        }
+    }, since);
+    
+    std::vector<std::pair<Widget*, std::pair<uint64_t, uint64_t>>> sorted(totals.begin(), totals.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second.first > b.second.first;
+    });
+    if (sorted.size() > count) sorted.resize(count);
+    
+    uint64_t frames = std::max<uint64_t>(1, frameWindow);
+    std::vector<WidgetTiming> result;
+    for (const auto& entry : sorted) {
+        std::string label = entry.first->getId().empty() ? "(unnamed)" : entry.first->getId();
+        result.push_back({label, entry.second.first / 1e6 / frames, entry.second.second});
     }
+    return result;
 }
 
-Button& Button::setText(const std::string& text) {
-    this->text = text;
-    // Auto-resize
-    if (!text.empty() && g_context.font) {
-        int textW, textH;
-        getTextSize(text, textW, textH);
-        width = textW + 20;
-        height = textH + 10;
+static void writeJsonString(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (char c : value) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out << escaped;
+                } else {
+                    out << c;
+                }
+        }
     }
-    return *this;
+    out << '"';
 }
 
-void Button::render() {
-    if (!visible) return;
+bool Profiler::exportChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
     
-    // Get absolute position
-    int absX = x;
-    int absY = y;
-    Widget* p = parent;
-    while (p) {
-        absX += p->getX();
-        absY += p->getY();
-        p = p->parent;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]() {
+        if (!first) out << ",";
+        first = false;
+        out << "\n";
+    };
+    
+    for (const Frame& frame : getFrames()) {
+        separator();
+        out << "{\"name\":\"frame " << frame.index << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0"
+            << ",\"ts\":" << frame.startNs / 1000.0 << ",\"dur\":" << frame.durationNs / 1000.0
+            << ",\"args\":{\"busy_us\":" << frame.busyNs / 1000.0 << "}}";
     }
     
-    // Check mouse state for hover/press effects
-    int mouseX, mouseY;
-    Uint32 mouseState = SDL_GetMouseState(&mouseX, &mouseY);
-    bool hover = mouseX >= absX && mouseX < absX + width && 
-                 mouseY >= absY && mouseY < absY + height;
-    bool pressed = hover && (mouseState & SDL_BUTTON(SDL_BUTTON_LEFT));
+    forEachRetainedSample([&](const Sample& sample) {
+        separator();
+        out << "{\"name\":";
+        writeJsonString(out, sample.name);
+        out << ",\"cat\":\"gui\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+            << ",\"ts\":" << sample.startNs / 1000.0 << ",\"dur\":" << sample.durationNs / 1000.0;
+        if (Widget* widget = sample.widget.get()) {
+            out << ",\"args\":{\"widget\":";
+            writeJsonString(out, widget->getId());
+            out << "}";
+        }
+        out << "}";
+    });
     
-    // Draw button background
-    SDL_Color btnColor = pressed ? g_context.buttonPressedColor : 
-                        (hover ? g_context.buttonHoverColor : g_context.buttonColor);
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
+
+void Profiler::clear() {
+    g_profiler.sampleCursor = 0;
+    g_profiler.frameCount = 0;
+    g_profiler.frameFirstSample = 0;
+    g_profiler.frameBusyNs = 0;
+    g_profiler.frameStartNs = now();
+    g_profiler.depth = 0;
+}
+
+// In-app overlay: frame busy-time graph plus the slowest widgets
+static void drawProfilerOverlay(int windowWidth) {
+    const int graphWidth = 240;
+    const int graphHeight = 60;
+    const int panelWidth = graphWidth + 20;
+    const int panelHeight = graphHeight + 120;
+    const double budgetMs = 1000.0 / 60.0;
+    int panelX = windowWidth - panelWidth - 10;
+    int panelY = 10;
     
-    if (enabled) {
-        drawRect(absX, absY, width, height, btnColor);
-    } else {
-        SDL_Color disabledColor = {200, 200, 200, 255};
-        drawRect(absX, absY, width, height, disabledColor);
+    drawRect(panelX, panelY, panelWidth, panelHeight, SDL_Color{20, 20, 20, 220});
+    
+    // One bar per frame, scaled so the 60 FPS budget sits at half height
+    std::vector<Profiler::Frame> frames = Profiler::getFrames();
+    int graphX = panelX + 10;
+    int graphY = panelY + 10;
+    size_t visible = std::min<size_t>(frames.size(), graphWidth / 2);
+    for (size_t i = 0; i < visible; ++i) {
+        const Profiler::Frame& frame = frames[frames.size() - visible + i];
+        double ms = frame.busyNs / 1e6;
+        int barHeight = std::min(graphHeight, static_cast<int>(ms / (budgetMs * 2) * graphHeight));
+        SDL_Color barColor = ms > budgetMs ? SDL_Color{220, 70, 60, 255} : SDL_Color{90, 200, 90, 255};
+        drawRect(graphX + static_cast<int>(i) * 2, graphY + graphHeight - barHeight, 2, barHeight, barColor);
     }
+    drawRect(graphX, graphY + graphHeight / 2, graphWidth, 1, SDL_Color{200, 200, 200, 255});
     
-    // Draw border
-    drawRect(absX, absY, width, height, g_context.borderColor, false);
+    SDL_Color textColor{230, 230, 230, 255};
+    int textY = graphY + graphHeight + 6;
+    if (!frames.empty()) {
+        char line[64];
+        std::snprintf(line, sizeof(line), "frame %.2f ms (busy %.2f ms)",
+                      frames.back().durationNs / 1e6, frames.back().busyNs / 1e6);
+        drawText(line, graphX, textY, textColor);
+    }
     
-    // Draw text centered
-    if (!text.empty()) {
-        int textW, textH;
-        getTextSize(text, textW, textH);
-        int textX = absX + (width - textW) / 2;
-        int textY = absY + (height - textH) / 2;
-        
-        SDL_Color textColor = enabled ? g_context.textColor : SDL_Color{150, 150, 150, 255};
-        drawText(text, textX, textY, textColor);
+    for (const auto& timing : Profiler::getSlowestWidgets(5, 30)) {
+        textY += 18;
+        char line[128];
+        std::snprintf(line, sizeof(line), "%.3f ms  %s", timing.averageMs, timing.label.c_str());
+        drawText(line, graphX, textY, textColor);
     }
 }
 
-void Button::click() {
-    if (!enabled) return;
-    Event event{EventType::Click, this, {}};
-    emit(event);
+// Decodes one UTF-8 sequence and advances p; malformed input yields U+FFFD
+static uint32_t decodeUtf8(const char*& p, const char* end) {
+    unsigned char lead = static_cast<unsigned char>(*p++);
+    if (lead < 0x80) return lead;
+    
+    int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+    if (extra < 0 || end - p < extra) return 0xFFFD;
+    
+    uint32_t codepoint = lead & (0x3F >> extra);
+    for (int i = 0; i < extra; ++i) {
+        unsigned char next = static_cast<unsigned char>(*p);
+        if ((next & 0xC0) != 0x80) return 0xFFFD;
+        codepoint = (codepoint << 6) | (next & 0x3F);
+        ++p;
+    }
+    return codepoint;
 }
 
-// Label implementation
-Label::Label(const std::string& text, const std::string& id) 
-    : Widget(id), text(text) {
-    // Auto-size based on text
-    if (!text.empty() && g_context.font) {
-        int textW, textH;
-        getTextSize(text, textW, textH);
-        width = textW;
-        height = textH;
+// FNV-1a, used to key layout and raster caches by content
+static uint64_t hashBytes(std::string_view bytes, uint64_t seed = 1469598103934665603ull) {
+    uint64_t hash = seed;
+    for (char c : bytes) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
     }
+    return hash;
 }
 
-Label& Label::setText(const std::string& text) {
-    this->text = text;
-    // Auto-resize
-    if (!text.empty() && g_context.font) {
-        int textW, textH;
-        getTextSize(text, textW, textH);
-        width = textW;
-        height = textH;
+// Glyph advances measured once per codepoint and font; ASCII lives in a flat table
+struct GlyphAdvanceCache {
+    int ascii[128];
+    std::unordered_map<uint32_t, int> other;
+    
+    GlyphAdvanceCache() {
+        std::fill(std::begin(ascii), std::end(ascii), -1);
     }
-    return *this;
-}
+};
 
-void Label::render() {
-    if (!visible) return;
+struct GlyphAdvanceState {
+    std::unordered_map<TTF_Font*, GlyphAdvanceCache> fonts;
+    TTF_Font* currentFont = nullptr;       // last font looked up, usually the same run after run
+    GlyphAdvanceCache* current = nullptr;
+};
+
+static GlyphAdvanceState g_glyphAdvances;
+
+static int glyphAdvance(uint32_t codepoint) {
+    finishStartup();
+    if (!g_context.font) return 0;
+    if (g_glyphAdvances.currentFont != g_context.font) {
+        g_glyphAdvances.currentFont = g_context.font;
+        g_glyphAdvances.current = &g_glyphAdvances.fonts[g_context.font];
+    }
+    GlyphAdvanceCache& cache = *g_glyphAdvances.current;
     
-    // Get absolute position
-    int absX = x;
-    int absY = y;
-    Widget* p = parent;
-    while (p) {
-        absX += p->getX();
-        absY += p->getY();
-        p = p->parent;
+    int* slot;
+    if (codepoint < 128) {
+        slot = &cache.ascii[codepoint];
+        if (*slot >= 0) return *slot;
+    } else {
+        auto it = cache.other.find(codepoint);
+        if (it != cache.other.end()) return it->second;
+        slot = &cache.other[codepoint];
     }
     
-    // Draw text
-    if (!text.empty()) {
-        drawText(text, absX, absY, g_context.textColor);
+    int minX, maxX, minY, maxY, advance = 0;
+    if (!cachedGlyphAdvance(g_context.font, codepoint, advance) &&
+        TTF_GlyphMetrics32(g_context.font, codepoint, &minX, &maxX, &minY, &maxY, &advance) != 0) {
+        advance = 0;
     }
+    *slot = advance;
+    return advance;
 }
 
-// TextInput implementation
-TextInput::TextInput(const std::string& placeholder, const std::string& id) 
-    : Widget(id), placeholder(placeholder) {
-    width = 200;
-    height = 30;
+// FontManager implementation
+struct FontManagerState {
+    std::unordered_map<std::string, TTF_Font*> fonts;          // "family\0size\0style" -> handle
+    std::unordered_map<std::string, std::string> resolved;     // family -> file, "" if none
+    std::unordered_map<std::string, std::string> registered;   // family -> file given by the app
+    
+    struct OpenFont {
+        std::string path;
+        int size;
+        int style;
+    };
+    std::unordered_map<TTF_Font*, OpenFont> openFonts;
+    std::vector<std::string> searchPaths;
+    
+    // Most lookups repeat the previous one, so skip building the key for them
+    std::string lastFamily;
+    int lastSize = 0;
+    int lastStyle = -1;
+    TTF_Font* lastFont = nullptr;
+    
+    double resolveMs = 0;
+    double loadMs = 0;
+    double startupMs = 0;
+};
+
+static FontManagerState g_fonts;
+
+// Generic families and the families they fall back to, in order
+static const std::vector<std::vector<std::string>>& fontFallbacks() {
+    static const std::vector<std::vector<std::string>> chains = {
+        {"sans-serif", "Arial", "Helvetica", "Liberation Sans", "DejaVu Sans", "Segoe UI"},
+        {"serif", "Times New Roman", "Times", "Liberation Serif", "DejaVu Serif"},
+        {"monospace", "Courier New", "Courier", "Liberation Mono", "DejaVu Sans Mono", "Consolas"},
+    };
+    return chains;
 }
 
-TextInput& TextInput::setText(const std::string& text) {
-    this->text = text;
-    Event event{EventType::TextChanged, this, {{"text", text}}};
-    emit(event);
-    return *this;
+// File names a family is commonly installed under
+static std::vector<std::string> fontFileNames(const std::string& family) {
+    static const std::unordered_map<std::string, std::vector<std::string>> known = {
+        {"Arial", {"Arial.ttf", "arial.ttf"}},
+        {"Helvetica", {"Helvetica.ttc"}},
+        {"Liberation Sans", {"LiberationSans-Regular.ttf"}},
+        {"DejaVu Sans", {"DejaVuSans.ttf"}},
+        {"Segoe UI", {"segoeui.ttf"}},
+        {"Times New Roman", {"Times New Roman.ttf", "times.ttf"}},
+        {"Times", {"Times.ttc"}},
+        {"Liberation Serif", {"LiberationSerif-Regular.ttf"}},
+        {"DejaVu Serif", {"DejaVuSerif.ttf"}},
+        {"Courier New", {"Courier New.ttf", "cour.ttf"}},
+        {"Courier", {"Courier.ttc"}},
+        {"Liberation Mono", {"LiberationMono-Regular.ttf"}},
+        {"DejaVu Sans Mono", {"DejaVuSansMono.ttf"}},
+        {"Consolas", {"consola.ttf"}},
+    };
+    auto it = known.find(family);
+    if (it != known.end()) return it->second;
+    
+    std::string compact;
+    for (char c : family) {
+        if (c != ' ') compact += c;
+    }
+    return {family + ".ttf", compact + ".ttf", compact + "-Regular.ttf"};
 }
 
-TextInput& TextInput::setPlaceholder(const std::string& placeholder) {
-    this->placeholder = placeholder;
-    return *this;
+static bool fontFileExists(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::fclose(file);
+    return true;
 }
 
-void TextInput::render() {
-    if (!visible) return;
+// The working directory first, then the usual system locations
+static std::string findFontFile(const std::string& family) {
+    static const char* const systemPaths[] = {
+        "",
+        "/usr/share/fonts/truetype/liberation/",
+        "/usr/share/fonts/truetype/dejavu/",
+        "/usr/share/fonts/liberation/",
+        "/usr/share/fonts/dejavu/",
+        "/usr/share/fonts/TTF/",
+        "/Library/Fonts/",
+        "/System/Library/Fonts/Supplemental/",
+        "/System/Library/Fonts/",
+        "C:\\Windows\\Fonts\\",
+    };
     
-    // Get absolute position
-    int absX = x;
-    int absY = y;
-    Widget* p = parent;
-    while (p) {
-        absX += p->getX();
-        absY += p->getY();
-        p = p->parent;
+    std::vector<std::string> names = fontFileNames(family);
+    for (const std::string& directory : g_fonts.searchPaths) {
+        for (const std::string& name : names) {
+            std::string path = directory + "/" + name;
+            if (fontFileExists(path)) return path;
+        }
     }
+    for (const char* directory : systemPaths) {
+        for (const std::string& name : names) {
+            std::string path = directory + name;
+            if (fontFileExists(path)) return path;
+        }
+    }
+    return "";
+}
+
+const std::string& FontManager::resolve(const std::string& family) {
+    finishStartup();
+    auto cached = g_fonts.resolved.find(family);
+    if (cached != g_fonts.resolved.end()) return cached->second;
+    
+    auto start = std::chrono::steady_clock::now();
+    std::string path;
+    auto registered = g_fonts.registered.find(family);
+    if (registered != g_fonts.registered.end()) {
+        path = registered->second;
+    } else {
+        // The family itself, then the rest of any fallback chain it belongs to
+        std::vector<std::string> candidates = {family};
+        for (const auto& chain : fontFallbacks()) {
+            if (std::find(chain.begin(), chain.end(), family) == chain.end()) continue;
+            candidates.insert(candidates.end(), chain.begin() + 1, chain.end());
+            break;
+        }
+        for (const std::string& candidate : candidates) {
+            if (candidate != family && g_fonts.resolved.count(candidate)) {
+                path = g_fonts.resolved[candidate];
+            } else {
+                path = findFontFile(candidate);
+            }
+            if (!path.empty()) break;
+        }
+        
+        // Unknown families end up on the default sans-serif face
+        if (path.empty() && family != "sans-serif") {
+            path = resolve("sans-serif");
+        }
+    }
+    g_fonts.resolveMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return g_fonts.resolved[family] = path;
+}
+
+TTF_Font* FontManager::get(const std::string& family, int size, int style) {
+    finishStartup();
+    if (!g_sdlInitialized) return nullptr;
+    if (size == g_fonts.lastSize && style == g_fonts.lastStyle && family == g_fonts.lastFamily) {
+        return g_fonts.lastFont;
+    }
+    
+    std::string key = family;
+    key += '\0';
+    key += std::to_string(size);
+    key += '\0';
+    key += std::to_string(style);
+    
+    TTF_Font* font;
+    auto it = g_fonts.fonts.find(key);
+    if (it != g_fonts.fonts.end()) {
+        font = it->second;
+    } else {
+        GUI_PROFILE_SCOPE("FontManager::load");
+        const std::string& path = resolve(family);
+        auto start = std::chrono::steady_clock::now();
+        font = path.empty() ? nullptr : TTF_OpenFont(path.c_str(), std::max(1, size));
+        if (font && style != Normal) {
+            TTF_SetFontStyle(font, style);
+        }
+        g_fonts.loadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        g_fonts.fonts[key] = font;
+        if (font) {
+            g_fonts.openFonts[font] = FontManagerState::OpenFont{path, size, style};
+            bindGlyphSet(font);
+        }
+    }
+    
+    g_fonts.lastFamily = family;
+    g_fonts.lastSize = size;
+    g_fonts.lastStyle = style;
+    g_fonts.lastFont = font;
+    return font;
+}
+
+void FontManager::registerFamily(const std::string& family, const std::string& path) {
+    finishStartup();
+    g_fonts.registered[family] = path;
+    g_fonts.resolved.clear();   // fallbacks may now land elsewhere
+}
+
+void FontManager::addSearchPath(const std::string& directory) {
+    finishStartup();
+    g_fonts.searchPaths.push_back(directory);
+    g_fonts.resolved.clear();
+}
+
+void FontManager::releaseAll() {
+    joinFontLoader();
+    for (auto& entry : g_fonts.fonts) {
+        if (entry.second) {
+            TTF_CloseFont(entry.second);
+        }
+    }
+    g_fonts.fonts.clear();
+    g_fonts.openFonts.clear();
+    unbindGlyphSets();
+    g_fonts.lastFamily.clear();
+    g_fonts.lastStyle = -1;
+    g_fonts.lastFont = nullptr;
+    g_glyphAdvances.fonts.clear();
+    g_glyphAdvances.currentFont = nullptr;
+    g_glyphAdvances.current = nullptr;
+}
+
+FontManager::Stats FontManager::getStats() {
+    joinFontLoader();
+    Stats stats{};
+    for (const auto& entry : g_fonts.fonts) {
+        if (entry.second) ++stats.fonts;
+    }
+    stats.families = g_fonts.resolved.size();
+    stats.resolveMs = g_fonts.resolveMs;
+    stats.loadMs = g_fonts.loadMs;
+    stats.startupMs = g_fonts.startupMs;
+    return stats;
+}
+
+// Resolves the generic fallback chains once and opens the default UI font
+static TTF_Font* loadStartupFonts() {
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& chain : fontFallbacks()) {
+        FontManager::resolve(chain.front());
+    }
+    TTF_Font* font = FontManager::get(FontManager::kDefaultFamily, FontManager::kDefaultSize);
+    g_fonts.startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return font;
+}
+
+// Makes the widget's style font current for the text helpers while it
+// renders or handles an event
+class FontScope {
+public:
+    explicit FontScope(const Widget* widget) {
+        finishStartup();
+        previous = g_context.font;
+        const Style& style = widget->getStyle();
+        if (TTF_Font* font = FontManager::get(style.fontFamily, style.fontSize)) {
+            g_context.font = font;
+        }
+    }
+    
+    ~FontScope() { g_context.font = previous; }
+    
+    FontScope(const FontScope&) = delete;
+    FontScope& operator=(const FontScope&) = delete;
+    
+private:
+    TTF_Font* previous;
+};
+
+// Delivers an event with the widget's font current, as during render
+static bool dispatchToWidget(Widget* widget, const Event& event) {
+    FontScope font(widget);
+    return widget->handleEvent(event);
+}
+
+// SDL reads an empty clip rect as no clipping at all, so an empty
+// intersection clips to a pixel outside the target instead
+static void applyClip() {
+    if (g_context.recording) {
+        SDL_Rect none = {0, 0, -1, -1};
+        recordCommand(DisplayCommand::Clip, SDL_Color{}, g_context.clipStack.empty() ? none : g_context.clipStack.back());
+        return;
+    }
+    if (g_context.clipStack.empty()) {
+        SDL_RenderSetClipRect(g_context.renderer, nullptr);
+        return;
+    }
+    const SDL_Rect& clip = g_context.clipStack.back();
+    if (clip.w > 0 && clip.h > 0) {
+        SDL_RenderSetClipRect(g_context.renderer, &clip);
+    } else {
+        SDL_Rect outside = {-1, -1, 1, 1};
+        SDL_RenderSetClipRect(g_context.renderer, &outside);
+    }
+}
+
+// Narrows drawing to rect, in window coordinates, until the matching popClip
+static void pushClip(const SDL_Rect& rect) {
+    SDL_Rect clip = rect;
+    if (!g_context.clipStack.empty() && !SDL_IntersectRect(&rect, &g_context.clipStack.back(), &clip)) {
+        clip = {0, 0, 0, 0};
+    }
+    g_context.clipStack.push_back(clip);
+    applyClip();
+}
+
+static void popClip() {
+    g_context.clipStack.pop_back();
+    applyClip();
+}
+
+// Renders one child, timed per widget when profiling. A child outside the
+// clip rect is skipped with its whole subtree after one rectangle test.
+static void renderWidget(Widget* widget) {
+    if (!widget->isVisible()) return;
+    
+    widget->updateRenderOrigin();
+    SDL_Rect bounds = {widget->getRenderX(), widget->getRenderY(), widget->getWidth(), widget->getHeight()};
+    if (!g_context.clipStack.empty() && !SDL_HasIntersection(&bounds, &g_context.clipStack.back())) {
+        g_context.widgetsCulled++;
+        return;
+    }
+    g_context.widgetsDrawn++;
+    
+    GUI_PROFILE_WIDGET("render", widget);
+    FontScope font(widget);
+    widget->render();
+}
+
+// Static member initialization
+std::vector<Window*> Window::windows;
+
+// Widget handle registry: slot -> live widget, generation bumped on destruction.
+// Slot 0 is reserved so a default-constructed handle never resolves.
+static std::vector<Widget*> g_widgetSlots(1, nullptr);
+static std::vector<uint32_t> g_widgetGenerations(1, 0);
+static std::vector<uint32_t> g_freeWidgetSlots;
+
+Widget* WidgetHandle::get() const {
+    if (slot == 0 || slot >= g_widgetSlots.size() || g_widgetGenerations[slot] != generation) {
+        return nullptr;
+    }
+    return g_widgetSlots[slot];
+}
+
+// Widget storage. Every widget carries a one-word header naming the arena it
+// was carved from, or null for a plain heap allocation. UILayout::instantiate
+// opens an arena sized for its whole tree on the calling thread; widgets built
+// outside one go straight to ::operator new. An arena is freed when its last
+// widget is destroyed, so evicted or discarded subtrees give their memory back
+// with the rest of the tree they were loaded with.
+struct WidgetArena {
+    std::atomic<size_t> live;    // widgets still in it, plus one while instantiate fills it
+    char* next;
+    char* end;
+};
+
+static constexpr size_t kWidgetHeader = alignof(std::max_align_t);
+static thread_local WidgetArena* t_widgetArena = nullptr;
+
+#if defined(__SANITIZE_ADDRESS__)
+#define GUI_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define GUI_ASAN 1
+#endif
+#endif
+
+#ifdef GUI_ASAN
+extern "C" void __asan_poison_memory_region(const volatile void* address, size_t size);
+extern "C" void __asan_unpoison_memory_region(const volatile void* address, size_t size);
+#endif
+
+static size_t widgetArenaStride(size_t size) {
+    return kWidgetHeader + (size + kWidgetHeader - 1) / kWidgetHeader * kWidgetHeader;
+}
+
+static WidgetArena* openWidgetArena(size_t bytes) {
+    char* block = static_cast<char*>(::operator new(sizeof(WidgetArena) + kWidgetHeader + bytes));
+    WidgetArena* arena = new (block) WidgetArena{};
+    arena->live = 1;
+    arena->next = block + (sizeof(WidgetArena) + kWidgetHeader - 1) / kWidgetHeader * kWidgetHeader;
+    arena->end = arena->next + bytes;
+    return arena;
+}
+
+static void releaseWidgetArena(WidgetArena* arena) {
+    if (--arena->live > 0) return;
+    arena->~WidgetArena();
+    ::operator delete(static_cast<void*>(arena));
+}
+
+void* Widget::operator new(size_t size) {
+    size_t stride = widgetArenaStride(size);
+    WidgetArena* arena = t_widgetArena;
+    char* slot;
+    if (arena && static_cast<size_t>(arena->end - arena->next) >= stride) {
+        slot = arena->next;
+        arena->next += stride;
+        ++arena->live;
+    } else {
+        slot = static_cast<char*>(::operator new(kWidgetHeader + size));
+        arena = nullptr;
+    }
+    *reinterpret_cast<WidgetArena**>(slot) = arena;
+    return slot + kWidgetHeader;
+}
+
+void Widget::operator delete(void* pointer, size_t size) {
+    char* slot = static_cast<char*>(pointer) - kWidgetHeader;
+    WidgetArena* arena = *reinterpret_cast<WidgetArena**>(slot);
+    if (!arena) {
+        ::operator delete(slot);
+        return;
+    }
+#ifdef GUI_ASAN
+    // Arena slots are never reused, so a stale pointer into one still faults
+    __asan_poison_memory_region(pointer, size);
+#else
+    (void)size;
+#endif
+    releaseWidgetArena(arena);
+}
+
+// ImageCache implementation
+struct ImageEntry {
+    SDL_Renderer* renderer = nullptr;
+    std::string key;
+    std::string path;
+    int requestedWidth = 0;
+    int requestedHeight = 0;
+    
+    SDL_Texture* texture = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t bytes = 0;
+    bool pending = false;   // queued for the decoder thread
+    bool failed = false;
+    bool pinned = false;    // raw texture handed out by utils::loadImage
+    std::list<ImageEntry*>::iterator lruPosition;
+};
+
+// Work for the decoder thread, by value so it never touches live entries
+struct ImageJob {
+    std::string key;
+    std::string path;
+    int width;
+    int height;
+};
+
+struct DecodedImage {
+    std::string key;
+    SDL_Surface* surface;
+};
+
+static void imageDecoderLoop();
+
+struct ImageCacheState {
+    // UI thread only
+    std::unordered_map<std::string, std::shared_ptr<ImageEntry>> entries;
+    std::list<ImageEntry*> lru; // most recently requested first
+    size_t budget = ImageCache::kDefaultBudget;
+    size_t textureBytes = 0;
+    size_t pending = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    
+    // Shared with the decoder thread
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<ImageJob> queue;
+    std::vector<DecodedImage> decoded;
+    std::thread worker;
+    bool stopping = false;
+    Uint32 readyEvent = static_cast<Uint32>(-1);
+    
+    ~ImageCacheState() {
+        if (worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            worker.join();
+        }
+        for (DecodedImage& image : decoded) {
+            SDL_FreeSurface(image.surface);
+        }
+        // Textures are owned by their renderers at this point
+    }
+};
+
+static ImageCacheState g_imageCache;
+
+// Thread-safe: only touches the surfaces it creates
+static SDL_Surface* decodeImage(const std::string& path, int width, int height) {
+    SDL_Surface* loaded = SDL_LoadBMP(path.c_str());
+    if (!loaded) return nullptr;
+    
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded);
+    if (!converted || width <= 0 || height <= 0 || (converted->w == width && converted->h == height)) {
+        return converted;
+    }
+    
+    SDL_Surface* scaled = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (scaled) {
+        SDL_SetSurfaceBlendMode(converted, SDL_BLENDMODE_NONE);
+        SDL_BlitScaled(converted, nullptr, scaled, nullptr);
+    }
+    SDL_FreeSurface(converted);
+    return scaled;
+}
+
+static void imageDecoderLoop() {
+    for (;;) {
+        ImageJob job;
+        {
+            std::unique_lock<std::mutex> lock(g_imageCache.mutex);
+            g_imageCache.wake.wait(lock, [] { return g_imageCache.stopping || !g_imageCache.queue.empty(); });
+            if (g_imageCache.stopping) return;
+            job = std::move(g_imageCache.queue.front());
+            g_imageCache.queue.pop_front();
+        }
+        
+        SDL_Surface* surface = decodeImage(job.path, job.width, job.height);
+        {
+            std::lock_guard<std::mutex> lock(g_imageCache.mutex);
+            g_imageCache.decoded.push_back({std::move(job.key), surface});
+        }
+        
+        // Wake an idle event loop so the image gets uploaded and drawn
+        if (g_imageCache.readyEvent != static_cast<Uint32>(-1)) {
+            SDL_Event event{};
+            event.type = g_imageCache.readyEvent;
+            SDL_PushEvent(&event);
+        }
+    }
+}
+
+static std::shared_ptr<ImageEntry> lookupImage(SDL_Renderer* renderer, const std::string& path,
+                                               int width, int height, bool& created) {
+    std::string key = std::to_string(reinterpret_cast<uintptr_t>(renderer)) + ':' +
+                      std::to_string(width) + 'x' + std::to_string(height) + ':' + path;
+    std::shared_ptr<ImageEntry>& slot = g_imageCache.entries[key];
+    created = !slot;
+    
+    if (!created) {
+        ++g_imageCache.hits;
+        g_imageCache.lru.splice(g_imageCache.lru.begin(), g_imageCache.lru, slot->lruPosition);
+        return slot;
+    }
+    
+    ++g_imageCache.misses;
+    slot = std::make_shared<ImageEntry>();
+    slot->renderer = renderer;
+    slot->key = std::move(key);
+    slot->path = path;
+    slot->requestedWidth = width;
+    slot->requestedHeight = height;
+    g_imageCache.lru.push_front(slot.get());
+    slot->lruPosition = g_imageCache.lru.begin();
+    return slot;
+}
+
+static void uploadImage(ImageEntry& entry, SDL_Surface* surface) {
+    if (entry.pending) {
+        entry.pending = false;
+        --g_imageCache.pending;
+    }
+    
+    // A synchronous load() may have finished first
+    if (entry.texture || entry.failed) {
+        if (surface) SDL_FreeSurface(surface);
+        return;
+    }
+    if (!surface) {
+        entry.failed = true;
+        return;
+    }
+    
+    entry.width = surface->w;
+    entry.height = surface->h;
+    entry.texture = createCachedTexture(entry.renderer, surface);
+    if (!entry.texture) {
+        entry.failed = true;
+        return;
+    }
+    
+    SDL_SetTextureBlendMode(entry.texture, SDL_BLENDMODE_BLEND);
+    entry.bytes = static_cast<size_t>(entry.width) * entry.height * 4;
+    g_imageCache.textureBytes += entry.bytes;
+}
+
+static std::shared_ptr<ImageEntry> loadImageEntry(SDL_Renderer* renderer, const std::string& path,
+                                                  int width, int height) {
+    bool created;
+    std::shared_ptr<ImageEntry> entry = lookupImage(renderer, path, width, height, created);
+    if (!entry->texture && !entry->failed) {
+        // New, or still queued: decode here rather than wait for the worker
+        uploadImage(*entry, decodeImage(path, width, height));
+        ImageCache::trim();
+    }
+    return entry;
+}
+
+SDL_Texture* Image::getTexture() const {
+    return entry ? entry->texture : nullptr;
+}
+
+bool Image::isFailed() const {
+    return entry && entry->failed;
+}
+
+int Image::getWidth() const {
+    return entry ? entry->width : 0;
+}
+
+int Image::getHeight() const {
+    return entry ? entry->height : 0;
+}
+
+const std::string& Image::getPath() const {
+    static const std::string empty;
+    return entry ? entry->path : empty;
+}
+
+Image ImageCache::request(SDL_Renderer* renderer, const std::string& path, int width, int height) {
+    bool created;
+    std::shared_ptr<ImageEntry> entry = lookupImage(renderer, path, width, height, created);
+    if (created) {
+        entry->pending = true;
+        ++g_imageCache.pending;
+        {
+            std::lock_guard<std::mutex> lock(g_imageCache.mutex);
+            if (!g_imageCache.worker.joinable()) {
+                g_imageCache.readyEvent = SDL_RegisterEvents(1);
+                g_imageCache.worker = std::thread(imageDecoderLoop);
+            }
+            g_imageCache.queue.push_back({entry->key, path, width, height});
+        }
+        g_imageCache.wake.notify_one();
+    }
+    return Image(entry);
+}
+
+Image ImageCache::load(SDL_Renderer* renderer, const std::string& path, int width, int height) {
+    return Image(loadImageEntry(renderer, path, width, height));
+}
+
+size_t ImageCache::pump(size_t maxUploads) {
+    std::vector<DecodedImage> batch;
+    {
+        std::lock_guard<std::mutex> lock(g_imageCache.mutex);
+        size_t count = std::min(maxUploads, g_imageCache.decoded.size());
+        if (count == 0) return 0;
+        batch.assign(g_imageCache.decoded.begin(), g_imageCache.decoded.begin() + count);
+        g_imageCache.decoded.erase(g_imageCache.decoded.begin(), g_imageCache.decoded.begin() + count);
+    }
+    
+    GUI_PROFILE_SCOPE("uploadImages");
+    size_t changed = 0;
+    for (DecodedImage& image : batch) {
+        auto it = g_imageCache.entries.find(image.key);
+        if (it == g_imageCache.entries.end()) {
+            // Released while it was decoding
+            if (image.surface) SDL_FreeSurface(image.surface);
+            continue;
+        }
+        
+        ImageEntry& entry = *it->second;
+        bool settled = entry.texture || entry.failed;
+        uploadImage(entry, image.surface);
+        if (!settled) ++changed;
+    }
+    
+    trim();
+    return changed;
+}
+
+void ImageCache::setBudget(size_t bytes) {
+    g_imageCache.budget = bytes;
+    trim();
+}
+
+size_t ImageCache::getBudget() {
+    return g_imageCache.budget;
+}
+
+void ImageCache::trim() {
+    // Oldest first; images still referenced, pinned or decoding are skipped
+    auto it = g_imageCache.lru.end();
+    while (g_imageCache.textureBytes > g_imageCache.budget && it != g_imageCache.lru.begin()) {
+        --it;
+        ImageEntry* entry = *it;
+        if (entry->pending || entry->pinned) continue;
+        
+        auto found = g_imageCache.entries.find(entry->key);
+        if (found->second.use_count() > 1) continue;
+        
+        if (entry->texture) destroyCachedTexture(entry->texture);
+        g_imageCache.textureBytes -= entry->bytes;
+        ++g_imageCache.evictions;
+        it = g_imageCache.lru.erase(it);
+        g_imageCache.entries.erase(found);
+    }
+}
+
+void ImageCache::releaseRenderer(SDL_Renderer* renderer) {
+    for (auto it = g_imageCache.entries.begin(); it != g_imageCache.entries.end();) {
+        ImageEntry& entry = *it->second;
+        if (entry.renderer != renderer) {
+            ++it;
+            continue;
+        }
+        
+        // Outstanding Image handles see a failed image from now on
+        if (entry.texture) {
+            destroyCachedTexture(entry.texture);
+            entry.texture = nullptr;
+            g_imageCache.textureBytes -= entry.bytes;
+        }
+        if (entry.pending) {
+            entry.pending = false;
+            --g_imageCache.pending;
+        }
+        entry.failed = true;
+        g_imageCache.lru.erase(entry.lruPosition);
+        it = g_imageCache.entries.erase(it);
+    }
+}
+
+ImageCache::Stats ImageCache::getStats() {
+    Stats stats{};
+    stats.images = g_imageCache.entries.size();
+    stats.pending = g_imageCache.pending;
+    stats.textureBytes = g_imageCache.textureBytes;
+    stats.budgetBytes = g_imageCache.budget;
+    stats.hits = g_imageCache.hits;
+    stats.misses = g_imageCache.misses;
+    stats.evictions = g_imageCache.evictions;
+    for (const auto& entry : g_imageCache.entries) {
+        if (entry.second.use_count() > 1) ++stats.referenced;
+    }
+    return stats;
+}
+
+// Draws an image scaled into the rectangle, or a placeholder until it is ready
+static void drawImage(const Image& image, int x, int y, int w, int h) {
+    if (SDL_Texture* texture = image.getTexture()) {
+        // Uploaded before parallel rendering was turned on: decoded again for the display list
+        if (!isCachedTextureDrawable(texture)) {
+            if (SDL_Surface* pixels = decodeImage(image.getPath(), image.getWidth(), image.getHeight())) {
+                g_texturePixels[texture] = TexturePixels{g_context.renderer, pixels};
+            }
+        }
+        drawCachedTexture(texture, SDL_Rect{x, y, w, h});
+        return;
+    }
+    
+    drawRect(x, y, w, h, SDL_Color{225, 225, 225, 255});
+    drawRect(x, y, w, h, g_context.borderColor, false);
+    if (image.isFailed()) {
+        drawLine(x, y, x + w - 1, y + h - 1, g_context.borderColor);
+        drawLine(x + w - 1, y, x, y + h - 1, g_context.borderColor);
+    }
+}
+
+// IconAtlas implementation
+
+// Bottom-left skyline packer: the packed area is tracked as a row of segments
+// and each rectangle goes where its top edge ends up lowest
+class SkylinePacker {
+public:
+    SkylinePacker(int width, int height) : width(width), height(height), skyline{{0, 0, width}} {}
+    
+    bool insert(int w, int h, int& outX, int& outY) {
+        size_t best = skyline.size();
+        int bestTop = std::numeric_limits<int>::max();
+        int bestWidth = std::numeric_limits<int>::max();
+        for (size_t i = 0; i < skyline.size(); ++i) {
+            int y = fitAt(i, w);
+            if (y < 0 || y + h > height) continue;
+            if (y + h < bestTop || (y + h == bestTop && skyline[i].width < bestWidth)) {
+                best = i;
+                bestTop = y + h;
+                bestWidth = skyline[i].width;
+                outX = skyline[i].x;
+                outY = y;
+            }
+        }
+        if (best == skyline.size()) return false;
+        
+        // Raise the skyline over the new rectangle and trim what it covers
+        skyline.insert(skyline.begin() + best, Segment{outX, outY + h, w});
+        int coveredEnd = outX + w;
+        for (size_t i = best + 1; i < skyline.size();) {
+            Segment& segment = skyline[i];
+            if (segment.x >= coveredEnd) break;
+            int overlap = coveredEnd - segment.x;
+            if (overlap < segment.width) {
+                segment.x += overlap;
+                segment.width -= overlap;
+                break;
+            }
+            skyline.erase(skyline.begin() + i);
+        }
+        
+        for (size_t i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            } else {
+                ++i;
+            }
+        }
+        return true;
+    }
+    
+private:
+    struct Segment {
+        int x, y, width;
+    };
+    
+    int width, height;
+    std::vector<Segment> skyline;
+    
+    // Height a rectangle of width w would rest at when placed on segment index; -1 if it overhangs
+    int fitAt(size_t index, int w) const {
+        if (skyline[index].x + w > width) return -1;
+        int y = 0;
+        int remaining = w;
+        for (size_t i = index; remaining > 0; ++i) {
+            if (i >= skyline.size()) return -1;
+            y = std::max(y, skyline[i].y);
+            remaining -= skyline[i].width;
+        }
+        return y;
+    }
+};
+
+struct IconAtlas::Page {
+    struct Upload {
+        SDL_Texture* texture;
+        uint64_t version;
+    };
+    
+    SDL_Surface* pixels;     // ARGB8888 copy kept for uploads to new renderers and for save()
+    SkylinePacker packer;
+    bool packable;           // false for pages read from an atlas file
+    uint64_t version;        // bumped on every blit so stale textures get refreshed
+    std::unordered_map<SDL_Renderer*, Upload> uploads;
+    
+    Page()
+        : pixels(SDL_CreateRGBSurfaceWithFormat(0, kPageSize, kPageSize, 32, SDL_PIXELFORMAT_ARGB8888)),
+          packer(kPageSize, kPageSize), packable(true), version(1) {
+        if (!pixels) {
+            throw std::runtime_error("Failed to create atlas page: " + std::string(SDL_GetError()));
+        }
+    }
+    
+    ~Page() {
+        for (auto& upload : uploads) {
+            SDL_DestroyTexture(upload.second.texture);
+        }
+        SDL_FreeSurface(pixels);
+    }
+};
+
+IconAtlas::IconAtlas() = default;
+IconAtlas::~IconAtlas() = default;
+
+IconAtlas& IconAtlas::shared() {
+    static IconAtlas atlas;
+    return atlas;
+}
+
+static std::string atlasKey(const std::string& path, int size) {
+    return path + '@' + std::to_string(size);
+}
+
+const IconAtlas::Region* IconAtlas::get(const std::string& path, int size) {
+    std::string key = atlasKey(path, size);
+    auto it = regions.find(key);
+    if (it != regions.end()) {
+        return it->second.page >= 0 ? &it->second : nullptr;
+    }
+    
+    // Remembered either way so a missing icon is not decoded again every frame
+    Region& region = regions[key];
+    region = Region{-1, 0, 0, 0, 0};
+    
+    GUI_PROFILE_SCOPE("IconAtlas::pack");
+    SDL_Surface* icon = decodeImage(path, size, size);
+    if (!icon) return nullptr;
+    
+    int paddedW = icon->w + 2 * kPadding;
+    int paddedH = icon->h + 2 * kPadding;
+    if (paddedW > kPageSize || paddedH > kPageSize) {
+        SDL_FreeSurface(icon);
+        return nullptr;
+    }
+    
+    int packedX = 0, packedY = 0;
+    size_t pageIndex = 0;
+    while (pageIndex < pages.size() &&
+           !(pages[pageIndex]->packable && pages[pageIndex]->packer.insert(paddedW, paddedH, packedX, packedY))) {
+        ++pageIndex;
+    }
+    if (pageIndex == pages.size()) {
+        pages.push_back(std::make_unique<Page>());
+        pages.back()->packer.insert(paddedW, paddedH, packedX, packedY);
+    }
+    
+    Page& page = *pages[pageIndex];
+    SDL_Rect dest = {packedX + kPadding, packedY + kPadding, icon->w, icon->h};
+    SDL_SetSurfaceBlendMode(icon, SDL_BLENDMODE_NONE);
+    SDL_BlitSurface(icon, nullptr, page.pixels, &dest);
+    ++page.version;
+    
+    region = Region{static_cast<int>(pageIndex), packedX + kPadding, packedY + kPadding, icon->w, icon->h};
+    SDL_FreeSurface(icon);
+    return &region;
+}
+
+const IconAtlas::Region* IconAtlas::find(const std::string& path, int size) const {
+    auto it = regions.find(atlasKey(path, size));
+    return it != regions.end() && it->second.page >= 0 ? &it->second : nullptr;
+}
+
+SDL_Texture* IconAtlas::pageTexture(SDL_Renderer* renderer, Page& page) {
+    Page::Upload& upload = page.uploads[renderer];
+    if (!upload.texture) {
+        upload.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                           kPageSize, kPageSize);
+        if (!upload.texture) {
+            page.uploads.erase(renderer);
+            return nullptr;
+        }
+        SDL_SetTextureBlendMode(upload.texture, SDL_BLENDMODE_BLEND);
+        upload.version = 0;
+    }
+    
+    // Icons are packed in bursts on the first frames, so one whole-page upload covers many
+    if (upload.version != page.version) {
+        SDL_UpdateTexture(upload.texture, nullptr, page.pixels->pixels, page.pixels->pitch);
+        upload.version = page.version;
+    }
+    return upload.texture;
+}
+
+void IconAtlas::draw(SDL_Renderer* renderer, const std::vector<Draw>& draws) {
+    if (!renderer || draws.empty()) return;
+    
+    GUI_PROFILE_SCOPE("IconAtlas::draw");
+    if (g_context.recording && renderer == g_context.renderer) {
+        // Blitted straight from the page pixels, which the display list holds on to
+        for (const Draw& draw : draws) {
+            if (!draw.region) continue;
+            
+            const Region& region = *draw.region;
+            SDL_Rect source = {region.x, region.y, region.width, region.height};
+            recordBlit(pages[region.page]->pixels, &source, SDL_Rect{draw.x, draw.y, region.width, region.height},
+                       kNoModulation);
+        }
+        return;
+    }
+    for (size_t pageIndex = 0; pageIndex < pages.size(); ++pageIndex) {
+        int page = static_cast<int>(pageIndex);
+        bool used = std::any_of(draws.begin(), draws.end(), [page](const Draw& draw) {
+            return draw.region && draw.region->page == page;
+        });
+        if (!used) continue;
+        
+        SDL_Texture* texture = pageTexture(renderer, *pages[pageIndex]);
+        if (!texture) continue;
+        
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        // Every icon on the page as textured quads in a single call
+        std::vector<SDL_Vertex> vertices;
+        std::vector<int> indices;
+        const float scale = 1.0f / kPageSize;
+        for (const Draw& draw : draws) {
+            if (!draw.region || draw.region->page != page) continue;
+            
+            const Region& region = *draw.region;
+            float left = static_cast<float>(draw.x);
+            float top = static_cast<float>(draw.y);
+            float right = left + region.width;
+            float bottom = top + region.height;
+            float u0 = region.x * scale;
+            float v0 = region.y * scale;
+            float u1 = (region.x + region.width) * scale;
+            float v1 = (region.y + region.height) * scale;
+            
+            int base = static_cast<int>(vertices.size());
+            SDL_Color white = {255, 255, 255, 255};
+            vertices.push_back(SDL_Vertex{SDL_FPoint{left, top}, white, SDL_FPoint{u0, v0}});
+            vertices.push_back(SDL_Vertex{SDL_FPoint{right, top}, white, SDL_FPoint{u1, v0}});
+            vertices.push_back(SDL_Vertex{SDL_FPoint{right, bottom}, white, SDL_FPoint{u1, v1}});
+            vertices.push_back(SDL_Vertex{SDL_FPoint{left, bottom}, white, SDL_FPoint{u0, v1}});
+            for (int corner : {0, 1, 2, 0, 2, 3}) {
+                indices.push_back(base + corner);
+            }
+        }
+        SDL_RenderGeometry(renderer, texture, vertices.data(), static_cast<int>(vertices.size()),
+                           indices.data(), static_cast<int>(indices.size()));
+#else
+        // Still one texture bound for the whole batch
+        for (const Draw& draw : draws) {
+            if (!draw.region || draw.region->page != page) continue;
+            
+            const Region& region = *draw.region;
+            SDL_Rect source = {region.x, region.y, region.width, region.height};
+            SDL_Rect dest = {draw.x, draw.y, region.width, region.height};
+            SDL_RenderCopy(renderer, texture, &source, &dest);
+        }
+#endif
+    }
+}
+
+// Atlas file: magic, version, page size, page count, region count, then each
+// region (key, page, x, y, width, height) and finally the page pixels. All
+// integers and ARGB pixels are stored little-endian.
+static const char kAtlasMagic[8] = {'G', 'U', 'I', 'A', 'T', 'L', 'A', 'S'};
+static const uint32_t kAtlasFileVersion = 1;
+
+static void writeU32(std::ostream& out, uint32_t value) {
+    char bytes[4] = {
+        static_cast<char>(value & 0xFF), static_cast<char>((value >> 8) & 0xFF),
+        static_cast<char>((value >> 16) & 0xFF), static_cast<char>((value >> 24) & 0xFF)
+    };
+    out.write(bytes, 4);
+}
+
+static bool readU32(std::istream& in, uint32_t& value) {
+    unsigned char bytes[4];
+    if (!in.read(reinterpret_cast<char*>(bytes), 4)) return false;
+    value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    return true;
+}
+
+bool IconAtlas::save(const std::string& file) const {
+    std::ofstream out(file, std::ios::binary);
+    if (!out) return false;
+    
+    uint32_t packedCount = 0;
+    for (const auto& entry : regions) {
+        if (entry.second.page >= 0) ++packedCount;
+    }
+    
+    out.write(kAtlasMagic, sizeof(kAtlasMagic));
+    writeU32(out, kAtlasFileVersion);
+    writeU32(out, kPageSize);
+    writeU32(out, static_cast<uint32_t>(pages.size()));
+    writeU32(out, packedCount);
+    
+    for (const auto& entry : regions) {
+        const Region& region = entry.second;
+        if (region.page < 0) continue;
+        writeU32(out, static_cast<uint32_t>(entry.first.size()));
+        out.write(entry.first.data(), entry.first.size());
+        writeU32(out, region.page);
+        writeU32(out, region.x);
+        writeU32(out, region.y);
+        writeU32(out, region.width);
+        writeU32(out, region.height);
+    }
+    
+    std::vector<unsigned char> row(kPageSize * 4);
+    for (const auto& page : pages) {
+        for (int y = 0; y < kPageSize; ++y) {
+            const uint32_t* pixels = reinterpret_cast<const uint32_t*>(
+                static_cast<const unsigned char*>(page->pixels->pixels) + y * page->pixels->pitch);
+            for (int x = 0; x < kPageSize; ++x) {
+                for (int byte = 0; byte < 4; ++byte) {
+                    row[x * 4 + byte] = static_cast<unsigned char>(pixels[x] >> (byte * 8));
+                }
+            }
+            out.write(reinterpret_cast<const char*>(row.data()), row.size());
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+bool IconAtlas::load(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) return false;
+    
+    char magic[sizeof(kAtlasMagic)];
+    uint32_t version, pageSize, pageCount, regionCount;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, kAtlasMagic, sizeof(magic)) != 0 ||
+        !readU32(in, version) || version != kAtlasFileVersion ||
+        !readU32(in, pageSize) || pageSize != kPageSize ||
+        !readU32(in, pageCount) || !readU32(in, regionCount)) {
+        return false;
+    }
+    
+    std::unordered_map<std::string, Region> loadedRegions;
+    for (uint32_t i = 0; i < regionCount; ++i) {
+        uint32_t keyLength;
+        if (!readU32(in, keyLength) || keyLength > 4096) return false;
+        std::string key(keyLength, '\0');
+        uint32_t fields[5];
+        if (!in.read(&key[0], keyLength)) return false;
+        for (uint32_t& field : fields) {
+            if (!readU32(in, field)) return false;
+        }
+        if (fields[0] >= pageCount || fields[1] + fields[3] > kPageSize || fields[2] + fields[4] > kPageSize) {
+            return false;
+        }
+        loadedRegions[key] = Region{static_cast<int>(fields[0]), static_cast<int>(fields[1]),
+                                    static_cast<int>(fields[2]), static_cast<int>(fields[3]),
+                                    static_cast<int>(fields[4])};
+    }
+    
+    std::vector<std::unique_ptr<Page>> loadedPages;
+    std::vector<unsigned char> row(kPageSize * 4);
+    for (uint32_t i = 0; i < pageCount; ++i) {
+        auto page = std::make_unique<Page>();
+        page->packable = false;
+        for (int y = 0; y < kPageSize; ++y) {
+            if (!in.read(reinterpret_cast<char*>(row.data()), row.size())) return false;
+            uint32_t* pixels = reinterpret_cast<uint32_t*>(
+                static_cast<unsigned char*>(page->pixels->pixels) + y * page->pixels->pitch);
+            for (int x = 0; x < kPageSize; ++x) {
+                const unsigned char* bytes = &row[x * 4];
+                pixels[x] = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+            }
+        }
+        loadedPages.push_back(std::move(page));
+    }
+    
+    // Only replace the current contents once the whole file has been read
+    pages = std::move(loadedPages);
+    regions = std::move(loadedRegions);
+    return true;
+}
+
+void IconAtlas::releaseRenderer(SDL_Renderer* renderer) {
+    for (auto& page : pages) {
+        auto it = page->uploads.find(renderer);
+        if (it == page->uploads.end()) continue;
+        SDL_DestroyTexture(it->second.texture);
+        page->uploads.erase(it);
+    }
+}
+
+void IconAtlas::clear() {
+    pages.clear();
+    regions.clear();
+}
+
+// utils implementation
+SDL_Texture* utils::loadImage(SDL_Renderer* renderer, const std::string& path) {
+    // The caller keeps a raw pointer, so the entry can never be evicted
+    std::shared_ptr<ImageEntry> entry = loadImageEntry(renderer, path, 0, 0);
+    entry->pinned = true;
+    return entry->texture;
+}
+
+// Startup implementation
+static thread_local bool t_fontLoaderThread = false;
+
+// Common UI characters: printable ASCII, Latin-1 and whatever the app adds
+static std::vector<uint32_t> prewarmCodepoints() {
+    std::vector<uint32_t> codepoints;
+    for (uint32_t c = 32; c < 127; ++c) codepoints.push_back(c);
+    for (uint32_t c = 160; c < 256; ++c) codepoints.push_back(c);
+    
+    const std::string& extra = g_startup.prewarmCharacters;
+    const char* p = extra.data();
+    const char* end = p + extra.size();
+    while (p < end) {
+        uint32_t codepoint = decodeUtf8(p, end);
+        if (codepoint >= 256) codepoints.push_back(codepoint);
+    }
+    return codepoints;
+}
+
+// Maps the startup glyph cache file for the default font, building it first
+// if it is missing, stale or lacks prewarm characters the font provides
+static bool loadStartupGlyphs(TTF_Font* font, const std::vector<uint32_t>& codepoints) {
+    const std::string& file = g_startup.glyphCacheFile;
+    if (GlyphCache::load(file)) {
+        bool complete = true;
+        for (uint32_t codepoint : codepoints) {
+            int advance;
+            if (!cachedGlyphAdvance(font, codepoint, advance) && TTF_GlyphIsProvided32(font, codepoint)) {
+                complete = false;
+                break;
+            }
+        }
+        if (complete) return true;
+    }
+    
+    if (GlyphCache::build(file, FontManager::kDefaultFamily, FontManager::kDefaultSize, g_startup.prewarmCharacters)) {
+        GlyphCache::load(file);
+    }
+    return false;
+}
+
+// Fills the default font's advance cache before the first layout asks for it
+static void prewarmGlyphs(TTF_Font* font) {
+    auto start = std::chrono::steady_clock::now();
+    GlyphAdvanceCache& cache = g_glyphAdvances.fonts[font];
+    std::vector<uint32_t> codepoints = prewarmCodepoints();
+    
+    if (!g_startup.glyphCacheFile.empty()) {
+        g_startup.report.glyphCacheHit = loadStartupGlyphs(font, codepoints);
+    }
+    
+    for (uint32_t codepoint : codepoints) {
+        bool known = codepoint < 128 ? cache.ascii[codepoint] >= 0 : cache.other.count(codepoint) > 0;
+        if (known) continue;
+        
+        int minX, maxX, minY, maxY, advance = 0;
+        if (!cachedGlyphAdvance(font, codepoint, advance) &&
+            TTF_GlyphMetrics32(font, codepoint, &minX, &maxX, &minY, &maxY, &advance) != 0) {
+            advance = 0;
+        }
+        if (codepoint < 128) cache.ascii[codepoint] = advance;
+        else cache.other[codepoint] = advance;
+    }
+    g_startup.report.glyphPrewarmMs = millisecondsSince(start);
+}
+
+static void fontLoaderMain() {
+    t_fontLoaderThread = true;
+    auto start = std::chrono::steady_clock::now();
+    if (TTF_Init() < 0) {
+        g_startup.error = TTF_GetError();
+        return;
+    }
+    g_startup.font = loadStartupFonts();
+    g_startup.report.fontLoadMs = millisecondsSince(start);
+    
+    if (g_startup.font) {
+        prewarmGlyphs(g_startup.font);
+    }
+}
+
+static void startFontLoader() {
+    g_startup.error.clear();
+    g_startup.font = nullptr;
+    g_startup.loading = true;
+    g_startup.loader = std::thread(fontLoaderMain);
+}
+
+// Waits for the loader and installs the default font; never throws
+static void joinFontLoader() {
+    if (t_fontLoaderThread || !g_startup.loading) return;
+    
+    auto start = std::chrono::steady_clock::now();
+    g_startup.loader.join();
+    g_startup.loading = false;
+    g_startup.report.fontWaitMs += millisecondsSince(start);
+    g_context.font = g_startup.font;
+}
+
+// Called before anything touches fonts; reports a failed SDL_ttf init once
+static void finishStartup() {
+    if (t_fontLoaderThread || !g_startup.loading) return;
+    
+    joinFontLoader();
+    if (!g_startup.error.empty()) {
+        std::string error;
+        error.swap(g_startup.error);
+        throw std::runtime_error("SDL_ttf initialization failed: " + error);
+    }
+}
+
+// The loader thread reads the settings and writes the report; wait for it first
+
+void Startup::setGlyphCacheFile(const std::string& path) {
+    joinFontLoader();
+    g_startup.glyphCacheFile = path;
+}
+
+void Startup::setPrewarmCharacters(const std::string& text) {
+    joinFontLoader();
+    g_startup.prewarmCharacters = text;
+}
+
+Startup::Report Startup::getReport() {
+    joinFontLoader();
+    return g_startup.report;
+}
+
+std::string Startup::formatReport() {
+    joinFontLoader();
+    const Report& report = g_startup.report;
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer),
+                  "first frame     %8.2f ms%s\n"
+                  "  sdl init      %8.2f ms\n"
+                  "  window        %8.2f ms\n"
+                  "  font load     %8.2f ms (loader thread)\n"
+                  "  glyph prewarm %8.2f ms (loader thread, %s)\n"
+                  "  font wait     %8.2f ms\n",
+                  report.firstFrameMs, report.firstFrameDone ? "" : " (not presented yet)",
+                  report.sdlInitMs, report.windowCreateMs, report.fontLoadMs,
+                  report.glyphPrewarmMs, report.glyphCacheHit ? "cache hit" : "measured",
+                  report.fontWaitMs);
+    return buffer;
+}
+
+// Theme implementation
+static const size_t kWidgetTypeCount = static_cast<size_t>(WidgetType::Count);
+
+static const char* const kWidgetTypeNames[kWidgetTypeCount] = {
+    "Widget", "Button", "Label", "TextInput", "TextArea", "TextView", "CheckBox", "RadioButton",
+    "ComboBox", "Slider", "ProgressBar", "Container", "Panel", "Window", "Menu", "MenuBar",
+    "TabControl", "ScrollBar", "ListBox", "TreeView", "Table", "StatusBar", "ToolBar",
+    "ColorPicker", "DatePicker"
+};
+
+const char* widgetTypeName(WidgetType type) {
+    size_t index = static_cast<size_t>(type);
+    return index < kWidgetTypeCount ? kWidgetTypeNames[index] : "";
+}
+
+bool widgetTypeFromName(const std::string& name, WidgetType& type) {
+    for (size_t i = 0; i < kWidgetTypeCount; ++i) {
+        if (name == kWidgetTypeNames[i]) {
+            type = static_cast<WidgetType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct Theme::Table {
+    std::array<Style, kWidgetTypeCount> styles;
+    uint32_t explicitTypes = 0;   // bit per type given its own style
+};
+
+static void copyStyleFields(Style& to, const Style& from, uint32_t fields) {
+    if (fields & StyleBackground) to.backgroundColor = from.backgroundColor;
+    if (fields & StyleForeground) to.foregroundColor = from.foregroundColor;
+    if (fields & StyleBorder) to.borderColor = from.borderColor;
+    if (fields & StyleHover) to.hoverColor = from.hoverColor;
+    if (fields & StylePressed) to.pressedColor = from.pressedColor;
+    if (fields & StyleDisabled) to.disabledColor = from.disabledColor;
+    if (fields & StyleBorderWidth) to.borderWidth = from.borderWidth;
+    if (fields & StylePadding) to.padding = from.padding;
+    if (fields & StyleFontFamily) to.fontFamily = from.fontFamily;
+    if (fields & StyleFontSize) to.fontSize = from.fontSize;
+}
+
+static uint32_t changedStyleFields(const Style& a, const Style& b) {
+    uint32_t fields = 0;
+    if (a.backgroundColor != b.backgroundColor) fields |= StyleBackground;
+    if (a.foregroundColor != b.foregroundColor) fields |= StyleForeground;
+    if (a.borderColor != b.borderColor) fields |= StyleBorder;
+    if (a.hoverColor != b.hoverColor) fields |= StyleHover;
+    if (a.pressedColor != b.pressedColor) fields |= StylePressed;
+    if (a.disabledColor != b.disabledColor) fields |= StyleDisabled;
+    if (a.borderWidth != b.borderWidth) fields |= StyleBorderWidth;
+    if (a.padding != b.padding) fields |= StylePadding;
+    if (a.fontFamily != b.fontFamily) fields |= StyleFontFamily;
+    if (a.fontSize != b.fontSize) fields |= StyleFontSize;
+    return fields;
+}
+
+static SDL_Color toSDLColor(const Color& color) {
+    return SDL_Color{color.r, color.g, color.b, color.a};
+}
+
+static Style makeStyle(Color background, Color foreground, Color border,
+                       Color hover, Color pressed, Color disabled) {
+    Style style;
+    style.backgroundColor = background;
+    style.foregroundColor = foreground;
+    style.borderColor = border;
+    style.hoverColor = hover;
+    style.pressedColor = pressed;
+    style.disabledColor = disabled;
+    return style;
+}
+
+struct ThemeState {
+    Theme current;
+    uint64_t generation;   // bumped on every switch; stale widget overrides re-merge
+    
+    ThemeState() : current(Theme::Light()), generation(1) {}
+};
+
+static ThemeState g_theme;
+
+Theme::Theme(const std::string& name) : table(std::make_shared<Table>()), name(name) {}
+
+Theme& Theme::setStyle(WidgetType widgetType, const Style& style) {
+    size_t index = static_cast<size_t>(widgetType);
+    if (index >= kWidgetTypeCount) return *this;
+    
+    // Copy on write: other copies, including the global theme, keep the old table
+    if (table.use_count() > 1) {
+        table = std::make_shared<Table>(*table);
+    }
+    
+    table->styles[index] = style;
+    table->explicitTypes |= 1u << index;
+    if (widgetType == WidgetType::Generic) {
+        for (size_t i = 1; i < kWidgetTypeCount; ++i) {
+            if (!(table->explicitTypes & (1u << i))) table->styles[i] = style;
+        }
+    }
+    return *this;
+}
+
+Theme& Theme::setStyle(const std::string& widgetType, const Style& style) {
+    WidgetType type;
+    if (!widgetTypeFromName(widgetType, type)) {
+        throw std::runtime_error("Failed to set theme style: unknown widget type " + widgetType);
+    }
+    return setStyle(type, style);
+}
+
+const Style& Theme::getStyle(WidgetType widgetType) const {
+    size_t index = static_cast<size_t>(widgetType);
+    return table->styles[index < kWidgetTypeCount ? index : 0];
+}
+
+const Style* Theme::getStyle(const std::string& widgetType) const {
+    WidgetType type;
+    return widgetTypeFromName(widgetType, type) ? &getStyle(type) : nullptr;
+}
+
+const Style& Theme::resolve(WidgetType widgetType) {
+    return g_theme.current.getStyle(widgetType);
+}
+
+// True if any widget in the tree resolves to a different style under the new table
+static bool styleChangedIn(const Widget* widget, const std::array<uint32_t, kWidgetTypeCount>& changed) {
+    size_t index = static_cast<size_t>(widget->getType());
+    if (index < kWidgetTypeCount && (changed[index] & ~widget->getStyleOverrides())) return true;
+    
+    for (const auto& child : widget->getChildren()) {
+        if (styleChangedIn(child.get(), changed)) return true;
+    }
+    return false;
+}
+
+void Theme::setGlobalTheme(const Theme& theme) {
+    std::shared_ptr<Table> previous = g_theme.current.table;
+    g_theme.current = theme;
+    if (previous == theme.table) return;
+    ++g_theme.generation;
+    
+    std::array<uint32_t, kWidgetTypeCount> changed{};
+    bool anyChanged = false;
+    for (size_t i = 0; i < kWidgetTypeCount; ++i) {
+        changed[i] = changedStyleFields(previous->styles[i], theme.table->styles[i]);
+        anyChanged = anyChanged || changed[i];
+    }
+    if (!anyChanged) return;
+    
+    // Redrawn at the next frame slot; cached subtrees notice the new generation
+    for (Window* window : Window::windows) {
+        if (window->running && styleChangedIn(window, changed)) {
+            window->invalidate();
+        }
+    }
+}
+
+const Theme* Theme::getGlobalTheme() {
+    return &g_theme.current;
+}
+
+// Light matches the built-in colors, so an app that never sets a theme looks unchanged
+Theme Theme::Light() {
+    Theme theme("Light");
+    theme.setStyle(WidgetType::Generic, makeStyle(Color(240, 240, 240), Color(0, 0, 0), Color(180, 180, 180),
+                                                  Color(210, 210, 210), Color(195, 195, 195), Color(200, 200, 200)));
+    Style button = makeStyle(Color(225, 225, 225), Color(0, 0, 0), Color(180, 180, 180),
+                             Color(210, 210, 210), Color(195, 195, 195), Color(200, 200, 200));
+    Style input = makeStyle(Color(255, 255, 255), Color(0, 0, 0), Color(180, 180, 180),
+                            Color(210, 210, 210), Color(195, 195, 195), Color(240, 240, 240));
+    for (WidgetType type : {WidgetType::Button, WidgetType::ToolBar}) theme.setStyle(type, button);
+    for (WidgetType type : {WidgetType::TextInput, WidgetType::TextArea, WidgetType::TextView,
+                            WidgetType::ListBox, WidgetType::Menu}) theme.setStyle(type, input);
+    return theme;
+}
+
+Theme Theme::Dark() {
+    Theme theme("Dark");
+    theme.setStyle(WidgetType::Generic, makeStyle(Color(45, 45, 48), Color(230, 230, 230), Color(90, 90, 96),
+                                                  Color(70, 70, 76), Color(85, 85, 92), Color(60, 60, 64)));
+    Style button = makeStyle(Color(62, 62, 66), Color(230, 230, 230), Color(90, 90, 96),
+                             Color(80, 80, 86), Color(96, 96, 104), Color(55, 55, 58));
+    Style input = makeStyle(Color(30, 30, 32), Color(230, 230, 230), Color(90, 90, 96),
+                            Color(70, 70, 76), Color(85, 85, 92), Color(45, 45, 48));
+    for (WidgetType type : {WidgetType::Button, WidgetType::ToolBar}) theme.setStyle(type, button);
+    for (WidgetType type : {WidgetType::TextInput, WidgetType::TextArea, WidgetType::TextView,
+                            WidgetType::ListBox, WidgetType::Menu}) theme.setStyle(type, input);
+    return theme;
+}
+
+Theme Theme::Blue() {
+    Theme theme("Blue");
+    theme.setStyle(WidgetType::Generic, makeStyle(Color(230, 238, 250), Color(10, 30, 60), Color(120, 150, 200),
+                                                  Color(180, 200, 235), Color(160, 185, 225), Color(200, 210, 225)));
+    Style button = makeStyle(Color(200, 215, 240), Color(10, 30, 60), Color(120, 150, 200),
+                             Color(180, 200, 235), Color(160, 185, 225), Color(200, 210, 225));
+    Style input = makeStyle(Color(255, 255, 255), Color(10, 30, 60), Color(120, 150, 200),
+                            Color(180, 200, 235), Color(160, 185, 225), Color(235, 240, 248));
+    for (WidgetType type : {WidgetType::Button, WidgetType::ToolBar}) theme.setStyle(type, button);
+    for (WidgetType type : {WidgetType::TextInput, WidgetType::TextArea, WidgetType::TextView,
+                            WidgetType::ListBox, WidgetType::Menu}) theme.setStyle(type, input);
+    return theme;
+}
+
+// Widget implementation
+struct Widget::StyleOverride {
+    Style values;
+    uint32_t fields;
+    Style resolved;
+    uint64_t generation;   // theme generation `resolved` was merged against
+};
+
+Widget::Widget(const std::string& id) 
+    : id(id), x(0), y(0), width(100), height(30), 
+      visible(true), enabled(true), focused(false), hovered(false), dirty(true), parent(nullptr),
+      renderX(0), renderY(0) {
+    if (!g_freeWidgetSlots.empty()) {
+        handleSlot = g_freeWidgetSlots.back();
+        g_freeWidgetSlots.pop_back();
+        g_widgetSlots[handleSlot] = this;
+    } else {
+        handleSlot = static_cast<uint32_t>(g_widgetSlots.size());
+        g_widgetSlots.push_back(this);
+        g_widgetGenerations.push_back(0);
+    }
+}
+
+Widget::~Widget() {
+    // Invalidate outstanding handles before the slot is reused
+    g_widgetSlots[handleSlot] = nullptr;
+    ++g_widgetGenerations[handleSlot];
+    g_freeWidgetSlots.push_back(handleSlot);
+}
+
+WidgetHandle Widget::getHandle() const {
+    return WidgetHandle(handleSlot, g_widgetGenerations[handleSlot]);
+}
+
+bool Widget::hasPointerCapture() const {
+    const Widget* root = this;
+    while (root->parent) root = root->parent;
+    return root->getType() == WidgetType::Window &&
+           static_cast<const Window*>(root)->getPointerCapture() == this;
+}
+
+void Widget::invalidate() {
+    Widget* root = this;
+    root->dirty = true;
+    while (root->parent) {
+        root = root->parent;
+        root->dirty = true;
+    }
+    if (root->getType() == WidgetType::Window) {
+        static_cast<Window*>(root)->invalidate();
+    }
+}
+
+int Widget::getAbsoluteX() const {
+    int absX = x;
+    for (Widget* p = parent; p; p = p->getParent()) {
+        absX += p->getX();
+    }
+    return absX;
+}
+
+int Widget::getAbsoluteY() const {
+    int absY = y;
+    for (Widget* p = parent; p; p = p->getParent()) {
+        absY += p->getY();
+    }
+    return absY;
+}
+
+void Widget::updateRenderOrigin() {
+    renderX = parent ? parent->renderX + x : x;
+    renderY = parent ? parent->renderY + y : y;
+}
+
+Widget& Widget::setStyle(const Style& style, uint32_t fields) {
+    if (!styleOverride) {
+        styleOverride = std::make_unique<StyleOverride>();
+        styleOverride->fields = 0;
+    }
+    copyStyleFields(styleOverride->values, style, fields);
+    styleOverride->fields |= fields & StyleAllFields;
+    styleOverride->generation = 0;
+    invalidate();
+    return *this;
+}
+
+Widget& Widget::resetStyle() {
+    styleOverride.reset();
+    invalidate();
+    return *this;
+}
+
+const Style& Widget::getStyle() const {
+    const Style& themed = Theme::resolve(getType());
+    if (!styleOverride) return themed;
+    
+    // Merged once per theme switch rather than on every render
+    if (styleOverride->generation != g_theme.generation) {
+        styleOverride->resolved = themed;
+        copyStyleFields(styleOverride->resolved, styleOverride->values, styleOverride->fields);
+        styleOverride->generation = g_theme.generation;
+    }
+    return styleOverride->resolved;
+}
+
+uint32_t Widget::getStyleOverrides() const {
+    return styleOverride ? styleOverride->fields : 0;
+}
+
+Widget& Widget::setPosition(int x, int y) {
+    this->x = x;
+    this->y = y;
+    invalidate();
+    return *this;
+}
+
+Widget& Widget::setSize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    invalidate();
+    return *this;
+}
+
+Widget& Widget::setVisible(bool visible) {
+    this->visible = visible;
+    invalidate();
+    return *this;
+}
+
+Widget& Widget::setEnabled(bool enabled) {
+    this->enabled = enabled;
+    invalidate();
+    return *this;
+}
+
+Widget& Widget::setFocused(bool focused) {
+    this->focused = focused;
+    invalidate();
+    return *this;
+}
+
+Widget& Widget::add(std::unique_ptr<Widget> child) {
+    child->parent = this;
+    children.push_back(std::move(child));
+    invalidate();
+    return *this;
+}
+
+Widget* Widget::find(const std::string& id) {
+    if (this->id == id) return this;
+    
+    for (auto& child : children) {
+        if (Widget* found = child->find(id)) {
+            return found;
+        }
+    }
+    return nullptr;
+}
+
+Widget* Widget::findAt(int x, int y) {
+    return Window::findWidgetAt(this, x, y);
+}
+
+Widget& Widget::on(EventType type, EventHandler handler) {
+    eventHandlers[type].push_back(handler);
+    return *this;
+}
+
+bool Widget::hasHandlers(EventType type) const {
+    for (const Widget* widget = this; widget; widget = widget->parent) {
+        auto it = widget->eventHandlers.find(type);
+        if (it != widget->eventHandlers.end() && !it->second.empty()) {
+            return true;
+        }
+        if (type == EventType::WindowClose) break; // does not bubble
+    }
+    return false;
+}
+
+void Widget::emit(const Event& event) {
+    auto it = eventHandlers.find(event.type);
+    if (it != eventHandlers.end()) {
+        for (auto& handler : it->second) {
+            handler(event);
+        }
+    }
+    
+    // Bubble up to parent; every widget on the hover path gets its own enter and leave
+    if (parent && event.type != EventType::WindowClose &&
+        event.type != EventType::MouseEnter && event.type != EventType::MouseLeave) {
+        parent->emit(event);
+    }
+}
+
+// Button implementation
+Button::Button(const std::string& text, const std::string& id) 
+    : Widget(id), text(text) {
+    // Auto-size based on text, measured in the widget's style font
+    FontScope font(this);
+    if (!text.empty() && g_context.font) {
+        int textW, textH;
+        getTextSize(text, textW, textH);
+        width = textW + 20;  // Add padding
+        height = textH + 10;
+    }
+}
+
+Button& Button::setText(const std::string& text) {
+    this->text = text;
+    // Auto-resize
+    FontScope font(this);
+    if (!text.empty() && g_context.font) {
+        int textW, textH;
+        getTextSize(text, textW, textH);
+        width = textW + 20;
+        height = textH + 10;
+    }
+    invalidate();
+    return *this;
+}
+
+void Button::render() {
+    if (!visible) return;
+    
+    const Style& style = getStyle();
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    // Hover and press come from the window's pointer tracker
+    bool pressed = hovered && hasPointerCapture();
+    
+    // Draw button background
+    SDL_Color btnColor = toSDLColor(pressed ? style.pressedColor :
+                                    (hovered ? style.hoverColor : style.backgroundColor));
+    
+    if (enabled) {
+        drawRect(absX, absY, width, height, btnColor);
+    } else {
+        drawRect(absX, absY, width, height, toSDLColor(style.disabledColor));
+    }
+    
+    // Draw border
+    drawRect(absX, absY, width, height, toSDLColor(style.borderColor), false);
+    
+    // Draw text centered
+    if (!text.empty()) {
+        int textW, textH;
+        getTextSize(text, textW, textH);
+        int textX = absX + (width - textW) / 2;
+        int textY = absY + (height - textH) / 2;
+        
+        SDL_Color textColor = enabled ? toSDLColor(style.foregroundColor) : SDL_Color{150, 150, 150, 255};
+        drawText(text, textX, textY, textColor);
+    }
+}
+
+bool Button::handleEvent(const Event& event) {
+    if (event.type == EventType::Click && event.phase == EventPhase::Target) {
+        click();
+        return true;
+    }
+    if (event.type == EventType::KeyPress && (event.getKey() == "enter" || event.getKey() == "space")) {
+        click();
+        return true;
+    }
+    return false;
+}
+
+void Button::click() {
+    if (!enabled) return;
+    Event event{EventType::Click, this, {}};
+    emit(event);
+}
+
+// Label implementation
+Label::Label(const std::string& text, const std::string& id) 
+    : Widget(id), text(text), autoSize(true) {
+    // Auto-size based on text, measured in the widget's style font
+    FontScope font(this);
+    if (!text.empty() && g_context.font) {
+        int textW, textH;
+        getTextSize(text, textW, textH);
+        width = textW;
+        height = textH;
+    }
+}
+
+Label& Label::setText(const std::string& text) {
+    this->text = text;
+    // Auto-resize
+    FontScope font(this);
+    if (!text.empty() && g_context.font) {
+        int textW, textH;
+        getTextSize(text, textW, textH);
+        width = textW;
+        height = textH;
+    }
+    invalidate();
+    return *this;
+}
+
+void Label::render() {
+    if (!visible) return;
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    // Draw text
+    if (!text.empty()) {
+        drawText(text, absX, absY, toSDLColor(getStyle().foregroundColor));
+    }
+}
+
+// GapBuffer implementation
+GapBuffer::GapBuffer(const std::string& text) : gapStart(0), gapEnd(0) {
+    assign(text);
+}
+
+void GapBuffer::moveGap(size_t position) {
+    if (position < gapStart) {
+        size_t count = gapStart - position;
+        std::memmove(buffer.data() + gapEnd - count, buffer.data() + position, count);
+        gapStart -= count;
+        gapEnd -= count;
+    } else if (position > gapStart) {
+        size_t count = position - gapStart;
+        std::memmove(buffer.data() + gapStart, buffer.data() + gapEnd, count);
+        gapStart += count;
+        gapEnd += count;
+    }
+}
+
+void GapBuffer::reserveGap(size_t count) {
+    if (gapEnd - gapStart >= count) return;
+    
+    // Grow geometrically so a run of inserts stays amortized O(1)
+    size_t tail = buffer.size() - gapEnd;
+    size_t newSize = std::max(buffer.size() * 2, size() + count + 64);
+    buffer.resize(newSize);
+    std::memmove(buffer.data() + newSize - tail, buffer.data() + gapEnd, tail);
+    gapEnd = newSize - tail;
+}
+
+void GapBuffer::insert(size_t position, const char* text, size_t length) {
+    if (length == 0) return;
+    position = std::min(position, size());
+    moveGap(position);
+    reserveGap(length);
+    std::memcpy(buffer.data() + gapStart, text, length);
+    gapStart += length;
+}
+
+void GapBuffer::erase(size_t position, size_t count) {
+    if (position >= size()) return;
+    count = std::min(count, size() - position);
+    moveGap(position);
+    gapEnd += count;
+}
+
+void GapBuffer::assign(const std::string& text) {
+    buffer.assign(text.begin(), text.end());
+    gapStart = gapEnd = buffer.size();
+}
+
+std::string GapBuffer::substr(size_t position, size_t count) const {
+    if (position >= size()) return std::string();
+    count = std::min(count, size() - position);
+    
+    std::string result;
+    result.reserve(count);
+    size_t end = position + count;
+    if (position < gapStart) {
+        result.append(buffer.data() + position, std::min(end, gapStart) - position);
+    }
+    if (end > gapStart) {
+        size_t from = std::max(position, gapStart);
+        result.append(buffer.data() + from + (gapEnd - gapStart), end - from);
+    }
+    return result;
+}
+
+const char* GapBuffer::span(size_t position, size_t& length) const {
+    if (position < gapStart) {
+        length = gapStart - position;
+        return buffer.data() + position;
+    }
+    length = position < size() ? size() - position : 0;
+    return buffer.data() + position + (gapEnd - gapStart);
+}
+
+// Codepoints that continue the preceding grapheme cluster: combining marks of
+// the common scripts, Indic vowel signs, Hangul medial and final jamo,
+// joiners, variation selectors, emoji modifiers and tags. Sorted by start.
+struct CodepointRange {
+    uint32_t first;
+    uint32_t last;
+};
+
+static const CodepointRange kClusterExtenders[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
+    {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A},
+    {0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+    {0x0900, 0x0903}, {0x093A, 0x094F}, {0x0951, 0x0957}, {0x0962, 0x0963},
+    {0x0981, 0x0983}, {0x09BC, 0x09D7}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A},
+    {0x0E47, 0x0E4E}, {0x1160, 0x11FF}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+    {0x200C, 0x200D}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+    {0x1F3FB, 0x1F3FF}, {0xE0020, 0xE007F}, {0xE0100, 0xE01EF},
+};
+
+static bool isClusterExtender(uint32_t codepoint) {
+    if (codepoint < 0x0300) return false;
+    for (const CodepointRange& range : kClusterExtenders) {
+        if (codepoint < range.first) return false;
+        if (codepoint <= range.last) return true;
+    }
+    return false;
+}
+
+static bool isRegionalIndicator(uint32_t codepoint) {
+    return codepoint >= 0x1F1E6 && codepoint <= 0x1F1FF;
+}
+
+// End of the grapheme cluster starting at `start`, approximating UAX #29:
+// CR LF, extenders, ZWJ sequences and regional-indicator pairs stay together.
+// Adds the cluster's glyph advances to *width when given.
+static size_t nextClusterEnd(const char* data, size_t size, size_t start, int* width) {
+    const char* p = data + start;
+    const char* end = data + size;
+    if (p >= end) return size;
+    
+    uint32_t previous = decodeUtf8(p, end);
+    int advance = width ? glyphAdvance(previous) : 0;
+    bool pairedIndicators = false;
+    while (p < end) {
+        const char* next = p;
+        uint32_t codepoint = decodeUtf8(next, end);
+        
+        bool extend;
+        if (previous == '\r' || previous == '\n') {
+            extend = previous == '\r' && codepoint == '\n';
+        } else if (isRegionalIndicator(previous) && isRegionalIndicator(codepoint)) {
+            extend = !pairedIndicators;
+            pairedIndicators = true;
+        } else {
+            extend = previous == 0x200D || isClusterExtender(codepoint);
+        }
+        if (!extend) break;
+        
+        if (width) advance += glyphAdvance(codepoint);
+        previous = codepoint;
+        p = next;
+    }
+    
+    if (width) *width += advance;
+    return static_cast<size_t>(p - data);
+}
+
+// GraphemeIndex implementation
+size_t GraphemeIndex::entryAt(size_t byte) const {
+    auto it = std::upper_bound(starts.begin(), starts.end(), byte);
+    return it == starts.begin() ? 0 : static_cast<size_t>(it - starts.begin()) - 1;
+}
+
+size_t GraphemeIndex::stablePrefix(size_t byte) const {
+    // An edit at a boundary can merge into the previous cluster (a combining
+    // mark typed after its base), so rescanning starts one cluster earlier
+    auto stableEnd = starts.begin() + stableEntries;
+    size_t containing = static_cast<size_t>(std::upper_bound(starts.begin(), stableEnd, byte) - starts.begin()) - 1;
+    return std::max<size_t>(1, containing);
+}
+
+void GraphemeIndex::edit(size_t position, size_t removed, size_t inserted) {
+    // Entries past the edit are kept and shifted. While stale, only those past
+    // the earlier edits qualify, so every kept offset is off by the same amount.
+    size_t prefix = stablePrefix(position);
+    size_t first = stale ? stableEntries : prefix;
+    size_t suffix = static_cast<size_t>(
+        std::lower_bound(starts.begin() + first, starts.end(), position + removed) - starts.begin());
+    starts.erase(starts.begin() + prefix, starts.begin() + suffix);
+    offsets.erase(offsets.begin() + prefix, offsets.begin() + suffix);
+    for (size_t i = prefix; i < starts.size(); ++i) {
+        starts[i] = starts[i] - removed + inserted;
+    }
+    stableEntries = prefix;
+    stale = true;
+}
+
+void GraphemeIndex::invalidateFrom(size_t byte) {
+    stableEntries = stablePrefix(byte);
+    starts.resize(stableEntries);
+    offsets.resize(stableEntries);
+    stale = true;
+}
+
+void GraphemeIndex::update(const GapBuffer& text) {
+    if (!stale) return;
+    
+    // Kept entries that do not end at the text's end were not kept through edit()
+    size_t size = text.size();
+    if (starts[stableEntries - 1] > size) stableEntries = 1;
+    if (starts.size() > stableEntries && starts.back() != size) {
+        starts.resize(stableEntries);
+        offsets.resize(stableEntries);
+    }
+    
+    size_t byte = starts[stableEntries - 1];
+    int x = offsets[stableEntries - 1];
+    size_t kept = stableEntries;
+    bool synced = false;
+    std::vector<size_t> scannedStarts;
+    std::vector<int> scannedOffsets;
+    std::string window;
+    while (byte < size) {
+        // Clusters are measured in place. The scan decodes one code point past
+        // the cluster, so one ending within that of the gap is measured again
+        // from a copy spanning it.
+        size_t length;
+        const char* run = text.span(byte, length);
+        int advance = 0;
+        size_t end = nextClusterEnd(run, length, 0, &advance);
+        for (size_t count = length + 16; end + 4 > length && byte + length < size; count *= 2) {
+            window = text.substr(byte, count);
+            run = window.data();
+            length = window.size();
+            advance = 0;
+            end = nextClusterEnd(run, length, 0, &advance);
+        }
+        byte += end;
+        x += advance;
+        
+        // Past a boundary shared with a kept entry the clusters are unchanged
+        while (kept < starts.size() && starts[kept] < byte) ++kept;
+        if (kept < starts.size() && starts[kept] == byte) {
+            synced = true;
+            break;
+        }
+        scannedStarts.push_back(byte);
+        scannedOffsets.push_back(x);
+    }
+    
+    if (synced) {
+        int shift = x - offsets[kept];
+        for (size_t i = kept; i < offsets.size(); ++i) {
+            offsets[i] += shift;
+        }
+    } else {
+        kept = starts.size();
+    }
+    starts.erase(starts.begin() + stableEntries, starts.begin() + kept);
+    offsets.erase(offsets.begin() + stableEntries, offsets.begin() + kept);
+    starts.insert(starts.begin() + stableEntries, scannedStarts.begin(), scannedStarts.end());
+    offsets.insert(offsets.begin() + stableEntries, scannedOffsets.begin(), scannedOffsets.end());
+    
+    stableEntries = starts.size();
+    stale = false;
+}
+
+size_t GraphemeIndex::move(size_t byte, long clusters) const {
+    long last = static_cast<long>(starts.size()) - 1;
+    long target = static_cast<long>(entryAt(byte)) + clusters;
+    return starts[static_cast<size_t>(std::max(0L, std::min(target, last)))];
+}
+
+size_t GraphemeIndex::hitTest(int x) const {
+    auto it = std::lower_bound(offsets.begin(), offsets.end(), x);
+    if (it == offsets.end()) return starts.back();
+    
+    size_t index = static_cast<size_t>(it - offsets.begin());
+    if (index > 0 && x - offsets[index - 1] < *it - x) --index;
+    return starts[index];
+}
+
+// Longest prefix handed to the rasterizer; wider text is clipped by the widget anyway
+static const size_t kMaxRenderedLineBytes = 1024;
+
+// TextInput implementation
+TextInput::TextInput(const std::string& placeholder, const std::string& id) 
+    : Widget(id), placeholder(placeholder), cursorPosition(0), selectionStart(0),
+      selectionEnd(0), password(false), maxLength(0), layoutFont(g_context.font) {
+    width = 200;
+    height = 30;
+}
+
+TextInput& TextInput::setText(const std::string& text) {
+    this->text.assign(text);
+    clusters.invalidate();
+    cursorPosition = this->text.size();
+    selectionStart = selectionEnd = cursorPosition;
+    notifyTextChanged();
+    return *this;
+}
+
+TextInput& TextInput::setPlaceholder(const std::string& placeholder) {
+    this->placeholder = placeholder;
+    invalidate();
+    return *this;
+}
+
+TextInput& TextInput::setPassword(bool password) {
+    this->password = password;
+    invalidate();
+    return *this;
+}
+
+TextInput& TextInput::setMaxLength(int maxLength) {
+    this->maxLength = maxLength;
+    return *this;
+}
+
+TextInput& TextInput::setCursorPosition(size_t position) {
+    cursorPosition = clusterIndex().snap(std::min(position, text.size()));
+    selectionStart = selectionEnd = cursorPosition;
+    invalidate();
+    return *this;
+}
+
+TextInput& TextInput::setSelection(size_t start, size_t end) {
+    GraphemeIndex& index = clusterIndex();
+    selectionStart = index.snap(std::min(start, text.size()));
+    selectionEnd = index.snap(std::min(end, text.size()));
+    cursorPosition = selectionEnd;
+    invalidate();
+    return *this;
+}
+
+std::string TextInput::getSelectedText() const {
+    return text.substr(getSelectionStart(), getSelectionEnd() - getSelectionStart());
+}
+
+size_t TextInput::getPositionAt(int localX) {
+    GraphemeIndex& index = clusterIndex();
+    int textX = localX - 5;
+    if (!password) return index.hitTest(textX);
+    
+    int starWidth = std::max(1, glyphAdvance('*'));
+    long cluster = std::max(0, (textX + starWidth / 2) / starWidth);
+    return index.move(0, cluster);
+}
+
+GraphemeIndex& TextInput::clusterIndex() {
+    clusters.update(text);
+    return clusters;
+}
+
+int TextInput::caretX(size_t position) {
+    GraphemeIndex& index = clusterIndex();
+    if (password) return static_cast<int>(index.clusterIndex(position)) * glyphAdvance('*');
+    return index.xAt(position);
+}
+
+bool TextInput::eraseSelection() {
+    size_t start = getSelectionStart();
+    size_t end = getSelectionEnd();
+    if (start == end) return false;
+    
+    text.erase(start, end - start);
+    clusters.edit(start, end - start, 0);
+    cursorPosition = selectionStart = selectionEnd = start;
+    return true;
+}
+
+void TextInput::insertText(const std::string& str) {
+    bool erased = eraseSelection();
+    
+    size_t length = str.size();
+    if (maxLength > 0) {
+        // The limit counts clusters, so it never cuts a character in half
+        size_t used = clusterIndex().clusterCount();
+        size_t room = static_cast<size_t>(maxLength) > used ? maxLength - used : 0;
+        length = 0;
+        for (size_t i = 0; i < room && length < str.size(); ++i) {
+            length = nextClusterEnd(str.data(), str.size(), length, nullptr);
+        }
+    }
+    if (length == 0) {
+        if (erased) notifyTextChanged();
+        return;
+    }
+    
+    text.insert(cursorPosition, str.data(), length);
+    clusters.edit(cursorPosition, 0, length);
+    
+    // Inserted text can merge with a mark that followed the cursor
+    size_t end = cursorPosition + length;
+    GraphemeIndex& index = clusterIndex();
+    cursorPosition = index.snap(end) == end ? end : index.move(end, 1);
+    selectionStart = selectionEnd = cursorPosition;
+    notifyTextChanged();
+}
+
+void TextInput::deleteChar(bool forward) {
+    if (eraseSelection()) {
+        notifyTextChanged();
+        return;
+    }
+    
+    GraphemeIndex& index = clusterIndex();
+    size_t start = forward ? cursorPosition : index.move(cursorPosition, -1);
+    size_t end = forward ? index.move(cursorPosition, 1) : cursorPosition;
+    if (start == end) return;
+    
+    text.erase(start, end - start);
+    clusters.edit(start, end - start, 0);
+    cursorPosition = selectionStart = selectionEnd = start;
+    notifyTextChanged();
+}
+
+void TextInput::moveCursor(int steps) {
+    cursorPosition = clusterIndex().move(cursorPosition, steps);
+    selectionStart = selectionEnd = cursorPosition;
+}
+
+void TextInput::notifyTextChanged() {
+    // Every edit ends here
+    invalidate();
+    // Building the event copies the whole text; skip it when nobody listens
+    if (!hasHandlers(EventType::TextChanged)) return;
+    Event event{EventType::TextChanged, this, {{"text", text.text()}}};
+    emit(event);
+}
+
+void TextInput::render() {
+    if (!visible) return;
+    syncFont();
+    
+    const Style& style = getStyle();
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    // Draw background
+    SDL_Color bgColor = toSDLColor(enabled ? style.backgroundColor : style.disabledColor);
+    drawRect(absX, absY, width, height, bgColor);
     
-    // Draw background
-    SDL_Color bgColor = enabled ? SDL_Color{255, 255, 255, 255} : SDL_Color{240, 240, 240, 255};
-    drawRect(absX, absY, width, height, bgColor);
-    
     // Draw border
-    drawRect(absX, absY, width, height, g_context.borderColor, false);
+    drawRect(absX, absY, width, height, toSDLColor(style.borderColor), false);
+    
+    // Draw selection; offsets come from the cluster index, not from measuring
+    GraphemeIndex& index = clusterIndex();
+    size_t renderedEnd = password ? index.boundary(kMaxRenderedLineBytes) : index.snap(kMaxRenderedLineBytes);
+    if (focused && selectionStart != selectionEnd) {
+        int startX = caretX(std::min(getSelectionStart(), renderedEnd));
+        int endX = caretX(std::min(getSelectionEnd(), renderedEnd));
+        drawRect(absX + 5 + startX, absY + 5, endX - startX, height - 10, SDL_Color{180, 205, 240, 255});
+    }
+    
+    // Draw text or placeholder
+    std::string displayText;
+    if (text.empty()) {
+        displayText = placeholder;
+    } else if (password) {
+        displayText.assign(std::min(index.clusterCount(), kMaxRenderedLineBytes), '*');
+    } else {
+        displayText = text.substr(0, renderedEnd);
+    }
+    SDL_Color textColor = text.empty() ? SDL_Color{150, 150, 150, 255} : toSDLColor(style.foregroundColor);
+    
+    if (!displayText.empty()) {
+        int textH = g_context.font ? TTF_FontHeight(g_context.font) : 0;
+        int textY = absY + (height - textH) / 2;
+        drawText(displayText, absX + 5, textY, textColor);
+    }
+    
+    // Draw caret
+    if (focused && cursorPosition <= renderedEnd) {
+        drawRect(absX + 5 + caretX(cursorPosition), absY + 5, 1, height - 10, toSDLColor(style.foregroundColor));
+    }
+}
+
+// Render and dispatch make the style font current; offsets measured with
+// another font are stale
+void TextInput::syncFont() {
+    if (layoutFont == g_context.font) return;
+    layoutFont = g_context.font;
+    clusters.invalidate();
+}
+
+bool TextInput::handleEvent(const Event& event) {
+    syncFont();
+    if (!enabled || event.type != EventType::KeyPress) return false;
+    
+    std::string key = event.getKey();
+    if (key.empty()) {
+        std::string typed = event.getText();
+        if (typed.empty()) return false;
+        insertText(typed);
+        return true;
+    }
+    
+    if (key == "backspace") deleteChar(false);
+    else if (key == "delete") deleteChar(true);
+    else if (key == "left") moveCursor(-1);
+    else if (key == "right") moveCursor(1);
+    else if (key == "home") setCursorPosition(0);
+    else if (key == "end") setCursorPosition(text.size());
+    else return false;
+    return true;
+}
+
+// TextArea implementation
+TextArea::TextArea(const std::string& id)
+    : Widget(id), lines(1), cursorLine(0), cursorColumn(0), preferredCaretX(-1), scrollY(0),
+      lineHeight(g_context.font ? std::max(1, TTF_FontLineSkip(g_context.font)) : 16), readOnly(false),
+      layoutFont(g_context.font) {
+    width = 400;
+    height = 200;
+}
+
+TextArea::~TextArea() {
+    releaseTextures();
+}
+
+void TextArea::releaseTextures() {
+    for (Line& line : lines) {
+        if (line.texture) {
+            destroyCachedTexture(line.texture);
+            line.texture = nullptr;
+        }
+        line.dirty = true;
+    }
+}
+
+TextArea& TextArea::setText(const std::string& text) {
+    releaseTextures();
+    lines.clear();
+    
+    size_t start = 0;
+    for (;;) {
+        size_t newline = text.find('\n', start);
+        lines.emplace_back();
+        lines.back().text.assign(text.substr(start, newline == std::string::npos ? std::string::npos : newline - start));
+        if (newline == std::string::npos) break;
+        start = newline + 1;
+    }
+    
+    cursorLine = 0;
+    cursorColumn = 0;
+    preferredCaretX = -1;
+    scrollY = 0;
+    notifyTextChanged();
+    return *this;
+}
+
+TextArea& TextArea::setReadOnly(bool readOnly) {
+    this->readOnly = readOnly;
+    invalidate();
+    return *this;
+}
+
+TextArea& TextArea::setScrollY(int scrollY) {
+    int maxScroll = std::max(0, static_cast<int>(lines.size()) * lineHeight - height);
+    this->scrollY = std::max(0, std::min(scrollY, maxScroll));
+    invalidate();
+    return *this;
+}
+
+TextArea& TextArea::setCursor(size_t line, size_t column) {
+    cursorLine = std::min(line, lines.size() - 1);
+    cursorColumn = lineClusters(cursorLine).snap(std::min(column, lines[cursorLine].text.size()));
+    preferredCaretX = -1;
+    ensureCursorVisible();
+    invalidate();
+    return *this;
+}
+
+std::string TextArea::getText() const {
+    std::string result;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (i > 0) result += '\n';
+        result += lines[i].text.text();
+    }
+    return result;
+}
+
+std::string TextArea::getLine(size_t index) const {
+    return index < lines.size() ? lines[index].text.text() : std::string();
+}
+
+void TextArea::insertText(const std::string& str) {
+    if (readOnly || str.empty()) return;
+    
+    size_t start = 0;
+    for (;;) {
+        size_t newline = str.find('\n', start);
+        size_t length = (newline == std::string::npos ? str.size() : newline) - start;
+        
+        Line& line = lines[cursorLine];
+        line.text.insert(cursorColumn, str.data() + start, length);
+        line.clusters.edit(cursorColumn, 0, length);
+        line.dirty = true;
+        cursorColumn += length;
+        if (newline == std::string::npos) break;
+        
+        // Split the line at the cursor; only the two halves need re-rasterizing
+        Line next;
+        size_t rest = line.text.size() - cursorColumn;
+        next.text.assign(line.text.substr(cursorColumn, rest));
+        line.text.erase(cursorColumn, rest);
+        line.clusters.edit(cursorColumn, rest, 0);
+        lines.insert(lines.begin() + cursorLine + 1, std::move(next));
+        ++cursorLine;
+        cursorColumn = 0;
+        start = newline + 1;
+    }
+    
+    // Inserted text can merge with a mark that followed the cursor
+    GraphemeIndex& index = lineClusters(cursorLine);
+    if (index.snap(cursorColumn) != cursorColumn) {
+        cursorColumn = index.move(cursorColumn, 1);
+    }
+    preferredCaretX = -1;
+    ensureCursorVisible();
+    notifyTextChanged();
+}
+
+void TextArea::deleteChar(bool forward) {
+    if (readOnly) return;
+    
+    Line& line = lines[cursorLine];
+    GraphemeIndex& index = lineClusters(cursorLine);
+    if (forward) {
+        if (cursorColumn < line.text.size()) {
+            size_t end = index.move(cursorColumn, 1);
+            line.text.erase(cursorColumn, end - cursorColumn);
+            line.clusters.edit(cursorColumn, end - cursorColumn, 0);
+            line.dirty = true;
+        } else if (cursorLine + 1 < lines.size()) {
+            // Join with the next line
+            Line& next = lines[cursorLine + 1];
+            line.text.insert(line.text.size(), next.text.text());
+            line.clusters.edit(cursorColumn, 0, next.text.size());
+            line.dirty = true;
+            if (next.texture) destroyCachedTexture(next.texture);
+            lines.erase(lines.begin() + cursorLine + 1);
+        } else {
+            return;
+        }
+    } else {
+        if (cursorColumn > 0) {
+            size_t start = index.move(cursorColumn, -1);
+            line.text.erase(start, cursorColumn - start);
+            line.clusters.edit(start, cursorColumn - start, 0);
+            cursorColumn = start;
+            line.dirty = true;
+        } else if (cursorLine > 0) {
+            // Join with the previous line
+            Line& previous = lines[cursorLine - 1];
+            cursorColumn = previous.text.size();
+            previous.text.insert(cursorColumn, line.text.text());
+            previous.clusters.edit(cursorColumn, 0, line.text.size());
+            previous.dirty = true;
+            if (line.texture) destroyCachedTexture(line.texture);
+            lines.erase(lines.begin() + cursorLine);
+            --cursorLine;
+        } else {
+            return;
+        }
+    }
+    
+    preferredCaretX = -1;
+    ensureCursorVisible();
+    notifyTextChanged();
+}
+
+void TextArea::moveCursor(int columns, int rows) {
+    if (rows != 0) {
+        // Keep the caret's x position, not its byte offset, across lines
+        int caretX = preferredCaretX >= 0 ? preferredCaretX : lineClusters(cursorLine).xAt(cursorColumn);
+        long target = static_cast<long>(cursorLine) + rows;
+        cursorLine = static_cast<size_t>(std::max(0L, std::min(target, static_cast<long>(lines.size()) - 1)));
+        cursorColumn = lineClusters(cursorLine).hitTest(caretX);
+        preferredCaretX = caretX;
+    }
+    
+    if (columns != 0) preferredCaretX = -1;
+    while (columns != 0) {
+        GraphemeIndex& index = lineClusters(cursorLine);
+        size_t current = index.clusterIndex(cursorColumn);
+        if (columns < 0) {
+            size_t step = std::min(static_cast<size_t>(-columns), current);
+            if (step > 0) {
+                cursorColumn = index.boundary(current - step);
+                columns += static_cast<int>(step);
+            } else if (cursorLine > 0) {
+                cursorColumn = lines[--cursorLine].text.size();
+                ++columns;
+            } else {
+                break;
+            }
+        } else {
+            size_t step = std::min(static_cast<size_t>(columns), index.clusterCount() - current);
+            if (step > 0) {
+                cursorColumn = index.boundary(current + step);
+                columns -= static_cast<int>(step);
+            } else if (cursorLine + 1 < lines.size()) {
+                ++cursorLine;
+                cursorColumn = 0;
+                --columns;
+            } else {
+                break;
+            }
+        }
+    }
+    
+    ensureCursorVisible();
+}
+
+GraphemeIndex& TextArea::lineClusters(size_t line) {
+    lines[line].clusters.update(lines[line].text);
+    return lines[line].clusters;
+}
+
+void TextArea::ensureCursorVisible() {
+    int cursorTop = static_cast<int>(cursorLine) * lineHeight;
+    if (cursorTop < scrollY) {
+        scrollY = cursorTop;
+    } else if (cursorTop + lineHeight > scrollY + height) {
+        scrollY = cursorTop + lineHeight - height;
+    }
+}
+
+void TextArea::notifyTextChanged() {
+    // Every edit ends here
+    invalidate();
+    // Joining every line is O(n); only pay for it when someone listens
+    if (!hasHandlers(EventType::TextChanged)) return;
+    Event event{EventType::TextChanged, this, {{"text", getText()}}};
+    emit(event);
+}
+
+void TextArea::render() {
+    if (!visible) return;
+    syncFont();
+    
+    const Style& style = getStyle();
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    // Draw background and border
+    drawRect(absX, absY, width, height, toSDLColor(style.backgroundColor));
+    drawRect(absX, absY, width, height, toSDLColor(style.borderColor), false);
+    
+    // A theme switch changes the text color baked into the line textures
+    if (style.foregroundColor != lineColor) {
+        lineColor = style.foregroundColor;
+        for (Line& line : lines) {
+            line.dirty = true;
+        }
+    }
+    
+    pushClip({absX + 1, absY + 1, width - 2, height - 2});
+    
+    // Only the lines intersecting the viewport are touched
+    size_t first = static_cast<size_t>(scrollY / lineHeight);
+    size_t last = std::min(lines.size(), static_cast<size_t>((scrollY + height) / lineHeight + 1));
+    for (size_t i = first; i < last; ++i) {
+        Line& line = lines[i];
+        int lineY = absY + static_cast<int>(i) * lineHeight - scrollY;
+        
+        if (line.texture && !isCachedTextureDrawable(line.texture)) {
+            line.dirty = true;
+        }
+        if (line.dirty) {
+            GUI_PROFILE_SCOPE("shapeLine");
+            if (line.texture) {
+                destroyCachedTexture(line.texture);
+                line.texture = nullptr;
+            }
+            std::string visibleText = line.text.substr(0, lineClusters(i).snap(kMaxRenderedLineBytes));
+            if (!visibleText.empty() && g_context.font) {
+                SDL_Surface* surface = TTF_RenderUTF8_Blended(g_context.font, visibleText.c_str(), toSDLColor(lineColor));
+                if (surface) {
+                    line.textureWidth = surface->w;
+                    line.textureHeight = surface->h;
+                    line.texture = createCachedTexture(g_context.renderer, surface);
+                }
+            }
+            line.dirty = false;
+        }
+        
+        if (line.texture) {
+            drawCachedTexture(line.texture, SDL_Rect{absX + 4, lineY, line.textureWidth, line.textureHeight});
+        }
+        
+        if (focused && i == cursorLine && cursorColumn <= kMaxRenderedLineBytes) {
+            int caretX = lineClusters(i).xAt(cursorColumn);
+            drawRect(absX + 4 + caretX, lineY, 1, lineHeight, toSDLColor(lineColor));
+        }
+    }
+    
+    popClip();
+}
+
+void TextArea::syncFont() {
+    if (layoutFont == g_context.font) return;
+    layoutFont = g_context.font;
+    lineHeight = g_context.font ? std::max(1, TTF_FontLineSkip(g_context.font)) : 16;
+    for (Line& line : lines) {
+        line.clusters.invalidate();
+        line.dirty = true;
+    }
+}
+
+bool TextArea::handleEvent(const Event& event) {
+    syncFont();
+    if (!enabled || event.type != EventType::KeyPress) return false;
+    
+    std::string key = event.getKey();
+    if (key.empty()) {
+        std::string typed = event.getText();
+        if (typed.empty() || readOnly) return false;
+        insertText(typed);
+        return true;
+    }
+    
+    int pageRows = std::max(1, height / lineHeight);
+    if (key == "enter" && !readOnly) insertText("\n");
+    else if (key == "backspace") deleteChar(false);
+    else if (key == "delete") deleteChar(true);
+    else if (key == "left") moveCursor(-1, 0);
+    else if (key == "right") moveCursor(1, 0);
+    else if (key == "up") moveCursor(0, -1);
+    else if (key == "down") moveCursor(0, 1);
+    else if (key == "pageup") moveCursor(0, -pageRows);
+    else if (key == "pagedown") moveCursor(0, pageRows);
+    else if (key == "home") setCursor(cursorLine, 0);
+    else if (key == "end") setCursor(cursorLine, lines[cursorLine].text.size());
+    else return false;
+    return true;
+}
+
+// StringTextSource implementation
+StringTextSource::StringTextSource(std::string text) : text(std::move(text)) {
+    const char* data = this->text.data();
+    size_t size = this->text.size();
+    size_t position = 0;
+    while (position < size) {
+        lineStarts.push_back(position);
+        const void* newline = std::memchr(data + position, '\n', size - position);
+        if (!newline) break;
+        position = static_cast<const char*>(newline) - data + 1;
+    }
+}
+
+std::string_view StringTextSource::getLine(size_t index) const {
+    if (index >= lineStarts.size()) return std::string_view();
+    
+    size_t start = lineStarts[index];
+    size_t end = index + 1 < lineStarts.size() ? lineStarts[index + 1] : text.size();
+    if (end > start && text[end - 1] == '\n') --end;
+    if (end > start && text[end - 1] == '\r') --end;
+    return std::string_view(text.data() + start, end - start);
+}
+
+// Newline scanning for file-backed sources. SSE2 compares 16 bytes at a time;
+// other targets fall back to memchr.
+static inline unsigned countTrailingZeros(unsigned value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctz(value));
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    unsigned count = 0;
+    while (!(value & 1u)) {
+        value >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+static uint64_t countNewlines(const char* data, uint64_t begin, uint64_t end) {
+    uint64_t count = 0;
+    uint64_t i = begin;
+#ifdef GUI_HAVE_SSE2
+    // Per-lane byte counters, flushed before they can overflow
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    __m128i counters = zero;
+    int pending = 0;
+    for (; i + 16 <= end; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(block, newline));
+        if (++pending == 255) {
+            __m128i sums = _mm_sad_epu8(counters, zero);
+            count += static_cast<uint64_t>(_mm_cvtsi128_si32(sums)) +
+                     static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+            counters = zero;
+            pending = 0;
+        }
+    }
+    __m128i sums = _mm_sad_epu8(counters, zero);
+    count += static_cast<uint64_t>(_mm_cvtsi128_si32(sums)) +
+             static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+    for (; i < end; ++i) {
+        count += data[i] == '\n';
+    }
+#else
+    while (i < end) {
+        const void* hit = std::memchr(data + i, '\n', static_cast<size_t>(end - i));
+        if (!hit) break;
+        ++count;
+        i = static_cast<uint64_t>(static_cast<const char*>(hit) - data) + 1;
+    }
+#endif
+    return count;
+}
+
+template <typename Fn>
+static void forEachNewline(const char* data, uint64_t begin, uint64_t end, Fn&& fn) {
+    uint64_t i = begin;
+#ifdef GUI_HAVE_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= end; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        while (mask) {
+            fn(i + countTrailingZeros(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; i < end; ++i) {
+        if (data[i] == '\n') fn(i);
+    }
+#else
+    while (i < end) {
+        const void* hit = std::memchr(data + i, '\n', static_cast<size_t>(end - i));
+        if (!hit) break;
+        uint64_t position = static_cast<uint64_t>(static_cast<const char*>(hit) - data);
+        fn(position);
+        i = position + 1;
+    }
+#endif
+}
+
+// Smallest slice worth a thread of its own when indexing
+static const uint64_t kMinIndexBytesPerWorker = 8ull << 20;
+static const size_t kNoCachedBlock = static_cast<size_t>(-1);
+
+static uint64_t queryFileSize(intptr_t handle) {
+#ifdef _WIN32
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(reinterpret_cast<HANDLE>(handle), &fileSize)) return 0;
+    return static_cast<uint64_t>(fileSize.QuadPart);
+#else
+    struct stat info;
+    if (fstat(static_cast<int>(handle), &info) != 0) return 0;
+    return static_cast<uint64_t>(info.st_size);
+#endif
+}
+
+static void closeFileHandle(intptr_t handle) {
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(handle));
+#else
+    close(static_cast<int>(handle));
+#endif
+}
+
+static intptr_t openFileHandle(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    return reinterpret_cast<intptr_t>(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path + ": " + std::strerror(errno));
+    }
+    return fd;
+#endif
+}
+
+// Read-only view of the first `bytes` of an open file; bytes must be non-zero
+static const char* mapFileView(intptr_t handle, uint64_t bytes, const std::string& path, void*& mappingHandle) {
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(reinterpret_cast<HANDLE>(handle), nullptr,
+                                        PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(bytes));
+    if (!view) {
+        CloseHandle(mapping);
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+    mappingHandle = mapping;
+#else
+    (void)mappingHandle;
+    void* view = mmap(nullptr, static_cast<size_t>(bytes), PROT_READ, MAP_SHARED,
+                      static_cast<int>(handle), 0);
+    if (view == MAP_FAILED) {
+        throw std::runtime_error("Failed to map file: " + path + ": " + std::strerror(errno));
+    }
+#endif
+    return static_cast<const char*>(view);
+}
+
+static void unmapFileView(const char* data, uint64_t bytes, void*& mappingHandle) {
+#ifdef _WIN32
+    (void)bytes;
+    UnmapViewOfFile(data);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    mappingHandle = nullptr;
+#else
+    (void)mappingHandle;
+    munmap(const_cast<char*>(data), static_cast<size_t>(bytes));
+#endif
+}
+
+// MappedFileSource implementation
+MappedFileSource::MappedFileSource(const std::string& path)
+    : path(path), data(nullptr), size(0), fileHandle(-1), mappingHandle(nullptr),
+      newlineCount(0), lastLineStart(0), cachedBlock(kNoCachedBlock) {
+    fileHandle = openFileHandle(path);
+    
+    // A throwing constructor runs no destructor, so a failed index build
+    // releases the mapping and the handle here
+    try {
+        map(queryFileSize(fileHandle));
+        rebuildIndex();
+    } catch (...) {
+        unmap();
+        closeFileHandle(fileHandle);
+        throw;
+    }
+}
+
+MappedFileSource::~MappedFileSource() {
+    unmap();
+    closeFileHandle(fileHandle);
+}
+
+void MappedFileSource::map(uint64_t bytes) {
+    unmap();
+    
+    // Zero-length mappings are invalid; an empty file simply has no lines
+    if (bytes == 0) return;
+    
+    data = mapFileView(fileHandle, bytes, path, mappingHandle);
+    size = bytes;
+}
+
+void MappedFileSource::unmap() {
+    if (data) {
+        unmapFileView(data, size, mappingHandle);
+    }
+    data = nullptr;
+    size = 0;
+}
+
+void MappedFileSource::rebuildIndex() {
+    checkpoints.assign(1, 0);
+    newlineCount = 0;
+    lastLineStart = 0;
+    cachedBlock = kNoCachedBlock;
+    if (size == 0) return;
+    
+    uint64_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    size_t workers = static_cast<size_t>(std::min(hardware, size / kMinIndexBytesPerWorker));
+    if (workers <= 1) {
+        indexRange(0, size);
+        return;
+    }
+    
+    std::vector<uint64_t> bounds(workers + 1);
+    for (size_t i = 0; i <= workers; ++i) {
+        bounds[i] = size / workers * i;
+    }
+    bounds[workers] = size;
+    
+    auto runWorkers = [workers](const std::function<void(size_t)>& work) {
+        std::vector<std::thread> threads;
+        threads.reserve(workers - 1);
+        for (size_t i = 1; i < workers; ++i) {
+            threads.emplace_back(work, i);
+        }
+        work(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    };
+    
+    // Pass 1 counts newlines per slice so every worker knows the global number
+    // of its first line; pass 2 records checkpoints at those global positions
+    std::vector<uint64_t> counts(workers);
+    runWorkers([&](size_t i) {
+        counts[i] = countNewlines(data, bounds[i], bounds[i + 1]);
+    });
+    
+    std::vector<uint64_t> firstLine(workers, 0);
+    for (size_t i = 1; i < workers; ++i) {
+        firstLine[i] = firstLine[i - 1] + counts[i - 1];
+    }
+    
+    std::vector<std::vector<uint64_t>> found(workers);
+    std::vector<uint64_t> lastStarts(workers, 0);
+    runWorkers([&](size_t i) {
+        uint64_t line = firstLine[i];
+        std::vector<uint64_t>& local = found[i];
+        local.reserve(counts[i] / kLinesPerCheckpoint + 1);
+        forEachNewline(data, bounds[i], bounds[i + 1], [&](uint64_t position) {
+            if (++line % kLinesPerCheckpoint == 0) {
+                local.push_back(position + 1);
+            }
+            lastStarts[i] = position + 1;
+        });
+    });
+    
+    for (size_t i = 0; i < workers; ++i) {
+        checkpoints.insert(checkpoints.end(), found[i].begin(), found[i].end());
+        newlineCount += counts[i];
+        if (counts[i] > 0) lastLineStart = lastStarts[i];
+    }
+}
+
+void MappedFileSource::indexRange(uint64_t begin, uint64_t end) {
+    forEachNewline(data, begin, end, [this](uint64_t position) {
+        if (++newlineCount % kLinesPerCheckpoint == 0) {
+            checkpoints.push_back(position + 1);
+        }
+        lastLineStart = position + 1;
+    });
+}
+
+bool MappedFileSource::refresh() {
+    uint64_t current = queryFileSize(fileHandle);
+    if (current == size) return false;
+    
+    // Truncated or rotated in place: nothing indexed so far can be trusted
+    if (current < size) {
+        map(current);
+        rebuildIndex();
+        return true;
+    }
+    
+    // Appended: only the new tail is scanned
+    uint64_t previous = size;
+    map(current);
+    cachedBlock = kNoCachedBlock;
+    indexRange(previous, current);
+    return true;
+}
+
+size_t MappedFileSource::getLineCount() const {
+    // A final line without a terminator still counts
+    return static_cast<size_t>(newlineCount + (size > lastLineStart ? 1 : 0));
+}
+
+std::string_view MappedFileSource::getLine(size_t index) const {
+    if (index >= getLineCount()) return std::string_view();
+    
+    // Resolve the whole checkpoint block once; neighbouring rows hit the cache
+    size_t block = index / kLinesPerCheckpoint;
+    if (block != cachedBlock) {
+        cachedStarts.clear();
+        uint64_t position = checkpoints[block];
+        cachedStarts.push_back(position);
+        while (cachedStarts.size() < kLinesPerCheckpoint && position < lastLineStart) {
+            const void* hit = std::memchr(data + position, '\n', static_cast<size_t>(lastLineStart - position));
+            if (!hit) break;
+            position = static_cast<uint64_t>(static_cast<const char*>(hit) - data) + 1;
+            cachedStarts.push_back(position);
+        }
+        cachedBlock = block;
+    }
+    
+    uint64_t start = cachedStarts[index % kLinesPerCheckpoint];
+    const void* newline = std::memchr(data + start, '\n', static_cast<size_t>(size - start));
+    uint64_t end = newline ? static_cast<uint64_t>(static_cast<const char*>(newline) - data) : size;
+    if (end > start && data[end - 1] == '\r') --end;
+    return std::string_view(data + start, static_cast<size_t>(end - start));
+}
+
+// GlyphCache implementation
+
+// File layout, in native byte order (byteOrder rejects files from the other
+// endianness): header, glyph records sorted by codepoint, padding to 16
+// bytes, then pageCount pages of kPageSize x kPageSize ARGB8888 pixels
+// holding white glyphs with coverage in alpha.
+static const char kGlyphFileMagic[8] = {'G', 'U', 'I', 'G', 'L', 'Y', 'P', 'H'};
+static const uint32_t kGlyphFileVersion = 2;
+static const uint32_t kGlyphFileByteOrder = 0x01020304;
+
+struct GlyphFileHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint64_t fontHash;     // FNV-1a of the font file
+    uint64_t fontBytes;    // size and modification time of the font file; while
+    int64_t fontModified;  // both match, fontHash is trusted without rehashing
+    uint32_t pointSize;
+    uint32_t style;
+    int32_t height;        // TTF_FontHeight, the height of a measured run
+    uint32_t pageSize;
+    uint32_t pageCount;
+    uint32_t glyphCount;
+};
+
+struct GlyphRecord {
+    uint32_t codepoint;
+    int32_t advance;
+    uint32_t page;
+    uint32_t x, y;
+    uint32_t width, height;   // the glyph drawn at the pen position, full line height
+};
+
+static_assert(sizeof(GlyphFileHeader) == 64, "glyph cache header layout");
+static_assert(sizeof(GlyphRecord) == 28, "glyph cache record layout");
+
+static uint64_t glyphPagesOffset(uint64_t glyphCount) {
+    return (sizeof(GlyphFileHeader) + glyphCount * sizeof(GlyphRecord) + 15) & ~uint64_t(15);
+}
+
+static const uint64_t kGlyphPageBytes = uint64_t(GlyphCache::kPageSize) * GlyphCache::kPageSize * 4;
+
+// One mapped cache file
+struct GlyphSet {
+    std::string path;
+    const char* data = nullptr;
+    uint64_t size = 0;
+    void* mappingHandle = nullptr;
+    const GlyphFileHeader* header = nullptr;
+    const GlyphRecord* records = nullptr;
+    const char* pages = nullptr;
+    int32_t ascii[128];   // record index, -1 if not cached
+    std::unordered_map<SDL_Renderer*, std::vector<SDL_Texture*>> textures;
+    std::vector<SDL_Surface*> pageSurfaces;   // views of the mapped pages for display lists
+    
+    GlyphSet() {
+        std::fill(std::begin(ascii), std::end(ascii), -1);
+    }
+    
+    ~GlyphSet() {
+        for (auto& entry : textures) {
+            for (SDL_Texture* texture : entry.second) {
+                if (texture) SDL_DestroyTexture(texture);
+            }
+        }
+        for (SDL_Surface* surface : pageSurfaces) {
+            if (surface) SDL_FreeSurface(surface);
+        }
+        if (data) {
+            unmapFileView(data, size, mappingHandle);
+        }
+    }
+    
+    const GlyphRecord* find(uint32_t codepoint) const {
+        if (codepoint < 128) {
+            return ascii[codepoint] >= 0 ? &records[ascii[codepoint]] : nullptr;
+        }
+        const GlyphRecord* end = records + header->glyphCount;
+        const GlyphRecord* it = std::lower_bound(records, end, codepoint,
+            [](const GlyphRecord& record, uint32_t value) { return record.codepoint < value; });
+        return it != end && it->codepoint == codepoint ? it : nullptr;
+    }
+};
+
+struct GlyphCacheState {
+    std::vector<std::unique_ptr<GlyphSet>> sets;
+    std::unordered_map<TTF_Font*, GlyphSet*> bound;
+    std::unordered_map<std::string, uint64_t> fontHashes;   // font file -> content hash
+    TTF_Font* lastFont = nullptr;
+    GlyphSet* lastSet = nullptr;
+    size_t cachedRuns = 0;
+    size_t fallbackRuns = 0;
+};
+
+static GlyphCacheState g_glyphCache;
+
+// Size and last write time of a file, both 0 if it cannot be queried
+static void fileStamp(const std::string& path, uint64_t& bytes, int64_t& modified) {
+    bytes = 0;
+    modified = 0;
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) return;
+    bytes = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    modified = static_cast<int64_t>((static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+                                    info.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return;
+    bytes = static_cast<uint64_t>(info.st_size);
+    modified = static_cast<int64_t>(info.st_mtime);
+#endif
+}
+
+// Reads and hashes the whole file; bindGlyphSet only needs it when the stamp differs
+static uint64_t fontFileHash(const std::string& path) {
+    auto cached = g_glyphCache.fontHashes.find(path);
+    if (cached != g_glyphCache.fontHashes.end()) return cached->second;
+    
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return g_glyphCache.fontHashes[path] = hashBytes(bytes);
+}
+
+static GlyphSet* glyphSetFor(TTF_Font* font) {
+    if (g_glyphCache.bound.empty() || !font) return nullptr;
+    if (g_glyphCache.lastFont != font) {
+        auto it = g_glyphCache.bound.find(font);
+        g_glyphCache.lastFont = font;
+        g_glyphCache.lastSet = it != g_glyphCache.bound.end() ? it->second : nullptr;
+    }
+    return g_glyphCache.lastSet;
+}
+
+static void bindGlyphSet(TTF_Font* font) {
+    if (g_glyphCache.sets.empty()) return;
+    auto info = g_fonts.openFonts.find(font);
+    if (info == g_fonts.openFonts.end()) return;
+    
+    const std::string& path = info->second.path;
+    uint64_t bytes;
+    int64_t modified;
+    fileStamp(path, bytes, modified);
+    for (const auto& set : g_glyphCache.sets) {
+        const GlyphFileHeader& header = *set->header;
+        if (static_cast<int>(header.pointSize) != info->second.size ||
+            static_cast<int>(header.style) != info->second.style) {
+            continue;
+        }
+        bool sameStamp = bytes != 0 && header.fontBytes == bytes && header.fontModified == modified;
+        if (sameStamp || header.fontHash == fontFileHash(path)) {
+            g_glyphCache.bound[font] = set.get();
+            g_glyphCache.lastFont = nullptr;
+            return;
+        }
+    }
+}
+
+static void unbindGlyphSets() {
+    g_glyphCache.bound.clear();
+    g_glyphCache.lastFont = nullptr;
+    g_glyphCache.lastSet = nullptr;
+}
+
+static void unloadGlyphFile(const std::string& path) {
+    auto& sets = g_glyphCache.sets;
+    auto it = std::find_if(sets.begin(), sets.end(), [&path](const std::unique_ptr<GlyphSet>& set) {
+        return set->path == path;
+    });
+    if (it == sets.end()) return;
+    
+    for (auto bound = g_glyphCache.bound.begin(); bound != g_glyphCache.bound.end();) {
+        if (bound->second == it->get()) bound = g_glyphCache.bound.erase(bound);
+        else ++bound;
+    }
+    g_glyphCache.lastFont = nullptr;
+    sets.erase(it);
+}
+
+static bool cachedGlyphAdvance(TTF_Font* font, uint32_t codepoint, int& advance) {
+    GlyphSet* set = glyphSetFor(font);
+    const GlyphRecord* record = set ? set->find(codepoint) : nullptr;
+    if (!record) return false;
+    advance = record->advance;
+    return true;
+}
+
+static bool measureCachedGlyphs(const std::string& text, int& w, int& h) {
+    GlyphSet* set = glyphSetFor(g_context.font);
+    if (!set) return false;
+    
+    int width = 0;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        const GlyphRecord* record = set->find(decodeUtf8(p, end));
+        if (!record) {
+            ++g_glyphCache.fallbackRuns;
+            return false;
+        }
+        width += record->advance;
+    }
+    w = width;
+    h = set->header->height;
+    ++g_glyphCache.cachedRuns;
+    return true;
+}
+
+// Page textures are filled straight from the mapped file
+static SDL_Texture* glyphPageTexture(GlyphSet& set, SDL_Renderer* renderer, uint32_t page) {
+    std::vector<SDL_Texture*>& textures = set.textures[renderer];
+    if (textures.empty()) {
+        textures.assign(set.header->pageCount, nullptr);
+    }
+    if (!textures[page]) {
+        SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                                 GlyphCache::kPageSize, GlyphCache::kPageSize);
+        if (!texture) return nullptr;
+        SDL_UpdateTexture(texture, nullptr, set.pages + page * kGlyphPageBytes, GlyphCache::kPageSize * 4);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        textures[page] = texture;
+    }
+    return textures[page];
+}
+
+// The surfaces read the mapped file in place; display lists only read them
+static SDL_Surface* glyphPageSurface(GlyphSet& set, uint32_t page) {
+    if (set.pageSurfaces.empty()) {
+        set.pageSurfaces.assign(set.header->pageCount, nullptr);
+    }
+    if (!set.pageSurfaces[page]) {
+        void* pixels = const_cast<char*>(set.pages + page * kGlyphPageBytes);
+        set.pageSurfaces[page] = SDL_CreateRGBSurfaceWithFormatFrom(pixels, GlyphCache::kPageSize, GlyphCache::kPageSize,
+                                                                    32, GlyphCache::kPageSize * 4, SDL_PIXELFORMAT_ARGB8888);
+    }
+    return set.pageSurfaces[page];
+}
+
+static bool drawCachedGlyphs(const std::string& text, int x, int y, const SDL_Color& color) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    GlyphSet* set = glyphSetFor(g_context.font);
+    if (!set) return false;
+    
+    thread_local std::vector<const GlyphRecord*> run;
+    run.clear();
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        const GlyphRecord* record = set->find(decodeUtf8(p, end));
+        if (!record) {
+            ++g_glyphCache.fallbackRuns;
+            return false;
+        }
+        run.push_back(record);
+    }
+    
+    if (g_context.recording) {
+        // One blit per glyph, tinted through the modulation color
+        int penX = x;
+        for (const GlyphRecord* record : run) {
+            if (record->width > 0) {
+                SDL_Surface* page = glyphPageSurface(*set, record->page);
+                if (!page) return false;
+                int width = static_cast<int>(record->width);
+                int height = static_cast<int>(record->height);
+                SDL_Rect source = {static_cast<int>(record->x), static_cast<int>(record->y), width, height};
+                recordBlit(page, &source, SDL_Rect{penX, y, width, height}, color);
+            }
+            penX += record->advance;
+        }
+        ++g_glyphCache.cachedRuns;
+        return true;
+    }
+    
+    // White glyphs tinted through the vertex color, one call per page touched
+    thread_local std::vector<SDL_Vertex> vertices;
+    thread_local std::vector<int> indices;
+    const float scale = 1.0f / GlyphCache::kPageSize;
+    for (uint32_t page = 0; page < set->header->pageCount; ++page) {
+        vertices.clear();
+        indices.clear();
+        float penX = static_cast<float>(x);
+        for (const GlyphRecord* record : run) {
+            float left = penX;
+            penX += record->advance;
+            if (record->page != page || record->width == 0) continue;
+            
+            float top = static_cast<float>(y);
+            float right = left + record->width;
+            float bottom = top + record->height;
+            float u0 = record->x * scale;
+            float v0 = record->y * scale;
+            float u1 = (record->x + record->width) * scale;
+            float v1 = (record->y + record->height) * scale;
+            
+            int base = static_cast<int>(vertices.size());
+            vertices.push_back(SDL_Vertex{SDL_FPoint{left, top}, color, SDL_FPoint{u0, v0}});
+            vertices.push_back(SDL_Vertex{SDL_FPoint{right, top}, color, SDL_FPoint{u1, v0}});
+            vertices.push_back(SDL_Vertex{SDL_FPoint{right, bottom}, color, SDL_FPoint{u1, v1}});
+            vertices.push_back(SDL_Vertex{SDL_FPoint{left, bottom}, color, SDL_FPoint{u0, v1}});
+            for (int corner : {0, 1, 2, 0, 2, 3}) {
+                indices.push_back(base + corner);
+            }
+        }
+        if (vertices.empty()) continue;
+        
+        SDL_Texture* texture = glyphPageTexture(*set, g_context.renderer, page);
+        if (!texture) return false;
+        SDL_RenderGeometry(g_context.renderer, texture, vertices.data(), static_cast<int>(vertices.size()),
+                           indices.data(), static_cast<int>(indices.size()));
+    }
+    ++g_glyphCache.cachedRuns;
+    return true;
+#else
+    (void)text; (void)x; (void)y; (void)color;
+    return false;
+#endif
+}
+
+bool GlyphCache::build(const std::string& file, const std::string& family, int size,
+                       const std::string& characters, int style) {
+    initSDL();
+    finishStartup();
+    TTF_Font* font = FontManager::get(family, size, style);
+    if (!font) return false;
+    
+    std::vector<uint32_t> codepoints;
+    for (uint32_t c = 32; c < 127; ++c) codepoints.push_back(c);
+    for (uint32_t c = 160; c < 256; ++c) codepoints.push_back(c);
+    const char* p = characters.data();
+    const char* end = p + characters.size();
+    while (p < end) {
+        uint32_t codepoint = decodeUtf8(p, end);
+        if (codepoint >= 32 && codepoint != 0xFFFD) codepoints.push_back(codepoint);
+    }
+    std::sort(codepoints.begin(), codepoints.end());
+    codepoints.erase(std::unique(codepoints.begin(), codepoints.end()), codepoints.end());
+    
+    std::vector<GlyphRecord> records;
+    std::vector<std::vector<uint32_t>> pages;
+    std::vector<SkylinePacker> packers;
+    const SDL_Color white = {255, 255, 255, 255};
+    for (uint32_t codepoint : codepoints) {
+        int minX, maxX, minY, maxY, advance;
+        if (!TTF_GlyphIsProvided32(font, codepoint) ||
+            TTF_GlyphMetrics32(font, codepoint, &minX, &maxX, &minY, &maxY, &advance) != 0) {
+            continue;
+        }
+        
+        SDL_Surface* rendered = TTF_RenderGlyph32_Blended(font, codepoint, white);
+        SDL_Surface* glyph = rendered ? SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_ARGB8888, 0) : nullptr;
+        SDL_FreeSurface(rendered);
+        if (!glyph) continue;
+        
+        int packedX = 0, packedY = 0;
+        size_t page = 0;
+        bool fits = glyph->w + 2 <= kPageSize && glyph->h + 2 <= kPageSize;
+        while (fits && page < packers.size() && !packers[page].insert(glyph->w + 2, glyph->h + 2, packedX, packedY)) {
+            ++page;
+        }
+        if (fits && page == packers.size()) {
+            packers.emplace_back(kPageSize, kPageSize);
+            pages.emplace_back(static_cast<size_t>(kPageSize) * kPageSize, 0u);
+            packers.back().insert(glyph->w + 2, glyph->h + 2, packedX, packedY);
+        }
+        if (fits) {
+            for (int row = 0; row < glyph->h; ++row) {
+                std::memcpy(&pages[page][static_cast<size_t>(packedY + 1 + row) * kPageSize + packedX + 1],
+                            static_cast<const char*>(glyph->pixels) + row * glyph->pitch, glyph->w * 4);
+            }
+            records.push_back(GlyphRecord{codepoint, advance, static_cast<uint32_t>(page),
+                                          static_cast<uint32_t>(packedX + 1), static_cast<uint32_t>(packedY + 1),
+                                          static_cast<uint32_t>(glyph->w), static_cast<uint32_t>(glyph->h)});
+        }
+        SDL_FreeSurface(glyph);
+    }
+    
+    GlyphFileHeader header{};
+    std::memcpy(header.magic, kGlyphFileMagic, sizeof(header.magic));
+    header.byteOrder = kGlyphFileByteOrder;
+    header.version = kGlyphFileVersion;
+    std::string fontPath = FontManager::resolve(family);
+    header.fontHash = fontFileHash(fontPath);
+    fileStamp(fontPath, header.fontBytes, header.fontModified);
+    header.pointSize = static_cast<uint32_t>(size);
+    header.style = static_cast<uint32_t>(style);
+    header.height = TTF_FontHeight(font);
+    header.pageSize = kPageSize;
+    header.pageCount = static_cast<uint32_t>(pages.size());
+    header.glyphCount = static_cast<uint32_t>(records.size());
+    
+    // Written beside the target and renamed, so a mapped copy is never truncated under a reader
+    unloadGlyphFile(file);
+    std::string temporary = file + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(GlyphRecord));
+        uint64_t written = sizeof(header) + records.size() * sizeof(GlyphRecord);
+        static const char zeros[16] = {};
+        out.write(zeros, static_cast<std::streamsize>(glyphPagesOffset(records.size()) - written));
+        for (const auto& page : pages) {
+            out.write(reinterpret_cast<const char*>(page.data()), page.size() * sizeof(uint32_t));
+        }
+        if (!out) {
+            out.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    std::remove(file.c_str());
+    return std::rename(temporary.c_str(), file.c_str()) == 0;
+}
+
+bool GlyphCache::load(const std::string& file) {
+    finishStartup();
+    unloadGlyphFile(file);
+    
+    auto set = std::make_unique<GlyphSet>();
+    set->path = file;
+    try {
+        intptr_t handle = openFileHandle(file);
+        uint64_t bytes = queryFileSize(handle);
+        try {
+            if (bytes >= sizeof(GlyphFileHeader)) {
+                set->data = mapFileView(handle, bytes, file, set->mappingHandle);
+                set->size = bytes;
+            }
+        } catch (...) {
+            closeFileHandle(handle);
+            throw;
+        }
+        // The mapping stays valid without the handle
+        closeFileHandle(handle);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    if (!set->data) return false;
+    
+    const GlyphFileHeader& header = *reinterpret_cast<const GlyphFileHeader*>(set->data);
+    if (std::memcmp(header.magic, kGlyphFileMagic, sizeof(header.magic)) != 0 ||
+        header.byteOrder != kGlyphFileByteOrder || header.version != kGlyphFileVersion ||
+        header.pageSize != static_cast<uint32_t>(kPageSize) ||
+        glyphPagesOffset(header.glyphCount) + header.pageCount * kGlyphPageBytes > set->size) {
+        return false;
+    }
+    
+    set->header = &header;
+    set->records = reinterpret_cast<const GlyphRecord*>(set->data + sizeof(GlyphFileHeader));
+    set->pages = set->data + glyphPagesOffset(header.glyphCount);
+    for (uint32_t i = 0; i < header.glyphCount; ++i) {
+        const GlyphRecord& record = set->records[i];
+        if (record.page >= header.pageCount || record.x + record.width > header.pageSize ||
+            record.y + record.height > header.pageSize ||
+            (i > 0 && set->records[i - 1].codepoint >= record.codepoint)) {
+            return false;
+        }
+        if (record.codepoint < 128) set->ascii[record.codepoint] = static_cast<int32_t>(i);
+    }
+    
+    g_glyphCache.sets.push_back(std::move(set));
+    for (const auto& entry : g_fonts.openFonts) {
+        bindGlyphSet(entry.first);
+    }
+    return true;
+}
+
+void GlyphCache::unloadAll() {
+    finishStartup();
+    unbindGlyphSets();
+    g_glyphCache.sets.clear();
+}
+
+void GlyphCache::releaseRenderer(SDL_Renderer* renderer) {
+    // Called from Window's destructor, so it must not throw a loader error
+    joinFontLoader();
+    for (auto& set : g_glyphCache.sets) {
+        auto it = set->textures.find(renderer);
+        if (it == set->textures.end()) continue;
+        for (SDL_Texture* texture : it->second) {
+            if (texture) SDL_DestroyTexture(texture);
+        }
+        set->textures.erase(it);
+    }
+}
+
+GlyphCache::Stats GlyphCache::getStats() {
+    finishStartup();
+    Stats stats{};
+    stats.files = g_glyphCache.sets.size();
+    for (const auto& set : g_glyphCache.sets) {
+        stats.glyphs += set->header->glyphCount;
+        stats.mappedBytes += set->size;
+    }
+    stats.boundFonts = g_glyphCache.bound.size();
+    stats.cachedRuns = g_glyphCache.cachedRuns;
+    stats.fallbackRuns = g_glyphCache.fallbackRuns;
+    return stats;
+}
+
+// TextView implementation
+TextView::TextView(const std::string& id)
+    : Widget(id), topLine(0), topRow(0), wordWrap(true),
+      lineHeight(g_context.font ? std::max(1, TTF_FontLineSkip(g_context.font)) : 16),
+      rowCacheCapacity(512), layoutFont(g_context.font) {
+    width = 400;
+    height = 300;
+}
+
+TextView::~TextView() {
+    clearCaches();
+}
+
+void TextView::clearCaches() {
+    for (auto& entry : rowCache) {
+        if (entry.second.texture) {
+            destroyCachedTexture(entry.second.texture);
+        }
+    }
+    rowCache.clear();
+    rowLru.clear();
+    breakCache.clear();
+}
+
+TextView& TextView::setSource(std::shared_ptr<TextSource> source) {
+    this->source = std::move(source);
+    topLine = 0;
+    topRow = 0;
+    invalidate();
+    return *this;
+}
+
+TextView& TextView::setText(std::string text) {
+    return setSource(std::make_shared<StringTextSource>(std::move(text)));
+}
+
+TextView& TextView::setWordWrap(bool wordWrap) {
+    this->wordWrap = wordWrap;
+    topRow = 0;
+    invalidate();
+    return *this;
+}
+
+TextView& TextView::setRowCacheCapacity(size_t rows) {
+    rowCacheCapacity = std::max<size_t>(1, rows);
+    return *this;
+}
+
+// Seed of the second hash that confirms a break cache hit
+static const uint64_t kBreakCheckSeed = 0x84222325CBF29CE4ull;
+
+const std::vector<uint32_t>& TextView::layoutLine(size_t line) {
+    static const std::vector<uint32_t> kSingleRow{0};
+    if (!source || line >= source->getLineCount()) return kSingleRow;
+    
+    std::string_view text = source->getLine(line);
+    int wrapWidth = wordWrap ? std::max(1, width - 8) : 0;
+    if (wrapWidth == 0 || text.empty()) return kSingleRow;
+    
+    // Breaks depend only on content and width, so identical lines share an entry
+    // and a resize back to a previous width is a cache hit
+    uint64_t key = hashBytes(text) ^ (static_cast<uint64_t>(wrapWidth) * 0x9E3779B97F4A7C15ull);
+    uint64_t check = hashBytes(text, kBreakCheckSeed);
+    auto cached = breakCache.find(key);
+    if (cached != breakCache.end()) {
+        const LineBreaks& entry = cached->second;
+        if (entry.length == text.size() && entry.width == wrapWidth && entry.check == check) return entry.starts;
+        // Another line with the same key; it is replaced below
+        breakCache.erase(cached);
+    }
+    
+    if (breakCache.size() >= 1 << 16) {
+        breakCache.clear();
+    }
+    
+    std::vector<uint32_t> breaks{0};
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    const char* p = begin;
+    size_t rowStart = 0;
+    size_t lastSpaceEnd = std::string_view::npos;
+    int rowWidth = 0;
+    int widthThroughSpace = 0;
+    
+    while (p < end) {
+        const char* charStart = p;
+        uint32_t codepoint = decodeUtf8(p, end);
+        int advance = glyphAdvance(codepoint);
+        size_t offset = static_cast<size_t>(charStart - begin);
+        
+        if (rowWidth + advance > wrapWidth && offset > rowStart) {
+            // Prefer breaking after the last space on the row, else mid-word
+            if (lastSpaceEnd != std::string_view::npos && lastSpaceEnd > rowStart) {
+                rowStart = lastSpaceEnd;
+                rowWidth -= widthThroughSpace;
+            } else {
+                rowStart = offset;
+                rowWidth = 0;
+            }
+            breaks.push_back(static_cast<uint32_t>(rowStart));
+            lastSpaceEnd = std::string_view::npos;
+        }
+        
+        rowWidth += advance;
+        if (codepoint == ' ') {
+            lastSpaceEnd = static_cast<size_t>(p - begin);
+            widthThroughSpace = rowWidth;
+        }
+    }
+    
+    LineBreaks entry{text.size(), wrapWidth, check, std::move(breaks)};
+    return breakCache.emplace(key, std::move(entry)).first->second.starts;
+}
+
+const TextView::ShapedRow* TextView::shapeRow(std::string_view text) {
+    if (text.empty() || !g_context.font) return nullptr;
+    
+    uint64_t key = hashBytes(text);
+    auto cached = rowCache.find(key);
+    if (cached != rowCache.end()) {
+        if (cached->second.text == text && isCachedTextureDrawable(cached->second.texture)) {
+            rowLru.splice(rowLru.begin(), rowLru, cached->second.lruPosition);
+            return &cached->second;
+        }
+        // Another row with the same hash, or one the display list cannot draw; it is replaced below
+        destroyCachedTexture(cached->second.texture);
+        rowLru.erase(cached->second.lruPosition);
+        rowCache.erase(cached);
+    }
+    
+    GUI_PROFILE_SCOPE("shapeRow");
+    std::string bytes(text);
+    SDL_Surface* surface = TTF_RenderUTF8_Blended(g_context.font, bytes.c_str(), toSDLColor(rowColor));
+    if (!surface) return nullptr;
+    ShapedRow row{nullptr, surface->w, surface->h, std::move(bytes), {}};
+    row.texture = createCachedTexture(g_context.renderer, surface);
+    if (!row.texture) return nullptr;
+    
+    while (rowCache.size() >= rowCacheCapacity && !rowLru.empty()) {
+        auto evicted = rowCache.find(rowLru.back());
+        destroyCachedTexture(evicted->second.texture);
+        rowCache.erase(evicted);
+        rowLru.pop_back();
+    }
+    
+    rowLru.push_front(key);
+    row.lruPosition = rowLru.begin();
+    return &rowCache.emplace(key, std::move(row)).first->second;
+}
+
+void TextView::scrollToLine(size_t line) {
+    size_t count = getLineCount();
+    topLine = count == 0 ? 0 : std::min(line, count - 1);
+    topRow = 0;
+    invalidate();
+}
+
+void TextView::scrollRows(long rows) {
+    size_t count = getLineCount();
+    if (count == 0) return;
+    invalidate();
+    
+    // Walks wrapped rows one line at a time; only the lines crossed are laid out
+    for (; rows > 0; --rows) {
+        if (topRow + 1 < layoutLine(topLine).size()) {
+            ++topRow;
+        } else if (topLine + 1 < count) {
+            ++topLine;
+            topRow = 0;
+        } else {
+            break;
+        }
+    }
+    for (; rows < 0; ++rows) {
+        if (topRow > 0) {
+            --topRow;
+        } else if (topLine > 0) {
+            --topLine;
+            topRow = layoutLine(topLine).size() - 1;
+        } else {
+            break;
+        }
+    }
+}
+
+void TextView::render() {
+    if (!visible) return;
+    syncFont();
+    
+    const Style& style = getStyle();
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    drawRect(absX, absY, width, height, toSDLColor(style.backgroundColor));
+    drawRect(absX, absY, width, height, toSDLColor(style.borderColor), false);
+    if (!source) return;
+    
+    // Cached rows carry the old text color after a theme switch
+    if (style.foregroundColor != rowColor) {
+        for (auto& cached : rowCache) {
+            destroyCachedTexture(cached.second.texture);
+        }
+        rowCache.clear();
+        rowLru.clear();
+        rowColor = style.foregroundColor;
+    }
+    
+    pushClip({absX + 1, absY + 1, width - 2, height - 2});
+    
+    size_t count = source->getLineCount();
+    size_t line = topLine;
+    size_t row = topRow;
+    int rowY = absY + 2;
+    
+    while (rowY < absY + height && line < count) {
+        std::string_view text = source->getLine(line);
+        const std::vector<uint32_t>& breaks = layoutLine(line);
+        
+        // A resize can leave topRow past the end of a re-wrapped line
+        row = std::min(row, breaks.size() - 1);
+        for (; row < breaks.size() && rowY < absY + height; ++row) {
+            size_t start = breaks[row];
+            size_t end = row + 1 < breaks.size() ? breaks[row + 1] : text.size();
+            size_t length = std::min(end - start, kMaxRenderedLineBytes);
+            
+            if (const ShapedRow* shaped = shapeRow(text.substr(start, length))) {
+                drawCachedTexture(shaped->texture, SDL_Rect{absX + 4, rowY, shaped->width, shaped->height});
+            }
+            rowY += lineHeight;
+        }
+        
+        ++line;
+        row = 0;
+    }
+    
+    popClip();
+}
+
+void TextView::syncFont() {
+    if (layoutFont == g_context.font) return;
+    layoutFont = g_context.font;
+    lineHeight = g_context.font ? std::max(1, TTF_FontLineSkip(g_context.font)) : 16;
+    clearCaches();
+}
+
+bool TextView::handleEvent(const Event& event) {
+    syncFont();
+    if (event.type != EventType::KeyPress) return false;
+    
+    std::string key = event.getKey();
+    long pageRows = std::max(1, height / lineHeight - 1);
+    if (key == "up") scrollRows(-1);
+    else if (key == "down") scrollRows(1);
+    else if (key == "pageup") scrollRows(-pageRows);
+    else if (key == "pagedown") scrollRows(pageRows);
+    else if (key == "home") scrollToLine(0);
+    else if (key == "end") scrollToLine(getLineCount());
+    else return false;
+    return true;
+}
+
+// ListBox implementation
+ListBox::ListBox(const std::string& id)
+    : Widget(id), selectedIndex(-1), scrollOffset(0),
+      itemHeight(g_context.font ? std::max(1, TTF_FontLineSkip(g_context.font)) + 4 : 20),
+      multiSelect(false), layoutFont(g_context.font) {
+    width = 200;
+    height = 150;
+}
+
+ListBox& ListBox::addItem(const std::string& item) {
+    source.reset();
+    items.push_back(item);
+    invalidate();
+    return *this;
+}
+
+ListBox& ListBox::setItems(const std::vector<std::string>& items) {
+    source.reset();
+    this->items = items;
+    clearSelection();
+    scrollOffset = 0;
+    invalidate();
+    return *this;
+}
+
+ListBox& ListBox::setSource(std::shared_ptr<TextSource> source) {
+    this->source = std::move(source);
+    items.clear();
+    clearSelection();
+    scrollOffset = 0;
+    invalidate();
+    return *this;
+}
+
+ListBox& ListBox::setSelectedIndex(int index) {
+    if (index < 0 || static_cast<size_t>(index) >= getItemCount()) {
+        return clearSelection();
+    }
+    
+    selectedIndex = index;
+    if (!multiSelect) {
+        selectedIndices.assign(1, index);
+    } else if (std::find(selectedIndices.begin(), selectedIndices.end(), index) == selectedIndices.end()) {
+        selectedIndices.push_back(index);
+    }
+    scrollTo(index);
+    invalidate();
+    return *this;
+}
+
+ListBox& ListBox::setMultiSelect(bool multiSelect) {
+    this->multiSelect = multiSelect;
+    if (!multiSelect) {
+        selectedIndices.clear();
+        if (selectedIndex >= 0) selectedIndices.push_back(selectedIndex);
+    }
+    invalidate();
+    return *this;
+}
+
+ListBox& ListBox::clearSelection() {
+    selectedIndex = -1;
+    selectedIndices.clear();
+    invalidate();
+    return *this;
+}
+
+void ListBox::scrollTo(int index) {
+    int visibleRows = std::max(1, (height - 2) / itemHeight);
+    if (index < scrollOffset) {
+        scrollOffset = std::max(0, index);
+    } else if (index >= scrollOffset + visibleRows) {
+        scrollOffset = index - visibleRows + 1;
+    }
+    invalidate();
+}
+
+std::string_view ListBox::getItem(size_t index) const {
+    if (source) return source->getLine(index);
+    return index < items.size() ? std::string_view(items[index]) : std::string_view();
+}
+
+std::string ListBox::getSelectedItem() const {
+    return selectedIndex >= 0 ? std::string(getItem(selectedIndex)) : "";
+}
+
+std::vector<std::string> ListBox::getSelectedItems() const {
+    std::vector<std::string> result;
+    for (int index : selectedIndices) {
+        result.emplace_back(getItem(index));
+    }
+    return result;
+}
+
+void ListBox::render() {
+    if (!visible) return;
+    syncFont();
+    
+    const Style& style = getStyle();
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    drawRect(absX, absY, width, height, toSDLColor(style.backgroundColor));
+    drawRect(absX, absY, width, height, toSDLColor(style.borderColor), false);
+    
+    pushClip({absX + 1, absY + 1, width - 2, height - 2});
+    
+    // Only visible rows are fetched, so sourced lists never touch the rest of the file
+    size_t count = getItemCount();
+    SDL_Color textColor = enabled ? toSDLColor(style.foregroundColor) : SDL_Color{150, 150, 150, 255};
+    int rowY = absY + 1;
+    for (size_t index = static_cast<size_t>(scrollOffset); index < count && rowY < absY + height; ++index) {
+        bool selected = static_cast<int>(index) == selectedIndex ||
+                        std::find(selectedIndices.begin(), selectedIndices.end(),
+                                  static_cast<int>(index)) != selectedIndices.end();
+        if (selected) {
+            drawRect(absX + 1, rowY, width - 2, itemHeight, SDL_Color{200, 220, 245, 255});
+        }
+        
+        std::string_view item = getItem(index);
+        drawText(std::string(item.substr(0, kMaxRenderedLineBytes)), absX + 4, rowY + 2, textColor);
+        rowY += itemHeight;
+    }
+    
+    popClip();
+}
+
+void ListBox::syncFont() {
+    if (layoutFont == g_context.font) return;
+    layoutFont = g_context.font;
+    itemHeight = g_context.font ? std::max(1, TTF_FontLineSkip(g_context.font)) + 4 : 20;
+}
+
+bool ListBox::handleEvent(const Event& event) {
+    syncFont();
+    if (event.type != EventType::KeyPress || getItemCount() == 0) return false;
+    
+    std::string key = event.getKey();
+    int last = static_cast<int>(getItemCount()) - 1;
+    int pageRows = std::max(1, (height - 2) / itemHeight - 1);
+    int current = std::max(0, selectedIndex);
+    if (key == "up") setSelectedIndex(std::max(0, current - 1));
+    else if (key == "down") setSelectedIndex(selectedIndex < 0 ? 0 : std::min(last, current + 1));
+    else if (key == "pageup") setSelectedIndex(std::max(0, current - pageRows));
+    else if (key == "pagedown") setSelectedIndex(std::min(last, current + pageRows));
+    else if (key == "home") setSelectedIndex(0);
+    else if (key == "end") setSelectedIndex(last);
+    else return false;
+    return true;
+}
+
+// ToolBar implementation
+static const int kToolSpacing = 4;
+static const int kSeparatorWidth = 9;
+
+ToolBar::ToolBar(const std::string& id)
+    : Widget(id), toolSize(32), showTooltips(true), hoveredTool(-1) {
+    width = 400;
+    height = toolSize + 8;
+}
+
+ToolBar& ToolBar::addTool(const std::string& icon, const std::string& tooltip, 
+                          std::function<void()> onClick, bool toggle) {
+    tools.push_back(Tool{icon, tooltip, std::move(onClick), true, toggle, false, false, nullptr, Image(), false});
+    invalidate();
+    return *this;
+}
+
+ToolBar& ToolBar::addSeparator() {
+    tools.push_back(Tool{"", "", nullptr, false, false, false, true, nullptr, Image(), false});
+    invalidate();
+    return *this;
+}
+
+ToolBar& ToolBar::setToolSize(int size) {
+    toolSize = std::max(8, size);
+    height = toolSize + 8;
+    
+    // Icons are packed per size; look them up again at the new one
+    for (Tool& tool : tools) {
+        tool.region = nullptr;
+        tool.image = Image();
+        tool.iconResolved = false;
+    }
+    invalidate();
+    return *this;
+}
+
+ToolBar& ToolBar::setShowTooltips(bool show) {
+    showTooltips = show;
+    invalidate();
+    return *this;
+}
+
+int ToolBar::getToolAt(int localX) const {
+    int toolX = kToolSpacing;
+    for (size_t i = 0; i < tools.size(); ++i) {
+        int toolWidth = tools[i].separator ? kSeparatorWidth : toolSize;
+        if (localX >= toolX && localX < toolX + toolWidth) {
+            return tools[i].separator ? -1 : static_cast<int>(i);
+        }
+        toolX += toolWidth + kToolSpacing;
+    }
+    return -1;
+}
+
+void ToolBar::activate(size_t index) {
+    if (!enabled || index >= tools.size()) return;
+    
+    Tool& tool = tools[index];
+    if (tool.separator || !tool.enabled) return;
+    if (tool.toggle) tool.pressed = !tool.pressed;
+    if (tool.onClick) tool.onClick();
+    
+    Event event{EventType::Click, this, {{"tool", std::to_string(index)}}};
+    emit(event);
+}
+
+void ToolBar::render() {
+    if (!visible) return;
+    
+    const Style& style = getStyle();
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    drawRect(absX, absY, width, height, toSDLColor(style.backgroundColor));
+    drawRect(absX, absY + height - 1, width, 1, toSDLColor(style.borderColor));
+    
+    int hovered = hoveredTool < static_cast<int>(tools.size()) ? hoveredTool : -1;
+    int hoveredX = 0;
+    
+    int toolX = absX + kToolSpacing;
+    int toolY = absY + (height - toolSize) / 2;
+    int iconSize = toolSize - 8;
+    std::vector<IconAtlas::Draw> icons;
+    for (size_t i = 0; i < tools.size(); ++i) {
+        Tool& tool = tools[i];
+        if (tool.separator) {
+            drawRect(toolX + kSeparatorWidth / 2, toolY + 2, 1, toolSize - 4, toSDLColor(style.borderColor));
+            toolX += kSeparatorWidth + kToolSpacing;
+            continue;
+        }
+        
+        if (static_cast<int>(i) == hovered) {
+            hoveredX = toolX;
+        }
+        if (tool.pressed) {
+            drawRect(toolX, toolY, toolSize, toolSize, toSDLColor(style.pressedColor));
+        } else if (static_cast<int>(i) == hovered && tool.enabled) {
+            drawRect(toolX, toolY, toolSize, toolSize, toSDLColor(style.hoverColor));
+        }
+        
+        // Packed into the shared atlas and drawn in one batch below; icons the
+        // atlas cannot take get their own texture through the image cache
+        if (!tool.iconResolved && !tool.icon.empty()) {
+            tool.region = IconAtlas::shared().get(tool.icon, iconSize);
+            if (!tool.region) {
+                tool.image = ImageCache::request(g_context.renderer, tool.icon, iconSize, iconSize);
+            }
+            tool.iconResolved = true;
+        }
+        if (tool.region) {
+            icons.push_back(IconAtlas::Draw{tool.region, toolX + 4, toolY + 4});
+        } else if (!tool.icon.empty()) {
+            drawImage(tool.image, toolX + 4, toolY + 4, iconSize, iconSize);
+        }
+        
+        toolX += toolSize + kToolSpacing;
+    }
+    IconAtlas::shared().draw(g_context.renderer, icons);
+    
+    if (showTooltips && hovered >= 0 && !tools[hovered].tooltip.empty()) {
+        int textW, textH;
+        getTextSize(tools[hovered].tooltip, textW, textH);
+        // Anchored to the tool so moving within it needs no redraw
+        int tipX = hoveredX;
+        int tipY = absY + height + 2;
+        drawRect(tipX, tipY, textW + 8, textH + 4, SDL_Color{255, 255, 225, 255});
+        drawRect(tipX, tipY, textW + 8, textH + 4, toSDLColor(style.borderColor), false);
+        drawText(tools[hovered].tooltip, tipX + 4, tipY + 2, toSDLColor(style.foregroundColor));
+    }
+}
+
+bool ToolBar::handleEvent(const Event& event) {
+    if (event.type == EventType::MouseMove || event.type == EventType::MouseLeave) {
+        int index = -1;
+        if (event.type == EventType::MouseMove && isHovered()) {
+            int localY = event.getY() - getAbsoluteY();
+            index = localY >= 0 && localY < height ? getToolAt(event.getX() - getAbsoluteX()) : -1;
+        }
+        if (index == hoveredTool) return false;
+        hoveredTool = index;
+        return true;
+    }
+    
+    if (event.type != EventType::Click || event.data.find("x") == event.data.end()) return false;
+    
+    int index = getToolAt(event.getX() - getAbsoluteX());
+    if (index < 0) return false;
+    activate(static_cast<size_t>(index));
+    return true;
+}
+
+// MenuItem implementation
+MenuItem::MenuItem(const std::string& text, const std::string& id)
+    : text(text), id(id), enabled(true), checkable(false), checked(false) {}
+
+MenuItem& MenuItem::setText(const std::string& text) {
+    this->text = text;
+    return *this;
+}
+
+MenuItem& MenuItem::setShortcut(const std::string& shortcut) {
+    this->shortcut = shortcut;
+    return *this;
+}
+
+MenuItem& MenuItem::setIcon(const std::string& iconPath) {
+    icon = iconPath;
+    return *this;
+}
+
+MenuItem& MenuItem::setEnabled(bool enabled) {
+    this->enabled = enabled;
+    return *this;
+}
+
+MenuItem& MenuItem::setCheckable(bool checkable) {
+    this->checkable = checkable;
+    return *this;
+}
+
+MenuItem& MenuItem::setChecked(bool checked) {
+    this->checked = checked;
+    return *this;
+}
+
+MenuItem& MenuItem::setOnClick(std::function<void()> callback) {
+    onClick = std::move(callback);
+    return *this;
+}
+
+MenuItem& MenuItem::addSubItem(std::unique_ptr<MenuItem> item) {
+    subItems.push_back(std::move(item));
+    return *this;
+}
+
+void MenuItem::click() {
+    if (!enabled) return;
+    if (checkable) checked = !checked;
+    if (onClick) onClick();
+}
+
+// Menu implementation
+static const int kMenuIconSize = 16;
+
+Menu::Menu(const std::string& id) : Widget(id), highlightedIndex(-1) {
+    width = 180;
+    height = 4;
+    visible = false;
+}
+
+Menu& Menu::addItem(std::unique_ptr<MenuItem> item) {
+    items.push_back(std::move(item));
+    height = static_cast<int>(items.size()) * itemHeight() + 4;
+    return *this;
+}
+
+// Separators are items without text
+Menu& Menu::addSeparator() {
+    return addItem(std::make_unique<MenuItem>(""));
+}
+
+void Menu::show(int x, int y) {
+    int textWidth = 0;
+    for (const auto& item : items) {
+        int itemW, itemH, shortcutW = 0;
+        getTextSize(item->getText(), itemW, itemH);
+        if (!item->getShortcut().empty()) {
+            getTextSize(item->getShortcut(), shortcutW, itemH);
+            shortcutW += 24;
+        }
+        textWidth = std::max(textWidth, itemW + shortcutW);
+    }
+    
+    setPosition(x, y);
+    width = std::max(180, textWidth + kMenuIconSize + 24);
+    height = static_cast<int>(items.size()) * itemHeight() + 4;
+    highlightedIndex = -1;
+    visible = true;
+    invalidate();
+}
+
+void Menu::hide() {
+    visible = false;
+    highlightedIndex = -1;
+    invalidate();
+}
+
+int Menu::itemHeight() const {
+    int lineHeight = g_context.font ? TTF_FontLineSkip(g_context.font) : 16;
+    return std::max(lineHeight, kMenuIconSize) + 8;
+}
+
+void Menu::activate(size_t index) {
+    if (index >= items.size()) return;
+    
+    MenuItem& item = *items[index];
+    if (item.getText().empty() || !item.isEnabled()) return;
+    item.click();
+    hide();
+    
+    Event event{EventType::Click, this, {{"item", item.getId()}}};
+    emit(event);
+}
+
+void Menu::render() {
+    if (!visible) return;
+    
+    const Style& style = getStyle();
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    drawRect(absX, absY, width, height, toSDLColor(style.backgroundColor));
+    drawRect(absX, absY, width, height, toSDLColor(style.borderColor), false);
+    
+    int rowHeight = itemHeight();
+    std::vector<IconAtlas::Draw> icons;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const MenuItem& item = *items[i];
+        int rowY = absY + 2 + static_cast<int>(i) * rowHeight;
+        if (item.getText().empty()) {
+            drawRect(absX + 4, rowY + rowHeight / 2, width - 8, 1, toSDLColor(style.borderColor));
+            continue;
+        }
+        
+        if (static_cast<int>(i) == highlightedIndex && item.isEnabled()) {
+            drawRect(absX + 2, rowY, width - 4, rowHeight, toSDLColor(style.hoverColor));
+        }
+        
+        int iconX = absX + 6;
+        int iconY = rowY + (rowHeight - kMenuIconSize) / 2;
+        const IconAtlas::Region* icon = item.getIcon().empty() ? nullptr
+            : IconAtlas::shared().get(item.getIcon(), kMenuIconSize);
+        if (icon) {
+            icons.push_back(IconAtlas::Draw{icon, iconX, iconY});
+        }
+        if (item.isChecked()) {
+            // With an icon the check becomes a frame around it
+            if (icon) {
+                drawRect(iconX - 2, iconY - 2, kMenuIconSize + 4, kMenuIconSize + 4, toSDLColor(style.borderColor), false);
+            } else {
+                drawRect(iconX + 4, iconY + 4, kMenuIconSize - 8, kMenuIconSize - 8, toSDLColor(style.foregroundColor));
+            }
+        }
+        
+        SDL_Color color = item.isEnabled() ? toSDLColor(style.foregroundColor) : SDL_Color{150, 150, 150, 255};
+        int textW, textH;
+        getTextSize(item.getText(), textW, textH);
+        drawText(item.getText(), iconX + kMenuIconSize + 8, rowY + (rowHeight - textH) / 2, color);
+        if (!item.getShortcut().empty()) {
+            getTextSize(item.getShortcut(), textW, textH);
+            drawText(item.getShortcut(), absX + width - textW - 8, rowY + (rowHeight - textH) / 2, color);
+        }
+    }
+    IconAtlas::shared().draw(g_context.renderer, icons);
+}
+
+bool Menu::handleEvent(const Event& event) {
+    if (!visible || !enabled) return false;
+    
+    if (event.type == EventType::Click && event.data.find("y") != event.data.end()) {
+        int row = (event.getY() - getAbsoluteY() - 2) / itemHeight();
+        if (row < 0 || row >= static_cast<int>(items.size())) return false;
+        activate(static_cast<size_t>(row));
+        return true;
+    }
+    
+    // The highlight follows the pointer; only a row change needs a redraw
+    if (event.type == EventType::MouseMove) {
+        int localY = event.getY() - getAbsoluteY() - 2;
+        int row = localY >= 0 ? localY / itemHeight() : -1;
+        if (row < 0 || row >= static_cast<int>(items.size()) || row == highlightedIndex) return false;
+        if (items[row]->getText().empty() || !items[row]->isEnabled()) return false;
+        highlightedIndex = row;
+        return true;
+    }
+    
+    if (event.type != EventType::KeyPress) return false;
+    
+    std::string key = event.getKey();
+    int count = static_cast<int>(items.size());
+    if (key == "up" || key == "down") {
+        int step = key == "up" ? -1 : 1;
+        int index = highlightedIndex;
+        for (int tried = 0; tried < count; ++tried) {
+            index = ((index < 0 && step < 0 ? count : index) + step + count) % count;
+            if (!items[index]->getText().empty() && items[index]->isEnabled()) {
+                highlightedIndex = index;
+                break;
+            }
+        }
+    } else if (key == "enter") {
+        if (highlightedIndex >= 0) activate(static_cast<size_t>(highlightedIndex));
+    } else if (key == "escape") {
+        hide();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// TabControl implementation
+static const int kTabPadding = 12;
+static const int kTabCloseWidth = 16;
+
+static size_t countWidgets(const Widget& root) {
+    size_t count = 1;
+    for (const auto& child : root.getChildren()) {
+        count += countWidgets(*child);
+    }
+    return count;
+}
+
+TabControl::TabControl(const std::string& id)
+    : Widget(id), activeTabIndex(-1),
+      tabHeight(g_context.font ? std::max(1, TTF_FontLineSkip(g_context.font)) + 10 : 28),
+      evictionEnabled(false), evictionIdle(std::chrono::steady_clock::duration::zero()), evictionBudget(0) {
+    width = 400;
+    height = 300;
+}
+
+TabControl& TabControl::addTab(const std::string& title, std::unique_ptr<Widget> content, bool closable) {
+    Tab tab;
+    tab.title = title;
+    tab.content = std::move(content);
+    tab.closable = closable;
+    tab.stripWidth = -1;
+    tab.widgetCount = tab.content ? countWidgets(*tab.content) : 0;
+    tab.lastActive = std::chrono::steady_clock::now();
+    tabs.push_back(std::move(tab));
+    if (activeTabIndex < 0) setActiveTab(0);
+    invalidate();
+    return *this;
+}
+
+TabControl& TabControl::addLazyTab(const std::string& title, PageFactory factory, bool closable) {
+    Tab tab;
+    tab.title = title;
+    tab.factory = std::move(factory);
+    tab.closable = closable;
+    tab.stripWidth = -1;
+    tab.widgetCount = 0;
+    tab.lastActive = std::chrono::steady_clock::now();
+    tabs.push_back(std::move(tab));
+    if (activeTabIndex < 0) setActiveTab(0);
+    invalidate();
+    return *this;
+}
+
+TabControl& TabControl::removeTab(int index) {
+    if (index < 0 || index >= static_cast<int>(tabs.size())) return *this;
+    
+    if (index == activeTabIndex) {
+        children.clear();
+        tabs.erase(tabs.begin() + index);
+        activeTabIndex = -1;
+        if (!tabs.empty()) setActiveTab(std::min(index, static_cast<int>(tabs.size()) - 1));
+    } else {
+        tabs.erase(tabs.begin() + index);
+        if (index < activeTabIndex) --activeTabIndex;
+    }
+    invalidate();
+    return *this;
+}
+
+TabControl& TabControl::setActiveTab(int index) {
+    if (index < 0 || index >= static_cast<int>(tabs.size()) || index == activeTabIndex) return *this;
+    
+    // The outgoing page leaves the tree and is kept, built, on its tab
+    if (activeTabIndex >= 0 && !children.empty()) {
+        Tab& previous = tabs[activeTabIndex];
+        previous.content = std::move(children.back());
+        children.pop_back();
+        previous.widgetCount = countWidgets(*previous.content);
+        previous.lastActive = std::chrono::steady_clock::now();
+    }
+    
+    activeTabIndex = index;
+    showPage(index);
+    evictIdlePages();
+    invalidate();
+    return *this;
+}
+
+void TabControl::showPage(int index) {
+    Tab& tab = tabs[index];
+    if (!tab.content && tab.factory) {
+        GUI_PROFILE_WIDGET("build page", this);
+        tab.content = tab.factory();
+        if (tab.content && tab.snapshot.getWidgetCount() > 0) {
+            tab.snapshot.restoreWidget(*tab.content);
+        }
+        tab.snapshot = UILayout();
+    }
+    if (!tab.content) return;
+    
+    Widget* page = tab.content.get();
+    add(std::move(tab.content));
+    fitPage(page);
+}
+
+// Pages fill the area below the tab strip and are laid out when shown or resized
+void TabControl::fitPage(Widget* page) {
+    page->setPosition(0, tabHeight);
+    page->setSize(width, std::max(0, height - tabHeight));
+    WidgetType type = page->getType();
+    if (type == WidgetType::Container || type == WidgetType::Panel) {
+        static_cast<Container*>(page)->applyLayout();
+    }
+}
+
+TabControl& TabControl::setPageEviction(double idleSeconds, size_t widgetBudget) {
+    evictionEnabled = true;
+    evictionIdle = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(std::max(0.0, idleSeconds)));
+    evictionBudget = widgetBudget;
+    evictIdlePages();
+    return *this;
+}
+
+TabControl& TabControl::disablePageEviction() {
+    evictionEnabled = false;
+    return *this;
+}
+
+void TabControl::evictIdlePages() {
+    if (!evictionEnabled) return;
+    
+    size_t inactiveWidgets = 0;
+    for (const Tab& tab : tabs) {
+        if (tab.content) inactiveWidgets += tab.widgetCount;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    while (inactiveWidgets > evictionBudget) {
+        Tab* oldest = nullptr;
+        for (Tab& tab : tabs) {
+            if (!tab.content || !tab.factory || now - tab.lastActive < evictionIdle) continue;
+            if (!oldest || tab.lastActive < oldest->lastActive) oldest = &tab;
+        }
+        if (!oldest) break;
+        
+        oldest->snapshot = UILayout::captureWidget(*oldest->content);
+        oldest->content.reset();
+        inactiveWidgets -= oldest->widgetCount;
+    }
+}
+
+std::string TabControl::getTabTitle(int index) const {
+    return index >= 0 && index < static_cast<int>(tabs.size()) ? tabs[index].title : std::string();
+}
+
+Widget* TabControl::getPage(int index) const {
+    if (index < 0 || index >= static_cast<int>(tabs.size())) return nullptr;
+    if (index == activeTabIndex) return children.empty() ? nullptr : children.back().get();
+    return tabs[index].content.get();
+}
+
+size_t TabControl::getBuiltPageCount() const {
+    size_t count = children.empty() ? 0 : 1;
+    for (const Tab& tab : tabs) {
+        if (tab.content) ++count;
+    }
+    return count;
+}
+
+int TabControl::measureTab(size_t index) {
+    Tab& tab = tabs[index];
+    if (tab.stripWidth < 0) {
+        int textW = 0, textH = 0;
+        getTextSize(tab.title, textW, textH);
+        tab.stripWidth = textW + 2 * kTabPadding + (tab.closable ? kTabCloseWidth : 0);
+    }
+    return tab.stripWidth;
+}
+
+int TabControl::getTabAt(int localX) {
+    int tabX = 0;
+    for (size_t i = 0; i < tabs.size(); ++i) {
+        int tabWidth = measureTab(i);
+        if (localX >= tabX && localX < tabX + tabWidth) return static_cast<int>(i);
+        tabX += tabWidth;
+    }
+    return -1;
+}
+
+void TabControl::render() {
+    if (!visible) return;
+    
+    const Style& style = getStyle();
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    drawRect(absX, absY, width, tabHeight, toSDLColor(style.disabledColor));
+    int tabX = absX;
+    for (size_t i = 0; i < tabs.size() && tabX < absX + width; ++i) {
+        int tabWidth = measureTab(i);
+        bool active = static_cast<int>(i) == activeTabIndex;
+        drawRect(tabX, absY, tabWidth, tabHeight, toSDLColor(active ? style.backgroundColor : style.disabledColor));
+        drawRect(tabX, absY, tabWidth, tabHeight, toSDLColor(style.borderColor), false);
+        
+        int textW, textH;
+        getTextSize(tabs[i].title, textW, textH);
+        drawText(tabs[i].title, tabX + kTabPadding, absY + (tabHeight - textH) / 2, toSDLColor(style.foregroundColor));
+        if (tabs[i].closable) {
+            int closeX = tabX + tabWidth - kTabPadding / 2 - kTabCloseWidth;
+            drawText("x", closeX + kTabCloseWidth / 2 - 3, absY + (tabHeight - textH) / 2, toSDLColor(style.foregroundColor));
+        }
+        tabX += tabWidth;
+    }
+    
+    drawRect(absX, absY + tabHeight, width, height - tabHeight, toSDLColor(style.backgroundColor));
+    drawRect(absX, absY + tabHeight, width, height - tabHeight, toSDLColor(style.borderColor), false);
+    
+    // Only the active page is a child; it follows the control's size
+    if (!children.empty()) {
+        Widget* page = children.back().get();
+        if (page->getWidth() != width || page->getHeight() != std::max(0, height - tabHeight)) {
+            fitPage(page);
+        }
+        renderWidget(page);
+    }
+    
+    evictIdlePages();
+}
+
+bool TabControl::handleEvent(const Event& event) {
+    if (!enabled || event.type != EventType::Click || event.data.find("x") == event.data.end()) return false;
+    if (event.getY() - getAbsoluteY() >= tabHeight) return false;
+    
+    int localX = event.getX() - getAbsoluteX();
+    int index = getTabAt(localX);
+    if (index < 0) return false;
+    
+    int tabRight = 0;
+    for (int i = 0; i <= index; ++i) tabRight += measureTab(i);
+    if (tabs[index].closable && localX >= tabRight - kTabPadding / 2 - kTabCloseWidth) {
+        removeTab(index);
+    } else {
+        setActiveTab(index);
+    }
+    emit(Event{EventType::Click, this, {{"tab", std::to_string(activeTabIndex)}}});
+    return true;
+}
+
+// VerticalLayout implementation
+VerticalLayout::VerticalLayout(int spacing, int padding, bool stretch) 
+    : spacing(spacing), padding(padding), stretch(stretch) {}
+
+void VerticalLayout::apply(Widget* container) {
+    int currentY = padding;
+    
+    for (auto& child : container->getChildren()) {
+        child->setPosition(padding, currentY);
+        if (stretch) {
+            child->setSize(container->getWidth() - 2 * padding, child->getHeight());
+        }
+        currentY += child->getHeight() + spacing;
+    }
+}
+
+// HorizontalLayout implementation
+HorizontalLayout::HorizontalLayout(int spacing, int padding, bool stretch) 
+    : spacing(spacing), padding(padding), stretch(stretch) {}
+
+void HorizontalLayout::apply(Widget* container) {
+    int currentX = padding;
+    
+    for (auto& child : container->getChildren()) {
+        child->setPosition(currentX, padding);
+        if (stretch) {
+            child->setSize(child->getWidth(), container->getHeight() - 2 * padding);
+        }
+        currentX += child->getWidth() + spacing;
+    }
+}
+
+// SubtreeCache implementation
+struct SubtreeCacheState {
+    size_t budget = SubtreeCache::kDefaultBudget;
+    uint32_t promoteFrames = SubtreeCache::kDefaultPromoteFrames;
+    size_t promoteWidgets = SubtreeCache::kDefaultPromoteWidgets;
+    // Bumped by invalidateAll; textures drawn under an older epoch are redrawn
+    uint32_t epoch = 0;
+    
+    size_t textures = 0;
+    size_t promoted = 0;
+    size_t textureBytes = 0;
+    uint64_t hits = 0;
+    uint64_t redraws = 0;
+    uint64_t promotions = 0;
+    uint64_t demotions = 0;
+};
+
+static SubtreeCacheState g_subtreeCache;
+
+// A promoted subtree redrawn this many renders in a row goes back to direct drawing
+static constexpr uint32_t kDemoteRedraws = 3;
+
+void SubtreeCache::setBudget(size_t bytes) {
+    // Promoted textures over the new budget are dropped as their containers render
+    g_subtreeCache.budget = bytes;
+}
+
+size_t SubtreeCache::getBudget() {
+    return g_subtreeCache.budget;
+}
+
+void SubtreeCache::setPromotion(uint32_t frames, size_t minWidgets) {
+    g_subtreeCache.promoteFrames = frames;
+    g_subtreeCache.promoteWidgets = minWidgets;
+}
+
+void SubtreeCache::invalidateAll() {
+    ++g_subtreeCache.epoch;
+}
+
+SubtreeCache::Stats SubtreeCache::getStats() {
+    Stats stats{};
+    stats.textures = g_subtreeCache.textures;
+    stats.promoted = g_subtreeCache.promoted;
+    stats.textureBytes = g_subtreeCache.textureBytes;
+    stats.budgetBytes = g_subtreeCache.budget;
+    stats.hits = g_subtreeCache.hits;
+    stats.redraws = g_subtreeCache.redraws;
+    stats.promotions = g_subtreeCache.promotions;
+    stats.demotions = g_subtreeCache.demotions;
+    return stats;
+}
+
+void SubtreeCache::resetStats() {
+    g_subtreeCache.hits = 0;
+    g_subtreeCache.redraws = 0;
+    g_subtreeCache.promotions = 0;
+    g_subtreeCache.demotions = 0;
+}
+
+std::string SubtreeCache::formatStats() {
+    const SubtreeCacheState& state = g_subtreeCache;
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer),
+                  "cached subtrees  %8zu (%zu promoted)\n"
+                  "texture memory   %8zu KB of %zu KB\n"
+                  "blits            %8llu\n"
+                  "redraws          %8llu\n"
+                  "promotions       %8llu (%llu demoted)\n",
+                  state.textures, state.promoted, state.textureBytes >> 10, state.budget >> 10,
+                  static_cast<unsigned long long>(state.hits),
+                  static_cast<unsigned long long>(state.redraws),
+                  static_cast<unsigned long long>(state.promotions),
+                  static_cast<unsigned long long>(state.demotions));
+    return buffer;
+}
+
+// Container implementation
+struct Container::TextureCache {
+    SDL_Texture* texture = nullptr;
+    SDL_Renderer* renderer = nullptr;
+    int width = 0;
+    int height = 0;
+    uint32_t epoch = 0;
+    uint64_t themeGeneration = 0;
+    bool promoted = false;
+    uint32_t redrawRun = 0;   // consecutive renders that had to redraw
+};
+
+// Children draw blended onto a transparent target, which leaves the texture
+// premultiplied; plain blending would darken their antialiased edges
+static SDL_BlendMode premultipliedBlendMode() {
+    static const SDL_BlendMode mode = SDL_ComposeCustomBlendMode(
+        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+    return mode;
+}
+
+Container::Container(const std::string& id) : Widget(id), stableFrames(0) {}
+
+Container::~Container() {
+    releaseTextureCache();
+}
+
+Container& Container::setCacheAsTexture(bool cache) {
+    if (cache && !textureCache) {
+        textureCache = std::make_unique<TextureCache>();
+    } else if (cache && textureCache->promoted) {
+        // The heuristic's texture becomes the container's own
+        if (textureCache->texture) g_subtreeCache.promoted--;
+        textureCache->promoted = false;
+    } else if (!cache && textureCache && !textureCache->promoted) {
+        releaseTextureCache();
+    }
+    invalidate();
+    return *this;
+}
+
+void Container::releaseTextureCache() {
+    if (!textureCache) return;
+    
+    if (textureCache->texture) {
+        SDL_DestroyTexture(textureCache->texture);
+        g_subtreeCache.textures--;
+        g_subtreeCache.textureBytes -= static_cast<size_t>(textureCache->width) * textureCache->height * 4;
+        if (textureCache->promoted) g_subtreeCache.promoted--;
+    }
+    textureCache.reset();
+}
+
+Container& Container::setLayout(std::unique_ptr<Layout> layout) {
+    this->layout = std::move(layout);
+    applyLayout();
+    invalidate();
+    return *this;
+}
+
+void Container::applyLayout() {
+    if (layout) {
+        GUI_PROFILE_WIDGET("layout", this);
+        layout->apply(this);
+    }
+}
+
+bool Container::handleEvent(const Event&) {
+    return false;
+}
+
+void Container::render() {
+    if (!visible) return;
+    
+    // Absolute position, as the render traversal left it
+    int absX = renderX;
+    int absY = renderY;
+    
+    bool changed = dirty;
+    dirty = false;
+    stableFrames = changed ? 0 : stableFrames + 1;
+    
+    // Promote a subtree that keeps rendering unchanged; the count restarts
+    // either way, so a rejected candidate is only measured again later.
+    // Display lists are recorded widget by widget, without subtree textures.
+    if (g_context.recording) {
+        stableFrames = 0;
+    } else if (!textureCache && g_subtreeCache.promoteFrames > 0 && stableFrames >= g_subtreeCache.promoteFrames) {
+        stableFrames = 0;
+        size_t bytes = static_cast<size_t>(std::max(width, 0)) * std::max(height, 0) * 4;
+        if (g_subtreeCache.textureBytes + bytes <= g_subtreeCache.budget &&
+            countWidgets(*this) > g_subtreeCache.promoteWidgets) {
+            textureCache = std::make_unique<TextureCache>();
+            textureCache->promoted = true;
+            g_subtreeCache.promotions++;
+        }
+    }
+    
+    if (textureCache && !g_context.recording && renderCached(absX, absY, changed)) return;
+    
+    // Optionally draw container background
+    // drawRect(absX, absY, width, height, {250, 250, 250, 255});
+    
+    // Render children, clipped to the container
+    pushClip({absX, absY, width, height});
+    for (auto& child : children) {
+        renderWidget(child.get());
+    }
+    popClip();
+}
+
+// Blits the subtree's texture, redrawing it first if anything below changed.
+// Returns false when the children have to be drawn directly instead.
+bool Container::renderCached(int absX, int absY, bool changed) {
+    SDL_Renderer* renderer = g_context.renderer;
+    TextureCache& cache = *textureCache;
+    
+    if (cache.promoted) {
+        cache.redrawRun = changed ? cache.redrawRun + 1 : 0;
+        if (cache.redrawRun >= kDemoteRedraws || g_subtreeCache.textureBytes > g_subtreeCache.budget) {
+            releaseTextureCache();
+            g_subtreeCache.demotions++;
+            return false;
+        }
+    }
+    if (!renderer || width <= 0 || height <= 0 || !SDL_RenderTargetSupported(renderer)) return false;
+    
+    if (cache.texture && (cache.renderer != renderer || cache.width != width || cache.height != height)) {
+        SDL_DestroyTexture(cache.texture);
+        cache.texture = nullptr;
+        g_subtreeCache.textures--;
+        g_subtreeCache.textureBytes -= static_cast<size_t>(cache.width) * cache.height * 4;
+        if (cache.promoted) g_subtreeCache.promoted--;
+    }
+    
+    bool redraw = changed || cache.epoch != g_subtreeCache.epoch || cache.themeGeneration != g_theme.generation;
+    if (!cache.texture) {
+        cache.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+        if (!cache.texture) return false;
+        if (SDL_SetTextureBlendMode(cache.texture, premultipliedBlendMode()) != 0) {
+            // Renderers without custom blend modes (the software one) could only
+            // blit the texture with darkened edges, so the subtree is drawn directly
+            SDL_DestroyTexture(cache.texture);
+            cache.texture = nullptr;
+            releaseTextureCache();
+            return false;
+        }
+        cache.renderer = renderer;
+        cache.width = width;
+        cache.height = height;
+        g_subtreeCache.textures++;
+        g_subtreeCache.textureBytes += static_cast<size_t>(width) * height * 4;
+        if (cache.promoted) g_subtreeCache.promoted++;
+        redraw = true;
+    }
+    
+    if (redraw) {
+        GUI_PROFILE_WIDGET("cache subtree", this);
+        // Nested cached containers draw into their own target from in here
+        SDL_Texture* previousTarget = SDL_GetRenderTarget(renderer);
+        SDL_Rect previousViewport;
+        SDL_RenderGetViewport(renderer, &previousViewport);
+        
+        SDL_SetRenderTarget(renderer, cache.texture);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        SDL_RenderClear(renderer);
+        // Offset the viewport so children keep drawing in window coordinates
+        SDL_Rect viewport = {-absX, -absY, absX + width, absY + height};
+        SDL_RenderSetViewport(renderer, &viewport);
+        
+        // The whole subtree goes into the texture, even the parts the
+        // enclosing clip rects hide right now
+        std::vector<SDL_Rect> outerClips;
+        outerClips.swap(g_context.clipStack);
+        pushClip({absX, absY, width, height});
+        for (auto& child : children) {
+            renderWidget(child.get());
+        }
+        g_context.clipStack.swap(outerClips);
+        
+        SDL_SetRenderTarget(renderer, previousTarget);
+        SDL_RenderSetViewport(renderer, &previousViewport);
+        applyClip();
+        cache.epoch = g_subtreeCache.epoch;
+        cache.themeGeneration = g_theme.generation;
+        g_subtreeCache.redraws++;
+    } else {
+        g_subtreeCache.hits++;
+    }
+    
+    SDL_Rect dest = {absX, absY, width, height};
+    SDL_RenderCopy(renderer, cache.texture, nullptr, &dest);
+    return true;
+}
+
+// UILayout implementation
+
+// Binary layout, native byte order (byteOrder rejects the other endianness):
+// header, one record per widget in depth-first order, string offsets
+// (stringCount + 1 entries) and the string bytes. String 0 is always empty.
+// Version 2 added captured widget state.
+static const char kLayoutFileMagic[8] = {'G', 'U', 'I', 'L', 'A', 'Y', 'O', 'T'};
+static const uint32_t kLayoutFileVersion = 2;
+static const uint32_t kLayoutFileByteOrder = 0x01020304;
+
+struct LayoutFileHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t stringCount;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+enum LayoutKind : uint8_t {
+    LayoutNone,
+    LayoutVertical,
+    LayoutHorizontal
+};
+
+enum LayoutNodeFlags : uint16_t {
+    NodeHidden = 1 << 0,
+    NodeDisabled = 1 << 1,
+    NodeHasX = 1 << 2,
+    NodeHasY = 1 << 3,
+    NodeHasWidth = 1 << 4,
+    NodeHasHeight = 1 << 5,
+    NodeReadOnly = 1 << 6,
+    NodePassword = 1 << 7,
+    NodeStretch = 1 << 8,
+    NodeItems = 1 << 9,         // text holds newline-separated ListBox items
+    NodeHasState = 1 << 10,     // state[] and selection were captured from a live widget
+    NodeMultiSelect = 1 << 11,
+    NodeMappedSource = 1 << 12, // text is the path of a TextView's or ListBox's mapped file
+    NodeNoWrap = 1 << 13,
+    NodeFixedSize = 1 << 14     // Label without autosize
+};
+
+struct LayoutRecord {
+    uint8_t type;          // WidgetType
+    uint8_t layout;        // LayoutKind
+    uint16_t flags;
+    uint32_t childCount;   // direct children, which follow in depth-first order
+    uint32_t id;           // string indices
+    uint32_t text;
+    uint32_t placeholder;
+    uint32_t selection;    // ListBox selected indices, packed int32
+    int32_t x, y, width, height;
+    int32_t spacing, padding;
+    // With NodeHasState: TextInput cursor, selection start, end and max length;
+    // TextArea cursor line, column and scrollY; TextView top line and row;
+    // ListBox selected index and scroll offset
+    int32_t state[4];
+};
+
+static_assert(sizeof(LayoutFileHeader) == 32, "layout header layout");
+static_assert(sizeof(LayoutRecord) == 64, "layout record layout");
+
+// Widget types the loader can build, with their storage size for reservation
+static size_t layoutWidgetSize(WidgetType type) {
+    switch (type) {
+        case WidgetType::Container: return sizeof(Container);
+        case WidgetType::Button: return sizeof(Button);
+        case WidgetType::Label: return sizeof(Label);
+        case WidgetType::TextInput: return sizeof(TextInput);
+        case WidgetType::TextArea: return sizeof(TextArea);
+        case WidgetType::TextView: return sizeof(TextView);
+        case WidgetType::ListBox: return sizeof(ListBox);
+        default: return 0;
+    }
+}
+
+// Records and an interned string table on their way into a UILayout
+class LayoutBuilder {
+public:
+    std::vector<LayoutRecord> records;
+    std::vector<std::string> strings;
+    
+    LayoutBuilder() {
+        intern("");
+    }
+    
+    uint32_t intern(const std::string& text) {
+        auto inserted = interned.try_emplace(text, static_cast<uint32_t>(strings.size()));
+        if (inserted.second) strings.push_back(text);
+        return inserted.first->second;
+    }
+    
+    void write(std::vector<char>& data) const {
+        LayoutFileHeader header{};
+        std::memcpy(header.magic, kLayoutFileMagic, sizeof(header.magic));
+        header.byteOrder = kLayoutFileByteOrder;
+        header.version = kLayoutFileVersion;
+        header.recordCount = static_cast<uint32_t>(records.size());
+        header.stringCount = static_cast<uint32_t>(strings.size());
+        
+        std::vector<uint32_t> offsets;
+        offsets.reserve(strings.size() + 1);
+        uint32_t offset = 0;
+        for (const std::string& text : strings) {
+            offsets.push_back(offset);
+            offset += static_cast<uint32_t>(text.size());
+        }
+        offsets.push_back(offset);
+        header.stringBytes = offset;
+        
+        size_t recordBytes = records.size() * sizeof(LayoutRecord);
+        data.resize(sizeof(header) + recordBytes + offsets.size() * sizeof(uint32_t) + offset);
+        char* out = data.data();
+        std::memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        if (recordBytes) std::memcpy(out, records.data(), recordBytes);
+        out += recordBytes;
+        std::memcpy(out, offsets.data(), offsets.size() * sizeof(uint32_t));
+        out += offsets.size() * sizeof(uint32_t);
+        for (const std::string& text : strings) {
+            std::memcpy(out, text.data(), text.size());
+            out += text.size();
+        }
+    }
+    
+private:
+    std::unordered_map<std::string, uint32_t> interned;
+};
+
+// Single-pass JSON reader that emits records as it goes
+class LayoutCompiler : public LayoutBuilder {
+public:
+    explicit LayoutCompiler(const std::string& json)
+        : begin(json.data()), p(json.data()), end(json.data() + json.size()) {}
+    
+    void compile() {
+        skipSpace();
+        if (consume('[')) {
+            if (!consume(']')) {
+                do {
+                    parseNode();
+                } while (consume(','));
+                expect(']');
+            }
+        } else {
+            parseNode();
+        }
+        if (p != end) fail("unexpected trailing characters");
+    }
+    
+private:
+    const char* begin;
+    const char* p;
+    const char* end;
+    
+    [[noreturn]] void fail(const std::string& message) const {
+        int line = 1 + static_cast<int>(std::count(begin, p, '\n'));
+        throw std::runtime_error("Failed to parse layout: line " + std::to_string(line) + ": " + message);
+    }
+    
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    }
+    
+    bool consume(char c) {
+        skipSpace();
+        if (p < end && *p == c) {
+            ++p;
+            skipSpace();
+            return true;
+        }
+        return false;
+    }
+    
+    void expect(char c) {
+        if (!consume(c)) fail(std::string("expected '") + c + "'");
+    }
+    
+    static void appendUtf8(std::string& out, uint32_t codepoint) {
+        if (codepoint < 0x80) {
+            out += static_cast<char>(codepoint);
+        } else if (codepoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codepoint >> 6));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else if (codepoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codepoint >> 12));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (codepoint >> 18));
+            out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+    }
+    
+    uint32_t parseHex4() {
+        if (end - p < 4) fail("truncated \\u escape");
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i, ++p) {
+            char c = *p;
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else fail("bad \\u escape");
+        }
+        return value;
+    }
+    
+    std::string parseString() {
+        skipSpace();
+        if (p >= end || *p != '"') fail("expected a string");
+        ++p;
+        std::string text;
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                text += *p++;
+                continue;
+            }
+            if (++p >= end) break;
+            char escape = *p++;
+            switch (escape) {
+                case '"': case '\\': case '/': text += escape; break;
+                case 'b': text += '\b'; break;
+                case 'f': text += '\f'; break;
+                case 'n': text += '\n'; break;
+                case 'r': text += '\r'; break;
+                case 't': text += '\t'; break;
+                case 'u': {
+                    uint32_t codepoint = parseHex4();
+                    if (codepoint >= 0xD800 && codepoint < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        p += 2;
+                        uint32_t low = parseHex4();
+                        if (low < 0xDC00 || low >= 0xE000) fail("unpaired surrogate");
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(text, codepoint);
+                    break;
+                }
+                default: fail(std::string("bad escape '\\") + escape + "'");
+            }
+        }
+        if (p >= end) fail("unterminated string");
+        ++p;
+        skipSpace();
+        return text;
+    }
+    
+    int32_t parseInt() {
+        skipSpace();
+        char* numberEnd = nullptr;
+        errno = 0;
+        long long value = std::strtoll(p, &numberEnd, 10);
+        if (numberEnd == p || errno == ERANGE || value < std::numeric_limits<int32_t>::min() ||
+            value > std::numeric_limits<int32_t>::max()) {
+            fail("expected an integer");
+        }
+        p = numberEnd;
+        skipSpace();
+        return static_cast<int32_t>(value);
+    }
+    
+    bool parseBool() {
+        skipSpace();
+        if (end - p >= 4 && std::strncmp(p, "true", 4) == 0) {
+            p += 4;
+        } else if (end - p >= 5 && std::strncmp(p, "false", 5) == 0) {
+            p += 5;
+            skipSpace();
+            return false;
+        } else {
+            fail("expected true or false");
+        }
+        skipSpace();
+        return true;
+    }
+    
+    void parseLayout(size_t index) {
+        LayoutRecord& record = records[index];
+        record.layout = LayoutVertical;
+        record.spacing = 10;
+        record.padding = 10;
+        expect('{');
+        if (consume('}')) return;
+        do {
+            std::string key = parseString();
+            expect(':');
+            if (key == "type") {
+                std::string kind = parseString();
+                if (kind == "vertical") record.layout = LayoutVertical;
+                else if (kind == "horizontal") record.layout = LayoutHorizontal;
+                else fail("unknown layout \"" + kind + "\"");
+            } else if (key == "spacing") {
+                record.spacing = parseInt();
+            } else if (key == "padding") {
+                record.padding = parseInt();
+            } else if (key == "stretch") {
+                if (parseBool()) record.flags |= NodeStretch;
+            } else {
+                fail("unknown layout key \"" + key + "\"");
+            }
+        } while (consume(','));
+        expect('}');
+    }
+    
+    void parseNode() {
+        // Children are appended while this node is open, so it is addressed by index
+        size_t index = records.size();
+        records.push_back(LayoutRecord{});
+        bool typed = false;
+        
+        expect('{');
+        if (!consume('}')) {
+            do {
+                std::string key = parseString();
+                expect(':');
+                if (key == "type") {
+                    std::string name = parseString();
+                    WidgetType type;
+                    if (!widgetTypeFromName(name, type) || layoutWidgetSize(type) == 0) {
+                        fail("unsupported widget type \"" + name + "\"");
+                    }
+                    records[index].type = static_cast<uint8_t>(type);
+                    typed = true;
+                } else if (key == "id") {
+                    records[index].id = intern(parseString());
+                } else if (key == "text") {
+                    records[index].text = intern(parseString());
+                } else if (key == "placeholder") {
+                    records[index].placeholder = intern(parseString());
+                } else if (key == "items") {
+                    std::string items;
+                    bool firstItem = true;
+                    expect('[');
+                    if (!consume(']')) {
+                        do {
+                            if (!firstItem) items += '\n';
+                            items += parseString();
+                            firstItem = false;
+                        } while (consume(','));
+                        expect(']');
+                    }
+                    records[index].text = intern(items);
+                    records[index].flags |= NodeItems;
+                } else if (key == "x") {
+                    records[index].x = parseInt();
+                    records[index].flags |= NodeHasX;
+                } else if (key == "y") {
+                    records[index].y = parseInt();
+                    records[index].flags |= NodeHasY;
+                } else if (key == "width") {
+                    records[index].width = parseInt();
+                    records[index].flags |= NodeHasWidth;
+                } else if (key == "height") {
+                    records[index].height = parseInt();
+                    records[index].flags |= NodeHasHeight;
+                } else if (key == "visible") {
+                    if (!parseBool()) records[index].flags |= NodeHidden;
+                } else if (key == "enabled") {
+                    if (!parseBool()) records[index].flags |= NodeDisabled;
+                } else if (key == "readOnly") {
+                    if (parseBool()) records[index].flags |= NodeReadOnly;
+                } else if (key == "password") {
+                    if (parseBool()) records[index].flags |= NodePassword;
+                } else if (key == "layout") {
+                    parseLayout(index);
+                } else if (key == "children") {
+                    expect('[');
+                    if (!consume(']')) {
+                        do {
+                            parseNode();
+                            ++records[index].childCount;
+                        } while (consume(','));
+                        expect(']');
+                    }
+                } else {
+                    fail("unknown key \"" + key + "\"");
+                }
+            } while (consume(','));
+            expect('}');
+        }
+        
+        const LayoutRecord& record = records[index];
+        WidgetType type = static_cast<WidgetType>(record.type);
+        if (!typed) fail("widget without a type");
+        if (record.layout != LayoutNone && type != WidgetType::Container) fail("layout on a non-container widget");
+        if ((record.flags & NodeItems) && type != WidgetType::ListBox) fail("items on a widget that is not a ListBox");
+    }
+};
+
+UILayout UILayout::compile(const std::string& json) {
+    LayoutCompiler compiler(json);
+    compiler.compile();
+    
+    UILayout layout;
+    compiler.write(layout.data);
+    layout.index();
+    return layout;
+}
+
+// Newline-joined lines of a source, the form items and text are stored in
+static std::string joinSourceLines(const TextSource& source) {
+    std::string text;
+    for (size_t line = 0; line < source.getLineCount(); ++line) {
+        if (line > 0) text += '\n';
+        text += source.getLine(line);
+    }
+    return text;
+}
+
+UILayout UILayout::capture(const Widget& parent) {
+    std::vector<const Widget*> roots;
+    roots.reserve(parent.children.size());
+    for (const auto& child : parent.children) {
+        roots.push_back(child.get());
+    }
+    return captureRoots(roots);
+}
+
+UILayout UILayout::captureWidget(const Widget& widget) {
+    return captureRoots({&widget});
+}
+
+UILayout UILayout::captureRoots(const std::vector<const Widget*>& roots) {
+    LayoutBuilder builder;
+    
+    // Depth-first; children are pushed in reverse so records come out in tree order
+    struct Pending {
+        const Widget* widget;
+        size_t parentRecord;
+    };
+    const size_t kNoRecord = std::numeric_limits<size_t>::max();
+    std::vector<Pending> pending;
+    for (auto it = roots.rbegin(); it != roots.rend(); ++it) {
+        pending.push_back({*it, kNoRecord});
+    }
+    
+    while (!pending.empty()) {
+        Pending next = pending.back();
+        pending.pop_back();
+        const Widget& widget = *next.widget;
+        WidgetType type = widget.getType();
+        if (layoutWidgetSize(type) == 0) continue;
+        
+        LayoutRecord record{};
+        record.type = static_cast<uint8_t>(type);
+        record.flags = NodeHasX | NodeHasY | NodeHasWidth | NodeHasHeight | NodeHasState;
+        if (!widget.visible) record.flags |= NodeHidden;
+        if (!widget.enabled) record.flags |= NodeDisabled;
+        record.id = builder.intern(widget.id);
+        record.x = widget.x;
+        record.y = widget.y;
+        record.width = widget.width;
+        record.height = widget.height;
+        
+        switch (type) {
+            case WidgetType::Container: {
+                const Layout* layout = static_cast<const Container&>(widget).layout.get();
+                if (auto* vertical = dynamic_cast<const VerticalLayout*>(layout)) {
+                    record.layout = LayoutVertical;
+                    record.spacing = vertical->getSpacing();
+                    record.padding = vertical->getPadding();
+                    if (vertical->getStretch()) record.flags |= NodeStretch;
+                } else if (auto* horizontal = dynamic_cast<const HorizontalLayout*>(layout)) {
+                    record.layout = LayoutHorizontal;
+                    record.spacing = horizontal->getSpacing();
+                    record.padding = horizontal->getPadding();
+                    if (horizontal->getStretch()) record.flags |= NodeStretch;
+                }
+                break;
+            }
+            case WidgetType::Button:
+                record.text = builder.intern(static_cast<const Button&>(widget).text);
+                break;
+            case WidgetType::Label: {
+                const Label& label = static_cast<const Label&>(widget);
+                record.text = builder.intern(label.text);
+                if (!label.autoSize) record.flags |= NodeFixedSize;
+                break;
+            }
+            case WidgetType::TextInput: {
+                const TextInput& input = static_cast<const TextInput&>(widget);
+                record.text = builder.intern(input.text.text());
+                record.placeholder = builder.intern(input.placeholder);
+                if (input.password) record.flags |= NodePassword;
+                record.state[0] = static_cast<int32_t>(input.cursorPosition);
+                record.state[1] = static_cast<int32_t>(input.selectionStart);
+                record.state[2] = static_cast<int32_t>(input.selectionEnd);
+                record.state[3] = input.maxLength;
+                break;
+            }
+            case WidgetType::TextArea: {
+                const TextArea& area = static_cast<const TextArea&>(widget);
+                record.text = builder.intern(area.getText());
+                if (area.readOnly) record.flags |= NodeReadOnly;
+                record.state[0] = static_cast<int32_t>(area.cursorLine);
+                record.state[1] = static_cast<int32_t>(area.cursorColumn);
+                record.state[2] = area.scrollY;
+                break;
+            }
+            case WidgetType::TextView: {
+                const TextView& view = static_cast<const TextView&>(widget);
+                if (auto* mapped = dynamic_cast<const MappedFileSource*>(view.source.get())) {
+                    record.text = builder.intern(mapped->getPath());
+                    record.flags |= NodeMappedSource;
+                } else if (view.source) {
+                    record.text = builder.intern(joinSourceLines(*view.source));
+                }
+                if (!view.wordWrap) record.flags |= NodeNoWrap;
+                record.state[0] = static_cast<int32_t>(view.topLine);
+                record.state[1] = static_cast<int32_t>(view.topRow);
+                break;
+            }
+            case WidgetType::ListBox: {
+                const ListBox& list = static_cast<const ListBox&>(widget);
+                // A source-backed list is not copied item by item; a mapped file
+                // is recorded by path and any other source is left to the caller
+                if (auto* mapped = dynamic_cast<const MappedFileSource*>(list.source.get())) {
+                    record.text = builder.intern(mapped->getPath());
+                    record.flags |= NodeMappedSource;
+                } else if (!list.source && list.getItemCount() > 0) {
+                    std::string items;
+                    for (size_t i = 0; i < list.getItemCount(); ++i) {
+                        if (i > 0) items += '\n';
+                        items += list.getItem(i);
+                    }
+                    record.text = builder.intern(items);
+                    record.flags |= NodeItems;
+                }
+                if (list.multiSelect) record.flags |= NodeMultiSelect;
+                record.selection = builder.intern(std::string(reinterpret_cast<const char*>(list.selectedIndices.data()),
+                                                              list.selectedIndices.size() * sizeof(int)));
+                record.state[0] = list.selectedIndex;
+                record.state[1] = list.scrollOffset;
+                break;
+            }
+            default:
+                break;
+        }
+        
+        size_t index = builder.records.size();
+        builder.records.push_back(record);
+        if (next.parentRecord != kNoRecord) ++builder.records[next.parentRecord].childCount;
+        for (auto it = widget.children.rbegin(); it != widget.children.rend(); ++it) {
+            pending.push_back({it->get(), index});
+        }
+    }
+    
+    UILayout layout;
+    builder.write(layout.data);
+    layout.index();
+    return layout;
+}
+
+// Validates the buffer and materializes the string table
+bool UILayout::index() {
+    strings.clear();
+    if (data.size() < sizeof(LayoutFileHeader)) return false;
+    
+    const LayoutFileHeader& header = *reinterpret_cast<const LayoutFileHeader*>(data.data());
+    uint64_t recordsEnd = sizeof(header) + uint64_t(header.recordCount) * sizeof(LayoutRecord);
+    uint64_t offsetsEnd = recordsEnd + (uint64_t(header.stringCount) + 1) * sizeof(uint32_t);
+    if (std::memcmp(header.magic, kLayoutFileMagic, sizeof(header.magic)) != 0 ||
+        header.byteOrder != kLayoutFileByteOrder || header.version != kLayoutFileVersion ||
+        header.stringCount == 0 || offsetsEnd + header.stringBytes != data.size()) {
+        return false;
+    }
+    
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data.data() + recordsEnd);
+    const char* bytes = data.data() + offsetsEnd;
+    if (offsets[header.stringCount] != header.stringBytes) return false;
+    strings.reserve(header.stringCount);
+    for (uint32_t i = 0; i < header.stringCount; ++i) {
+        if (offsets[i] > offsets[i + 1]) return false;
+        strings.emplace_back(bytes + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    
+    // Every record must be a buildable widget and the child counts must describe one forest;
+    // layouts and items are held to the same types the compiler accepts them on
+    const LayoutRecord* records = reinterpret_cast<const LayoutRecord*>(data.data() + sizeof(header));
+    std::vector<uint32_t> open;
+    for (uint32_t i = 0; i < header.recordCount; ++i) {
+        const LayoutRecord& record = records[i];
+        WidgetType type = static_cast<WidgetType>(record.type);
+        if (record.type >= static_cast<uint8_t>(WidgetType::Count) ||
+            layoutWidgetSize(type) == 0 || record.layout > LayoutHorizontal ||
+            (record.layout != LayoutNone && type != WidgetType::Container) ||
+            ((record.flags & NodeItems) && type != WidgetType::ListBox) ||
+            record.id >= header.stringCount || record.text >= header.stringCount ||
+            record.placeholder >= header.stringCount || record.selection >= header.stringCount) {
+            strings.clear();
+            return false;
+        }
+        while (!open.empty() && open.back() == 0) open.pop_back();
+        if (!open.empty()) --open.back();
+        if (record.childCount) open.push_back(record.childCount);
+    }
+    while (!open.empty() && open.back() == 0) open.pop_back();
+    if (!open.empty()) {
+        strings.clear();
+        return false;
+    }
+    return true;
+}
+
+bool UILayout::load(const std::string& file) {
+    std::ifstream in(file, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    
+    std::streamoff size = in.tellg();
+    in.seekg(0);
+    data.resize(static_cast<size_t>(std::max<std::streamoff>(size, 0)));
+    if (!in.read(data.data(), static_cast<std::streamsize>(data.size())) || !index()) {
+        data.clear();
+        strings.clear();
+        return false;
+    }
+    return true;
+}
+
+bool UILayout::save(const std::string& file) const {
+    if (data.empty()) return false;
+    std::ofstream out(file, std::ios::binary);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+size_t UILayout::getWidgetCount() const {
+    return data.empty() ? 0 : reinterpret_cast<const LayoutFileHeader*>(data.data())->recordCount;
+}
+
+static std::vector<std::string> splitLines(const std::string& text) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    for (size_t newline; (newline = text.find('\n', start)) != std::string::npos; start = newline + 1) {
+        lines.push_back(text.substr(start, newline - start));
+    }
+    lines.push_back(text.substr(start));
+    return lines;
+}
+
+// Geometry, flags, text and any captured state; written directly rather
+// than through setters with side effects
+// The mapped file at path, keeping current when it already maps that file. A
+// log that has gone away yields null, leaving the widget empty rather than
+// failing the restore.
+static std::shared_ptr<TextSource> mappedSource(const std::string& path, const std::shared_ptr<TextSource>& current) {
+    auto* mapped = dynamic_cast<const MappedFileSource*>(current.get());
+    if (mapped && mapped->getPath() == path) return current;
+    try {
+        return std::make_shared<MappedFileSource>(path);
+    } catch (const std::runtime_error&) {
+        return nullptr;
+    }
+}
+
+void UILayout::applyRecord(const LayoutRecord& record, Widget& widget) const {
+    uint16_t flags = record.flags;
+    if (flags & NodeHasX) widget.x = record.x;
+    if (flags & NodeHasY) widget.y = record.y;
+    if (flags & NodeHasWidth) widget.width = record.width;
+    if (flags & NodeHasHeight) widget.height = record.height;
+    widget.visible = !(flags & NodeHidden);
+    widget.enabled = !(flags & NodeDisabled);
+    
+    const std::string& text = strings[record.text];
+    bool restore = (flags & NodeHasState) != 0;
+    switch (static_cast<WidgetType>(record.type)) {
+        case WidgetType::Button:
+            static_cast<Button&>(widget).text = text;
+            break;
+        case WidgetType::Label: {
+            Label& label = static_cast<Label&>(widget);
+            label.text = text;
+            label.autoSize = !(flags & NodeFixedSize);
+            break;
+        }
+        case WidgetType::TextInput: {
+            TextInput& input = static_cast<TextInput&>(widget);
+            input.placeholder = strings[record.placeholder];
+            input.password = (flags & NodePassword) != 0;
+            input.text.assign(text);
+            input.clusters.invalidate();
+            size_t length = input.text.size();
+            if (restore) {
+                input.cursorPosition = std::min<size_t>(static_cast<uint32_t>(record.state[0]), length);
+                input.selectionStart = std::min<size_t>(static_cast<uint32_t>(record.state[1]), length);
+                input.selectionEnd = std::min<size_t>(static_cast<uint32_t>(record.state[2]), length);
+                input.maxLength = std::max(0, record.state[3]);
+            } else {
+                input.cursorPosition = input.selectionStart = input.selectionEnd = length;
+            }
+            break;
+        }
+        case WidgetType::TextArea: {
+            TextArea& area = static_cast<TextArea&>(widget);
+            if (restore || !text.empty()) area.setText(text);
+            area.readOnly = (flags & NodeReadOnly) != 0;
+            if (restore) {
+                area.cursorLine = std::min<size_t>(static_cast<uint32_t>(record.state[0]), area.lines.size() - 1);
+                area.cursorColumn = std::min<size_t>(static_cast<uint32_t>(record.state[1]),
+                                                     area.lines[area.cursorLine].text.size());
+                area.scrollY = std::max(0, record.state[2]);
+            }
+            break;
+        }
+        case WidgetType::TextView: {
+            TextView& view = static_cast<TextView&>(widget);
+            if (flags & NodeMappedSource) {
+                std::shared_ptr<TextSource> source = mappedSource(text, view.source);
+                if (source != view.source) view.setSource(std::move(source));
+            } else if (restore || !text.empty()) {
+                view.setText(text);
+            }
+            view.wordWrap = !(flags & NodeNoWrap);
+            if (restore && view.getLineCount() > 0) {
+                view.topLine = std::min<size_t>(static_cast<uint32_t>(record.state[0]), view.getLineCount() - 1);
+                view.topRow = static_cast<uint32_t>(record.state[1]);
+            }
+            break;
+        }
+        case WidgetType::ListBox: {
+            ListBox& list = static_cast<ListBox&>(widget);
+            if (flags & NodeMappedSource) {
+                std::shared_ptr<TextSource> source = mappedSource(text, list.source);
+                if (source != list.source) list.setSource(std::move(source));
+            } else if ((flags & NodeItems) && !list.source) {
+                list.items = text.empty() ? std::vector<std::string>() : splitLines(text);
+            }
+            list.multiSelect = (flags & NodeMultiSelect) != 0;
+            if (restore) {
+                int count = static_cast<int>(list.getItemCount());
+                const std::string& selection = strings[record.selection];
+                list.selectedIndices.clear();
+                for (size_t offset = 0; offset + sizeof(int) <= selection.size(); offset += sizeof(int)) {
+                    int index;
+                    std::memcpy(&index, selection.data() + offset, sizeof(int));
+                    if (index >= 0 && index < count) list.selectedIndices.push_back(index);
+                }
+                list.selectedIndex = record.state[0] >= 0 && record.state[0] < count ? record.state[0] : -1;
+                list.scrollOffset = std::max(0, std::min(record.state[1], count));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    // The fields above are written directly, so cached ancestors are told here
+    widget.invalidate();
+}
+
+Widget* UILayout::instantiate(Widget& parent) const {
+    if (data.empty()) return nullptr;
+    GUI_PROFILE_SCOPE("UILayout::instantiate");
+    
+    const LayoutFileHeader& header = *reinterpret_cast<const LayoutFileHeader*>(data.data());
+    const LayoutRecord* records = reinterpret_cast<const LayoutRecord*>(data.data() + sizeof(header));
+    
+    // Storage for the whole tree up front: one arena for the widgets, then handle slots
+    size_t arenaBytes = 0;
+    for (uint32_t i = 0; i < header.recordCount; ++i) {
+        arenaBytes += widgetArenaStride(layoutWidgetSize(static_cast<WidgetType>(records[i].type)));
+    }
+    size_t newSlots = header.recordCount > g_freeWidgetSlots.size() ? header.recordCount - g_freeWidgetSlots.size() : 0;
+    g_widgetSlots.reserve(g_widgetSlots.size() + newSlots);
+    g_widgetGenerations.reserve(g_widgetGenerations.size() + newSlots);
+    
+    // Widgets with a known size skip text measurement
+    auto create = [this](const LayoutRecord& record) -> std::unique_ptr<Widget> {
+        const std::string& id = strings[record.id];
+        const std::string& text = strings[record.text];
+        bool sized = (record.flags & NodeHasWidth) && (record.flags & NodeHasHeight);
+        switch (static_cast<WidgetType>(record.type)) {
+            case WidgetType::Button: return std::make_unique<Button>(sized ? std::string() : text, id);
+            case WidgetType::Label: return std::make_unique<Label>(sized ? std::string() : text, id);
+            case WidgetType::TextInput: return std::make_unique<TextInput>(strings[record.placeholder], id);
+            case WidgetType::TextArea: return std::make_unique<TextArea>(id);
+            case WidgetType::TextView: return std::make_unique<TextView>(id);
+            case WidgetType::ListBox: return std::make_unique<ListBox>(id);
+            default: return std::make_unique<Container>(id);
+        }
+    };
+    
+    struct OpenNode {
+        Widget* widget;
+        uint32_t remaining;
+    };
+    std::vector<OpenNode> open{{&parent, std::numeric_limits<uint32_t>::max()}};
+    std::vector<Container*> containers;
+    Widget* first = nullptr;
+    
+    // Widgets created below are carved from the arena; the last one destroyed frees it
+    struct ArenaScope {
+        WidgetArena* arena;
+        WidgetArena* previous;
+        ~ArenaScope() {
+            t_widgetArena = previous;
+            releaseWidgetArena(arena);
+        }
+    } arenaScope{openWidgetArena(arenaBytes), t_widgetArena};
+    t_widgetArena = arenaScope.arena;
+    
+    for (uint32_t i = 0; i < header.recordCount; ++i) {
+        const LayoutRecord& record = records[i];
+        while (open.back().remaining == 0) open.pop_back();
+        
+        std::unique_ptr<Widget> widget = create(record);
+        Widget* raw = widget.get();
+        applyRecord(record, *raw);
+        if (record.childCount) raw->children.reserve(record.childCount);
+        
+        // Layouts are installed without applying them; that happens once below
+        if (record.layout != LayoutNone) {
+            Container* container = static_cast<Container*>(raw);
+            bool stretch = (record.flags & NodeStretch) != 0;
+            if (record.layout == LayoutVertical) {
+                container->layout = std::make_unique<VerticalLayout>(record.spacing, record.padding, stretch);
+            } else {
+                container->layout = std::make_unique<HorizontalLayout>(record.spacing, record.padding, stretch);
+            }
+            containers.push_back(container);
+        }
+        
+        OpenNode& target = open.back();
+        --target.remaining;
+        target.widget->add(std::move(widget));
+        if (!first) first = raw;
+        if (record.childCount) open.push_back({raw, record.childCount});
+    }
+    
+    // Parents come first, so sizes stretched by a parent's layout are final
+    // before the children are laid out
+    for (Container* container : containers) {
+        container->applyLayout();
+    }
+    return first;
+}
+
+bool UILayout::restore(Widget& parent) const {
+    std::vector<Widget*> roots;
+    roots.reserve(parent.children.size());
+    for (const auto& child : parent.children) {
+        roots.push_back(child.get());
+    }
+    return restoreRoots(roots);
+}
+
+bool UILayout::restoreWidget(Widget& widget) const {
+    return restoreRoots({&widget});
+}
+
+// Walks the tree in capture order, skipping the same widgets capture skips
+bool UILayout::restoreRoots(const std::vector<Widget*>& roots) const {
+    if (data.empty()) return false;
+    GUI_PROFILE_SCOPE("UILayout::restore");
+    
+    const LayoutFileHeader& header = *reinterpret_cast<const LayoutFileHeader*>(data.data());
+    const LayoutRecord* records = reinterpret_cast<const LayoutRecord*>(data.data() + sizeof(header));
+    std::vector<Widget*> pending(roots.rbegin(), roots.rend());
+    uint32_t next = 0;
+    
+    while (!pending.empty() && next < header.recordCount) {
+        Widget& widget = *pending.back();
+        pending.pop_back();
+        WidgetType type = widget.getType();
+        if (layoutWidgetSize(type) == 0) continue;
+        
+        const LayoutRecord& record = records[next++];
+        if (record.type != static_cast<uint8_t>(type)) return false;
+        applyRecord(record, widget);
+        for (auto it = widget.children.rbegin(); it != widget.children.rend(); ++it) {
+            pending.push_back(it->get());
+        }
+    }
+    return next == header.recordCount;
+}
+
+// InputPipeline implementation
+struct InputState {
+    InputPipeline::Stats stats{};
+    bool keepHistory = false;
+    std::vector<InputPipeline::MotionSample> history;   // folded into the MouseMove being delivered
+    std::vector<InputPipeline::MotionSample> pending;   // since the last MouseMove
+    int frameRate = 0;       // requested; 0 follows the display
+    int displayRate = 60;    // refresh rate of the first window's display
+};
+
+static InputState g_input;
+
+static std::chrono::steady_clock::duration frameInterval() {
+    int fps = g_input.frameRate > 0 ? g_input.frameRate : g_input.displayRate;
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / fps));
+}
+
+void InputPipeline::setMotionHistory(bool enabled) {
+    g_input.keepHistory = enabled;
+    if (!enabled) {
+        g_input.history.clear();
+        g_input.pending.clear();
+    }
+}
+
+const std::vector<InputPipeline::MotionSample>& InputPipeline::getMotionHistory() {
+    return g_input.history;
+}
+
+void InputPipeline::setFrameRate(int fps) {
+    g_input.frameRate = std::max(0, fps);
+}
+
+int InputPipeline::getFrameRate() {
+    return g_input.frameRate > 0 ? g_input.frameRate : g_input.displayRate;
+}
+
+InputPipeline::Stats InputPipeline::getStats() {
+    return g_input.stats;
+}
+
+void InputPipeline::resetStats() {
+    g_input.stats = {};
+}
+
+std::string InputPipeline::formatStats() {
+    const Stats& stats = g_input.stats;
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer),
+                  "events received  %8zu\n"
+                  "  motion         %8zu -> %zu delivered\n"
+                  "  text           %8zu -> %zu delivered\n"
+                  "hover changes    %8zu\n"
+                  "events routed    %8zu (%zu handleEvent calls)\n"
+                  "render requests  %8zu\n"
+                  "frames rendered  %8zu (%d fps cap)\n",
+                  stats.eventsReceived, stats.motionReceived, stats.motionDelivered,
+                  stats.textReceived, stats.textDelivered, stats.hoverTransitions,
+                  stats.eventsRouted, stats.dispatches, stats.renderRequests,
+                  stats.framesRendered, getFrameRate());
+    return buffer;
+}
+
+// Window implementation
+
+// Display list rasterizer. Runs on render workers: it only reads the list and
+// the surfaces it references and writes the frame surface, all ARGB8888.
+static uint32_t* surfaceRow(SDL_Surface* surface, int y) {
+    return reinterpret_cast<uint32_t*>(static_cast<unsigned char*>(surface->pixels) + y * surface->pitch);
+}
+
+// Fills and lines replace pixels, as the renderer's default draw blend mode does
+static uint32_t packPixel(const SDL_Color& color) {
+    return (uint32_t(color.a) << 24) | (uint32_t(color.r) << 16) | (uint32_t(color.g) << 8) | color.b;
+}
+
+// SDL_BLENDMODE_BLEND with the color and alpha modulation applied to source
+static uint32_t blendPixel(uint32_t source, uint32_t dest, const SDL_Color& modulation) {
+    uint32_t alpha = (source >> 24) * modulation.a / 255;
+    if (alpha == 0) return dest;
+    
+    uint32_t red = ((source >> 16) & 0xFF) * modulation.r / 255;
+    uint32_t green = ((source >> 8) & 0xFF) * modulation.g / 255;
+    uint32_t blue = (source & 0xFF) * modulation.b / 255;
+    if (alpha == 255) return 0xFF000000u | (red << 16) | (green << 8) | blue;
+    
+    uint32_t inverse = 255 - alpha;
+    red = (red * alpha + ((dest >> 16) & 0xFF) * inverse) / 255;
+    green = (green * alpha + ((dest >> 8) & 0xFF) * inverse) / 255;
+    blue = (blue * alpha + (dest & 0xFF) * inverse) / 255;
+    uint32_t destAlpha = alpha + (dest >> 24) * inverse / 255;
+    return (destAlpha << 24) | (red << 16) | (green << 8) | blue;
+}
+
+static void fillArea(SDL_Surface* target, const SDL_Rect& rect, const SDL_Rect& clip, uint32_t pixel) {
+    SDL_Rect area;
+    if (!SDL_IntersectRect(&rect, &clip, &area)) return;
+    for (int y = area.y; y < area.y + area.h; ++y) {
+        std::fill_n(surfaceRow(target, y) + area.x, area.w, pixel);
+    }
+}
+
+// Bresenham, end points included like SDL_RenderDrawLine
+static void strokeLine(SDL_Surface* target, const SDL_Rect& line, const SDL_Rect& clip, uint32_t pixel) {
+    int x = line.x;
+    int y = line.y;
+    int dx = std::abs(line.w - x);
+    int dy = -std::abs(line.h - y);
+    int stepX = x < line.w ? 1 : -1;
+    int stepY = y < line.h ? 1 : -1;
+    int error = dx + dy;
+    for (;;) {
+        if (x >= clip.x && x < clip.x + clip.w && y >= clip.y && y < clip.y + clip.h) {
+            surfaceRow(target, y)[x] = pixel;
+        }
+        if (x == line.w && y == line.h) break;
+        int doubled = 2 * error;
+        if (doubled >= dy) {
+            error += dy;
+            x += stepX;
+        }
+        if (doubled <= dx) {
+            error += dx;
+            y += stepY;
+        }
+    }
+}
+
+// Scaled with the nearest source pixel, which the renderer also uses by default
+static void blitArea(SDL_Surface* target, const DisplayCommand& blit, const SDL_Rect& clip) {
+    SDL_Rect area;
+    if (!SDL_IntersectRect(&blit.rect, &clip, &area)) return;
+    
+    const SDL_Rect& dest = blit.rect;
+    const SDL_Rect& source = blit.source;
+    for (int y = area.y; y < area.y + area.h; ++y) {
+        int sourceY = source.y + static_cast<int>((int64_t(y - dest.y) * 2 + 1) * source.h / (int64_t(dest.h) * 2));
+        const uint32_t* from = surfaceRow(blit.surface, sourceY);
+        uint32_t* to = surfaceRow(target, y);
+        if (source.w == dest.w) {
+            from += source.x + (area.x - dest.x);
+            to += area.x;
+            for (int x = 0; x < area.w; ++x) {
+                to[x] = blendPixel(from[x], to[x], blit.color);
+            }
+            continue;
+        }
+        for (int x = area.x; x < area.x + area.w; ++x) {
+            int sourceX = source.x + static_cast<int>((int64_t(x - dest.x) * 2 + 1) * source.w / (int64_t(dest.w) * 2));
+            to[x] = blendPixel(from[sourceX], to[x], blit.color);
+        }
+    }
+}
+
+static void rasterizeDisplayList(const DisplayList& list, SDL_Surface* target) {
+    const SDL_Rect bounds = {0, 0, target->w, target->h};
+    SDL_Rect clip = bounds;
+    for (const DisplayCommand& command : list.commands) {
+        const SDL_Rect& rect = command.rect;
+        switch (command.kind) {
+            case DisplayCommand::Clip:
+                if (rect.w < 0) {
+                    clip = bounds;
+                } else if (!SDL_IntersectRect(&rect, &bounds, &clip)) {
+                    clip = {0, 0, 0, 0};
+                }
+                break;
+            case DisplayCommand::Fill:
+                fillArea(target, rect, clip, packPixel(command.color));
+                break;
+            case DisplayCommand::Outline:
+                if (rect.w <= 0 || rect.h <= 0) break;
+                fillArea(target, {rect.x, rect.y, rect.w, 1}, clip, packPixel(command.color));
+                fillArea(target, {rect.x, rect.y + rect.h - 1, rect.w, 1}, clip, packPixel(command.color));
+                fillArea(target, {rect.x, rect.y, 1, rect.h}, clip, packPixel(command.color));
+                fillArea(target, {rect.x + rect.w - 1, rect.y, 1, rect.h}, clip, packPixel(command.color));
+                break;
+            case DisplayCommand::Line:
+                if (clip.w > 0 && clip.h > 0) strokeLine(target, rect, clip, packPixel(command.color));
+                break;
+            case DisplayCommand::Blit:
+                blitArea(target, command, clip);
+                break;
+        }
+    }
+}
+
+static void renderWorkerLoop() {
+    RenderWorkerState& state = g_renderWorkers;
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while (true) {
+        state.wake.wait(lock, [&state] { return state.stopping || state.nextJob < state.jobs.size(); });
+        if (state.stopping) return;
+        
+        size_t index = state.nextJob++;
+        lock.unlock();
+        state.jobs[index]();
+        lock.lock();
+        if (++state.finishedJobs == state.jobs.size()) {
+            state.done.notify_one();
+        }
+    }
+}
+
+// Runs the jobs on the render workers and the calling thread, returning when all are done
+static void runRenderJobs(std::vector<std::function<void()>> jobs) {
+    RenderWorkerState& state = g_renderWorkers;
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    size_t wanted = std::min(jobs.size(), hardware) - 1;
+    while (state.threads.size() < wanted) {
+        state.threads.emplace_back(renderWorkerLoop);
+    }
+    
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.jobs = std::move(jobs);
+    state.nextJob = 0;
+    state.finishedJobs = 0;
+    state.wake.notify_all();
+    
+    while (state.nextJob < state.jobs.size()) {
+        size_t index = state.nextJob++;
+        lock.unlock();
+        state.jobs[index]();
+        lock.lock();
+        ++state.finishedJobs;
+    }
+    state.done.wait(lock, [&state] { return state.finishedJobs == state.jobs.size(); });
+    state.jobs.clear();
+}
+
+// What a window's display list is rasterized into, uploaded through a
+// streaming texture of its renderer
+struct Window::FrameTarget {
+    DisplayList list;
+    SDL_Surface* surface = nullptr;
+    SDL_Texture* texture = nullptr;
+    double recordMs = 0;
+    
+    ~FrameTarget() {
+        list.reset();
+        release();
+    }
+    
+    void release() {
+        if (texture) SDL_DestroyTexture(texture);
+        if (surface) SDL_FreeSurface(surface);
+        texture = nullptr;
+        surface = nullptr;
+    }
+};
+
+// Routes the drawing helpers into a display list for one frame
+class RecordingScope {
+public:
+    explicit RecordingScope(DisplayList& list) {
+        list.reset();
+        g_context.recording = &list;
+    }
+    
+    ~RecordingScope() { g_context.recording = nullptr; }
+    
+    RecordingScope(const RecordingScope&) = delete;
+    RecordingScope& operator=(const RecordingScope&) = delete;
+};
+
+void Window::setParallelRendering(bool enabled) {
+    if (enabled == g_renderWorkers.enabled) return;
+    g_renderWorkers.enabled = enabled;
+    if (enabled) return;
+    
+    // Subtree textures missed the frames recorded meanwhile, and nothing
+    // needs the kept pixels or frame surfaces any more
+    SubtreeCache::invalidateAll();
+    releaseTexturePixels(nullptr);
+    for (Window* window : windows) {
+        window->frameTarget.reset();
+    }
+}
+
+bool Window::isParallelRendering() {
+    return g_renderWorkers.enabled;
+}
+
+double Window::getParallelScaling() {
+    if (g_renderWorkers.parallelFrames == 0) return 0;
+    return g_renderWorkers.scalingTotal / g_renderWorkers.parallelFrames;
+}
+
+Window::Window(const std::string& title, int width, int height) 
+    : Widget("window"), title(title), running(false), resizable(false), fullscreen(false),
+      sdlWindow(nullptr), sdlRenderer(nullptr), needsRender(false), pointerDown(false),
+      frameStats{} {
+    setSize(width, height);
+    
+    // Initialize SDL if needed
+    initSDL();
+    
+    // Created now, hidden, so this overlaps the font loader rather than
+    // waiting behind the first text measurement of the widget tree. Only a
+    // window that exists is registered; a throwing constructor runs no destructor.
+    createNativeWindow();
+    windows.push_back(this);
+}
+
+Window::~Window() {
+    windows.erase(std::remove(windows.begin(), windows.end(), this), windows.end());
+    
+    // Children may hold textures of this renderer
+    children.clear();
+    
+    if (sdlRenderer) {
+        ImageCache::releaseRenderer(sdlRenderer);
+        IconAtlas::shared().releaseRenderer(sdlRenderer);
+        GlyphCache::releaseRenderer(sdlRenderer);
+        releaseTexturePixels(sdlRenderer);
+        frameTarget.reset();
+        if (g_context.renderer == sdlRenderer) {
+            g_context.renderer = nullptr;
+        }
+        SDL_DestroyRenderer(sdlRenderer);
+        sdlRenderer = nullptr;
+    }
+    
+    if (sdlWindow) {
+        SDL_DestroyWindow(sdlWindow);
+        sdlWindow = nullptr;
+    }
+    
+    if (windows.empty() && g_sdlInitialized) {
+        // The loader may still be running for a window closed before its first frame
+        joinFontLoader();
+        FontManager::releaseAll();
+        g_context.font = nullptr;
+        TTF_Quit();
+        SDL_Quit();
+        g_sdlInitialized = false;
+    }
+}
+
+Window& Window::setTitle(const std::string& title) {
+    this->title = title;
+    if (sdlWindow) {
+        SDL_SetWindowTitle(sdlWindow, title.c_str());
+    }
+    return *this;
+}
+
+void Window::createNativeWindow() {
+    auto start = std::chrono::steady_clock::now();
+    sdlWindow = SDL_CreateWindow(
+        title.c_str(),
+        SDL_WINDOWPOS_CENTERED,
+        SDL_WINDOWPOS_CENTERED,
+        width, height,
+        SDL_WINDOW_HIDDEN
+    );
+    
+    if (!sdlWindow) {
+        throw std::runtime_error("Failed to create window: " + std::string(SDL_GetError()));
+    }
+    
+    sdlRenderer = SDL_CreateRenderer(sdlWindow, -1, SDL_RENDERER_ACCELERATED);
+    if (!sdlRenderer) {
+        // Headless and dummy video drivers only provide the software renderer
+        sdlRenderer = SDL_CreateRenderer(sdlWindow, -1, SDL_RENDERER_SOFTWARE);
+    }
+    if (!sdlRenderer) {
+        std::string error = SDL_GetError();
+        SDL_DestroyWindow(sdlWindow);
+        sdlWindow = nullptr;
+        throw std::runtime_error("Failed to create renderer: " + error);
+    }
+    
+    // Frames are paced to the display rather than blocking in a vsynced present
+    SDL_DisplayMode mode;
+    if (SDL_GetWindowDisplayMode(sdlWindow, &mode) == 0 && mode.refresh_rate > 0) {
+        g_input.displayRate = mode.refresh_rate;
+    }
+    if (!g_startup.report.firstFrameDone) {
+        g_startup.report.windowCreateMs += millisecondsSince(start);
+    }
+}
+
+void Window::show() {
+    // The size may have changed since the constructor created the window
+    int shownWidth = 0;
+    int shownHeight = 0;
+    SDL_GetWindowSize(sdlWindow, &shownWidth, &shownHeight);
+    if (shownWidth != width || shownHeight != height) {
+        SDL_SetWindowSize(sdlWindow, width, height);
+    }
+    SDL_ShowWindow(sdlWindow);
+    
+    running = true;
+    makeCurrent();
+    render();
+}
+
+void Window::makeCurrent() {
+    g_context.renderer = sdlRenderer;
+}
+
+// One handleEvent call during routing, counted for InputPipeline::Stats
+static bool deliverEvent(Widget* widget, Event& event, EventPhase phase) {
+    event.phase = phase;
+    g_input.stats.dispatches++;
+    return dispatchToWidget(widget, event);
+}
+
+// Capture phase, outermost ancestor first; the recursion keeps the path off the heap
+static Widget* captureEvent(Widget* widget, Event& event) {
+    if (!widget) return nullptr;
+    if (Widget* handler = captureEvent(widget->getParent(), event)) return handler;
+    return deliverEvent(widget, event, EventPhase::Capture) ? widget : nullptr;
+}
+
+void Window::setPointerCapture(Widget* widget) {
+    // Both widgets draw their pressed state from the capture
+    if (Widget* previous = pointerCapture.get()) previous->invalidate();
+    pointerCapture = widget ? widget->getHandle() : WidgetHandle();
+    if (widget) widget->invalidate();
+}
+
+// Moves the hover path to end at target (null when the pointer left the
+// window). Only widgets that leave or join the path get events and are
+// invalidated; returns true if the path changed.
+bool Window::updateHover(Widget* target) {
+    std::vector<Widget*> path;
+    for (Widget* widget = target; widget && widget != this; widget = widget->parent) {
+        path.push_back(widget);
+    }
+    std::reverse(path.begin(), path.end());
+    
+    size_t common = 0;
+    while (common < hoverPath.size() && common < path.size() && hoverPath[common].get() == path[common]) {
+        ++common;
+    }
+    if (common == hoverPath.size() && common == path.size()) return false;
+    
+    for (size_t i = hoverPath.size(); i-- > common;) {
+        Widget* widget = hoverPath[i].get();
+        if (!widget) continue;
+        
+        widget->hovered = false;
+        widget->invalidate();
+        Event leaveEvent{EventType::MouseLeave, widget, {}};
+        if (!deliverEvent(widget, leaveEvent, EventPhase::Target)) {
+            widget->emit(leaveEvent);
+        }
+        g_input.stats.hoverTransitions++;
+    }
+    
+    hoverPath.resize(common);
+    for (size_t i = common; i < path.size(); ++i) {
+        Widget* widget = path[i];
+        widget->hovered = true;
+        widget->invalidate();
+        hoverPath.push_back(widget->getHandle());
+        Event enterEvent{EventType::MouseEnter, widget, {}};
+        if (!deliverEvent(widget, enterEvent, EventPhase::Target)) {
+            widget->emit(enterEvent);
+        }
+        g_input.stats.hoverTransitions++;
+    }
+    return true;
+}
+
+void Window::close() {
+    running = false;
+    Event event{EventType::WindowClose, this, {}};
+    emit(event);
+}
+
+void Window::invalidate() {
+    needsRender = true;
+    g_input.stats.renderRequests++;
+}
+
+void Window::render() {
+    if (!sdlRenderer) return;
+    if (g_renderWorkers.enabled) {
+        renderDisplayLists({this});
+        return;
+    }
+    
+    beginFrame();
+    drawFrame();
+    {
+        GUI_PROFILE_SCOPE("present");
+        SDL_RenderPresent(sdlRenderer);
+    }
+    frameStats.rasterMs = 0;
+    endFrame(millisecondsSince(lastRender));
+}
+
+void Window::beginFrame() {
+    makeCurrent();
+    finishStartup();
+    needsRender = false;
+    lastRender = std::chrono::steady_clock::now();
+    g_input.stats.framesRendered++;
+}
+
+// Draws the whole window with the renderer, or into the display list being recorded
+void Window::drawFrame() {
+    GUI_PROFILE_WIDGET("Window::render", this);
+    
+    // Clear screen
+    const Color& background = getStyle().backgroundColor;
+    if (g_context.recording) {
+        recordCommand(DisplayCommand::Fill, toSDLColor(background), SDL_Rect{0, 0, width, height});
+    } else {
+        SDL_SetRenderDrawColor(g_context.renderer, background.r, background.g, background.b, background.a);
+        SDL_RenderClear(g_context.renderer);
+    }
+    
+    // Render all children; whatever lies outside the window is culled
+    updateRenderOrigin();
+    g_context.widgetsDrawn = 0;
+    g_context.widgetsCulled = 0;
+    g_context.clipStack.clear();
+    pushClip({0, 0, width, height});
+    for (auto& child : children) {
+        renderWidget(child.get());
+    }
+    popClip();
+    frameStats.widgetsDrawn = g_context.widgetsDrawn;
+    frameStats.widgetsCulled = g_context.widgetsCulled;
+    
+    if (Profiler::isOverlayVisible()) {
+        drawProfilerOverlay(width);
+    }
+}
+
+void Window::endFrame(double frameMs) {
+    frameStats.lastMs = frameMs;
+    frameStats.frames++;
+    frameStats.averageMs += (frameStats.lastMs - frameStats.averageMs) / frameStats.frames;
+    
+    if (!g_startup.report.firstFrameDone) {
+        g_startup.report.firstFrameMs = millisecondsSince(g_startup.processStart);
+        g_startup.report.firstFrameDone = true;
+    }
+    
+    Profiler::endFrame();
+}
+
+// Records the windows' display lists on the UI thread, rasterizes them on the
+// render workers with the UI thread helping, then uploads and presents each
+// window. A window's frame time covers its own recording, rasterization and
+// present, not the time spent waiting for the others.
+void Window::renderDisplayLists(const std::vector<Window*>& due) {
+    std::vector<Window*> recorded;
+    for (Window* window : due) {
+        if (!window->sdlRenderer) continue;
+        window->beginFrame();
+        
+        if (!window->frameTarget) {
+            window->frameTarget = std::make_unique<FrameTarget>();
+        }
+        FrameTarget& target = *window->frameTarget;
+        if (target.surface && (target.surface->w != window->width || target.surface->h != window->height)) {
+            target.release();
+        }
+        if (!target.surface && window->width > 0 && window->height > 0) {
+            target.surface = SDL_CreateRGBSurfaceWithFormat(0, window->width, window->height, 32, SDL_PIXELFORMAT_ARGB8888);
+            target.texture = SDL_CreateTexture(window->sdlRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                               window->width, window->height);
+            if (target.texture) SDL_SetTextureBlendMode(target.texture, SDL_BLENDMODE_NONE);
+        }
+        if (!target.surface || !target.texture) {
+            // Nothing to rasterize into, so this frame is drawn directly
+            target.release();
+            window->drawFrame();
+            SDL_RenderPresent(window->sdlRenderer);
+            window->frameStats.rasterMs = 0;
+            window->endFrame(millisecondsSince(window->lastRender));
+            continue;
+        }
+        
+        {
+            RecordingScope recording(target.list);
+            window->drawFrame();
+        }
+        target.recordMs = millisecondsSince(window->lastRender);
+        recorded.push_back(window);
+    }
+    if (recorded.empty()) return;
+    
+    std::vector<std::function<void()>> jobs;
+    for (Window* window : recorded) {
+        jobs.push_back([window] {
+            auto start = std::chrono::steady_clock::now();
+            rasterizeDisplayList(window->frameTarget->list, window->frameTarget->surface);
+            window->frameStats.rasterMs = millisecondsSince(start);
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    runRenderJobs(std::move(jobs));
+    double wallMs = millisecondsSince(start);
+    
+    double rasterMs = 0;
+    for (Window* window : recorded) {
+        FrameTarget& target = *window->frameTarget;
+        auto presentStart = std::chrono::steady_clock::now();
+        {
+            GUI_PROFILE_SCOPE("present");
+            SDL_UpdateTexture(target.texture, nullptr, target.surface->pixels, target.surface->pitch);
+            SDL_RenderCopy(window->sdlRenderer, target.texture, nullptr, nullptr);
+            SDL_RenderPresent(window->sdlRenderer);
+        }
+        target.list.reset();
+        rasterMs += window->frameStats.rasterMs;
+        window->endFrame(target.recordMs + window->frameStats.rasterMs + millisecondsSince(presentStart));
+    }
+    if (recorded.size() > 1 && wallMs > 0) {
+        g_renderWorkers.scalingTotal += rasterMs / wallMs;
+        g_renderWorkers.parallelFrames++;
+    }
+}
+
+void Window::runEventLoop() {
+    g_eventLoopRunning = true;
+    
+    while (g_eventLoopRunning) {
+        processEvents();
+        
+        // Wake for input or the next frame slot; background image loads are polled at ~60 Hz
+        int timeout = getRenderWaitTimeout();
+        if (timeout < 0 || timeout > 16) {
+            timeout = 16;
+        }
+        SDL_WaitEventTimeout(nullptr, timeout);
+    }
+}
+
+void Window::renderPending() {
+    auto now = std::chrono::steady_clock::now();
+    auto interval = frameInterval();
+    std::vector<Window*> due;
+    for (Window* window : windows) {
+        if (window->running && window->needsRender && now - window->lastRender >= interval) {
+            due.push_back(window);
+        }
+    }
+    
+    // Due windows are rasterized together, so they present in the same pass
+    if (g_renderWorkers.enabled) {
+        if (!due.empty()) renderDisplayLists(due);
+        return;
+    }
+    for (Window* window : due) {
+        window->render();
+    }
+}
+
+int Window::getRenderWaitTimeout() {
+    auto now = std::chrono::steady_clock::now();
+    auto interval = frameInterval();
+    int timeout = -1;
+    for (Window* window : windows) {
+        if (!window->running || !window->needsRender) continue;
+        
+        auto due = window->lastRender + interval;
+        int wait = due <= now ? 0 : static_cast<int>(
+            std::chrono::ceil<std::chrono::milliseconds>(due - now).count());
+        if (timeout < 0 || wait < timeout) {
+            timeout = wait;
+        }
+    }
+    return timeout;
+}
+
+// Names for the editing keys delivered to widgets as KeyPress events
+static const char* keyName(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_RETURN: return "enter";
+        case SDLK_BACKSPACE: return "backspace";
+        case SDLK_DELETE: return "delete";
+        case SDLK_LEFT: return "left";
+        case SDLK_RIGHT: return "right";
+        case SDLK_UP: return "up";
+        case SDLK_DOWN: return "down";
+        case SDLK_HOME: return "home";
+        case SDLK_END: return "end";
+        case SDLK_PAGEUP: return "pageup";
+        case SDLK_PAGEDOWN: return "pagedown";
+        case SDLK_TAB: return "tab";
+        case SDLK_ESCAPE: return "escape";
+        default: return nullptr;
+    }
+}
+
+bool Window::dispatchEvent(Event& event) {
+    Widget* target = event.source;
+    if (!target) return false;
+    g_input.stats.eventsRouted++;
+    
+    Widget* handler = captureEvent(target->parent, event);
+    if (!handler && deliverEvent(target, event, EventPhase::Target)) {
+        handler = target;
+    }
+    for (Widget* ancestor = target->parent; !handler && ancestor; ancestor = ancestor->parent) {
+        if (deliverEvent(ancestor, event, EventPhase::Bubble)) {
+            handler = ancestor;
+        }
+    }
+    
+    if (handler) {
+        handler->invalidate();
+        return true;
+    }
+    event.phase = EventPhase::Target;
+    target->emit(event);
+    return false;
+}
+
+void Window::setFocus(Widget* widget) {
+    Widget* previous = focusedWidget.get();
+    if (previous == widget) return;
+    
+    focusedWidget = widget ? widget->getHandle() : WidgetHandle();
+    if (previous) {
+        previous->setFocused(false);
+        Event lostEvent{EventType::FocusLost, previous, {}};
+        dispatchEvent(lostEvent);
+    }
+    if (widget) {
+        widget->setFocused(true);
+        Event gainedEvent{EventType::FocusGained, widget, {}};
+        dispatchEvent(gainedEvent);
+    }
+    
+    if (widget && widget->acceptsTextInput()) {
+        SDL_StartTextInput();
+    } else {
+        SDL_StopTextInput();
+    }
+    invalidate();
+}
+
+void Window::processEvents() {
+    SDL_Event event;
+    
+    // Motion is coalesced until the window changes, another event arrives or the queue drains
+    Window* motionWindow = nullptr;
+    int motionX = 0;
+    int motionY = 0;
+    auto flushMotion = [&]() {
+        if (!motionWindow) return;
+        
+        g_input.history.swap(g_input.pending);
+        g_input.pending.clear();
+        
+        // A captured widget keeps the pointer wherever it goes
+        Widget* widget = motionWindow->pointerCapture.get();
+        if (!widget) {
+            widget = findWidgetAt(motionWindow, motionX, motionY);
+        }
+        motionWindow->updateHover(widget);
+        if (widget) {
+            Event moveEvent{EventType::MouseMove, widget,
+                            {{"x", std::to_string(motionX)}, {"y", std::to_string(motionY)}}};
+            dispatchEvent(moveEvent);
+        }
+        g_input.stats.motionDelivered++;
+        motionWindow = nullptr;
+    };
+    
+    // Typed text runs are delivered to the focused widget in one event
+    Window* textWindow = nullptr;
+    std::string pendingText;
+    auto flushText = [&]() {
+        if (pendingText.empty()) return;
+        
+        if (Widget* focused = textWindow->getFocusedWidget()) {
+            // Typed text is inserted at the widget's cursor, not re-assigned
+            Event textEvent{EventType::KeyPress, focused, {{"text", pendingText}}};
+            dispatchEvent(textEvent);
+            g_input.stats.textDelivered++;
+        }
+        pendingText.clear();
+    };
+    
+    // Process all pending events
+    while (SDL_PollEvent(&event)) {
+        g_input.stats.eventsReceived++;
+        
+        // Handle window events
+        if (event.type == SDL_QUIT) {
+            stopEventLoop();
+            break;
+        }
+        
+        // Find which window the event belongs to
+        Window* targetWindow = nullptr;
+        for (Window* window : windows) {
+            if (window->sdlWindow && SDL_GetWindowID(window->sdlWindow) == event.window.windowID) {
+                targetWindow = window;
+                break;
+            }
+        }
+        
+        if (!targetWindow) continue;
+        
+        GUI_PROFILE_SCOPE("dispatch");
+        
+        if (event.type == SDL_MOUSEMOTION) {
+            g_input.stats.motionReceived++;
+            if (motionWindow != targetWindow) {
+                flushMotion();
+            }
+            motionWindow = targetWindow;
+            motionX = event.motion.x;
+            motionY = event.motion.y;
+            if (g_input.keepHistory) {
+                g_input.pending.push_back({motionX, motionY, event.motion.timestamp});
+            }
+            continue;
+        }
+        if (event.type == SDL_TEXTINPUT) {
+            g_input.stats.textReceived++;
+            if (textWindow != targetWindow) {
+                flushText();
+            }
+            textWindow = targetWindow;
+            pendingText += event.text.text;
+            continue;
+        }
+        
+        // Everything else sees the pointer and text in the order they arrived
+        flushMotion();
+        flushText();
+        
+        // Handle different event types
+        switch (event.type) {
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
+                    targetWindow->close();
+                } else if (event.window.event == SDL_WINDOWEVENT_LEAVE && !targetWindow->pointerCapture) {
+                    targetWindow->updateHover(nullptr);
+                }
+                break;
+                
+            case SDL_MOUSEBUTTONDOWN:
+                if (event.button.button == SDL_BUTTON_LEFT) {
+                    targetWindow->pointerDown = true;
+                    
+                    // Focus widgets that take text input
+                    Widget* clickedWidget = findWidgetAt(targetWindow, event.button.x, event.button.y);
+                    targetWindow->setFocus(clickedWidget && clickedWidget->acceptsTextInput() ? clickedWidget : nullptr);
+                    
+                    // Drags stay with the pressed widget until release
+                    targetWindow->setPointerCapture(clickedWidget);
+                    targetWindow->updateHover(clickedWidget);
+                    targetWindow->invalidate();
+                }
+                break;
+                
+            case SDL_MOUSEBUTTONUP:
+                if (event.button.button == SDL_BUTTON_LEFT && targetWindow->pointerDown) {
+                    targetWindow->pointerDown = false;
+                    
+                    int mouseX = event.button.x;
+                    int mouseY = event.button.y;
+                    Widget* clickedWidget = findWidgetAt(targetWindow, mouseX, mouseY);
+                    Widget* captured = targetWindow->pointerCapture.get();
+                    targetWindow->releasePointerCapture();
+                    targetWindow->updateHover(clickedWidget);
+                    targetWindow->invalidate();
+                    
+                    // Releasing outside the pressed widget cancels the click
+                    if (!clickedWidget || (captured && captured != clickedWidget)) {
+                        break;
+                    }
+                    Event clickEvent{EventType::Click, clickedWidget,
+                                     {{"x", std::to_string(mouseX)}, {"y", std::to_string(mouseY)}}};
+                    dispatchEvent(clickEvent);
+                }
+                break;
+                
+            case SDL_KEYDOWN:
+                if (Widget* focused = targetWindow->getFocusedWidget()) {
+                    const char* key = keyName(event.key.keysym.sym);
+                    if (!key) break;
+                    
+                    // Unhandled keys reach the widget's listeners, e.g. Enter to submit
+                    Event keyEvent{EventType::KeyPress, focused, {{"key", key}}};
+                    dispatchEvent(keyEvent);
+                }
+                break;
+        }
+    }
+    flushMotion();
+    flushText();
+    
+    // Images decoded in the background are uploaded here; redraw once they land
+    if (ImageCache::pump() > 0) {
+        SubtreeCache::invalidateAll();
+        for (Window* window : windows) {
+            if (window->running) {
+                window->invalidate();
+            }
+        }
+    }
+    
+    renderPending();
+}
+
+void Window::stopEventLoop() {
+    g_eventLoopRunning = false;
+    for (auto* window : windows) {
+        window->running = false;
+    }
+}
+
+// Helper function to find widget at coordinates
+Widget* Window::findWidgetAt(Widget* root, int x, int y) {
+    if (!root || !root->isVisible()) return nullptr;
+    
+    // Calculate absolute position
+    int absX = root->getX();
+    int absY = root->getY();
+    Widget* p = root->parent;
+    while (p) {
+        absX += p->getX();
+        absY += p->getY();
+        p = p->getParent();
+    }
     
-    // Draw text or placeholder
-    std::string displayText = text.empty() ? placeholder : text;
-    SDL_Color textColor = text.empty() ? SDL_Color{150, 150, 150, 255} : g_context.textColor;
+    // Check children first (top to bottom)
+    for (auto it = root->children.rbegin(); it != root->children.rend(); ++it) {
+        if (Widget* found = findWidgetAt(it->get(), x, y)) {
+            return found;
+        }
+    }
     
-    if (!displayText.empty()) {
-        int textW, textH;
-        getTextSize(displayText, textW, textH);
-        int textY = absY + (height - textH) / 2;
-        drawText(displayText, absX + 5, textY, textColor);
+    // Check this widget
+    if (x >= absX && x < absX + root->getWidth() &&
+        y >= absY && y < absY + root->getHeight()) {
+        return root;
     }
+    
+    return nullptr;
 }
 
-// VerticalLayout implementation
-VerticalLayout::VerticalLayout(int spacing, int padding) 
-    : spacing(spacing), padding(padding) {}
+// Timer implementation
+static TimerScheduler::Clock::duration toClockDuration(double seconds) {
+    return std::chrono::duration_cast<TimerScheduler::Clock::duration>(
+        std::chrono::duration<double>(seconds));
+}
 
-void VerticalLayout::apply(Widget* container) {
-    int currentY = padding;
-    
-    for (auto& child : container->children) {
-        child->setPosition(padding, currentY);
-        currentY += child->getHeight() + spacing;
+Timer::Timer(double interval, std::function<void()> callback, bool repeating)
+    : callback(std::move(callback)), interval(interval), elapsed(0),
+      repeating(repeating), active(false), scheduler(nullptr),
+      heapIndex(static_cast<size_t>(-1)) {}
+
+Timer::~Timer() {
+    if (scheduler) {
+        scheduler->cancel(this);
     }
 }
 
-// HorizontalLayout implementation
-HorizontalLayout::HorizontalLayout(int spacing, int padding) 
-    : spacing(spacing), padding(padding) {}
+Timer& Timer::setScheduler(TimerScheduler* scheduler) {
+    if (this->scheduler) {
+        this->scheduler->cancel(this);
+    }
+    this->scheduler = scheduler;
+    if (active) {
+        start();
+    }
+    return *this;
+}
 
-void HorizontalLayout::apply(Widget* container) {
-    int currentX = padding;
-    
-    for (auto& child : container->children) {
-        child->setPosition(currentX, padding);
-        currentX += child->getWidth() + spacing;
+void Timer::start() {
+    active = true;
+    elapsed = 0;
+    if (scheduler) {
+        scheduler->schedule(this, TimerScheduler::Clock::now() + toClockDuration(interval));
     }
 }
 
-// Container implementation
-Container::Container(const std::string& id) : Widget(id) {}
+void Timer::stop() {
+    active = false;
+    if (scheduler) {
+        scheduler->cancel(this);
+    }
+}
 
-Container& Container::setLayout(std::unique_ptr<Layout> layout) {
-    this->layout = std::move(layout);
-    if (this->layout) {
-        this->layout->apply(this);
+void Timer::reset() {
+    elapsed = 0;
+    if (active && scheduler) {
+        scheduler->schedule(this, TimerScheduler::Clock::now() + toClockDuration(interval));
     }
-    return *this;
 }
 
-void Container::render() {
-    if (!visible) return;
+void Timer::update(double deltaTime) {
+    // Scheduled timers are fired by their TimerScheduler
+    if (!active || scheduler) return;
     
-    // Get absolute position
-    int absX = x;
-    int absY = y;
-    Widget* p = parent;
-    while (p) {
-        absX += p->getX();
-        absY += p->getY();
-        p = p->parent;
+    elapsed += deltaTime;
+    if (elapsed >= interval) {
+        if (repeating) {
+            elapsed -= interval;
+        } else {
+            active = false;
+        }
+        if (callback) callback();
     }
+}
+
+double Timer::getElapsed() const {
+    if (!scheduler || !active) return elapsed;
     
-    // Optionally draw container background
-    // drawRect(absX, absY, width, height, {250, 250, 250, 255});
+    auto remaining = std::chrono::duration<double>(deadline - TimerScheduler::Clock::now()).count();
+    return std::max(0.0, interval - remaining);
+}
+
+// TimerScheduler implementation
+static const size_t kNotScheduled = static_cast<size_t>(-1);
+
+TimerScheduler::~TimerScheduler() {
+    for (Timer* timer : heap) {
+        timer->heapIndex = kNotScheduled;
+        timer->scheduler = nullptr;
+    }
+}
+
+void TimerScheduler::schedule(Timer* timer, Clock::time_point deadline) {
+    timer->deadline = deadline;
+    timer->scheduler = this;
     
-    // Render children
-    for (auto& child : children) {
-        child->render();
+    if (timer->heapIndex != kNotScheduled) {
+        // Already queued: restore heap order around the new deadline
+        siftUp(timer->heapIndex);
+        siftDown(timer->heapIndex);
+        return;
     }
+    
+    timer->heapIndex = heap.size();
+    heap.push_back(timer);
+    siftUp(timer->heapIndex);
 }
 
-// Window implementation
-Window::Window(const std::string& title, int width, int height) 
-    : Widget("window"), title(title), running(false) {
-    setSize(width, height);
-    windows.push_back(this);
+void TimerScheduler::cancel(Timer* timer) {
+    if (timer->heapIndex == kNotScheduled || timer->heapIndex >= heap.size() ||
+        heap[timer->heapIndex] != timer) {
+        return;
+    }
+    removeAt(timer->heapIndex);
+}
+
+size_t TimerScheduler::runExpired(Clock::time_point now) {
+    size_t fired = 0;
     
-    // Initialize SDL if needed
-    initSDL();
+    while (!heap.empty() && heap.front()->deadline <= now) {
+        Timer* timer = heap.front();
+        removeAt(0);
+        
+        if (timer->repeating) {
+            // Advance from the previous deadline, not from now, so periods don't drift.
+            // Periods missed while the loop was stalled are skipped, not replayed.
+            auto period = std::max(toClockDuration(timer->interval), Clock::duration(1));
+            auto next = timer->deadline + period;
+            if (next <= now) {
+                next += period * ((now - next) / period + 1);
+            }
+            schedule(timer, next);
+        } else {
+            timer->active = false;
+        }
+        
+        ++fired;
+        if (timer->callback) timer->callback();
+    }
+    
+    return fired;
 }
 
-Window::~Window() {
-    windows.erase(std::remove(windows.begin(), windows.end(), this), windows.end());
+TimerScheduler::Clock::time_point TimerScheduler::nextDeadline() const {
+    return heap.empty() ? Clock::time_point::max() : heap.front()->deadline;
+}
+
+int TimerScheduler::getWaitTimeout(Clock::time_point now) const {
+    if (heap.empty()) return -1;
     
-    if (sdlWindow) {
-        SDL_DestroyWindow(sdlWindow);
-        sdlWindow = nullptr;
+    auto deadline = heap.front()->deadline;
+    if (deadline <= now) return 0;
+    
+    // Round up so the loop never wakes just before a deadline and spins
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+    return static_cast<int>(std::min<long long>(wait, std::numeric_limits<int>::max()));
+}
+
+void TimerScheduler::swapEntries(size_t a, size_t b) {
+    std::swap(heap[a], heap[b]);
+    heap[a]->heapIndex = a;
+    heap[b]->heapIndex = b;
+}
+
+void TimerScheduler::siftUp(size_t index) {
+    while (index > 0) {
+        size_t parentIndex = (index - 1) / 2;
+        if (heap[parentIndex]->deadline <= heap[index]->deadline) break;
+        swapEntries(index, parentIndex);
+        index = parentIndex;
+    }
+}
+
+void TimerScheduler::siftDown(size_t index) {
+    for (;;) {
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+        if (left < heap.size() && heap[left]->deadline < heap[smallest]->deadline) smallest = left;
+        if (right < heap.size() && heap[right]->deadline < heap[smallest]->deadline) smallest = right;
+        if (smallest == index) break;
+        swapEntries(index, smallest);
+        index = smallest;
+    }
+}
+
+void TimerScheduler::removeAt(size_t index) {
+    Timer* timer = heap[index];
+    size_t last = heap.size() - 1;
+    if (index != last) {
+        swapEntries(index, last);
     }
+    heap.pop_back();
+    timer->heapIndex = kNotScheduled;
     
-    if (windows.empty() && g_sdlInitialized) {
-        if (g_context.font) {
-            TTF_CloseFont(g_context.font);
-            g_context.font = nullptr;
-        }
-        TTF_Quit();
-        SDL_Quit();
-        g_sdlInitialized = false;
+    if (index < heap.size()) {
+        siftUp(index);
+        siftDown(index);
     }
 }
 
-Window& Window::setTitle(const std::string& title) {
-    this->title = title;
-    if (sdlWindow) {
-        SDL_SetWindowTitle(sdlWindow, title.c_str());
+// PropertyAccessor implementation
+PropertyAccessor PropertyAccessor::resolve(const std::string& property) {
+    if (property == props::X::name) return props::X::accessor();
+    if (property == props::Y::name) return props::Y::accessor();
+    if (property == props::Width::name) return props::Width::accessor();
+    if (property == props::Height::name) return props::Height::accessor();
+    return {nullptr, nullptr};
+}
+
+// Easing curves, written branch-free so the per-block loops vectorize
+namespace curves {
+    static inline float linear(float t) { return t; }
+    static inline float easeIn(float t) { return t * t; }
+    static inline float easeOut(float t) { return t * (2.0f - t); }
+    static inline float easeInOut(float t) {
+        float u = -2.0f * t + 2.0f;
+        return t < 0.5f ? 2.0f * t * t : 1.0f - u * u * 0.5f;
+    }
+    static inline float bounce(float t) {
+        const float n1 = 7.5625f;
+        const float d1 = 2.75f;
+        float t2 = t - 1.5f / d1;
+        float t3 = t - 2.25f / d1;
+        float t4 = t - 2.625f / d1;
+        float a = n1 * t * t;
+        float b = n1 * t2 * t2 + 0.75f;
+        float c = n1 * t3 * t3 + 0.9375f;
+        float d = n1 * t4 * t4 + 0.984375f;
+        return t < 1.0f / d1 ? a : (t < 2.0f / d1 ? b : (t < 2.5f / d1 ? c : d));
+    }
+    static inline float elastic(float t) {
+        const float c4 = 2.0f * 3.14159265f / 3.0f;
+        float v = std::exp2(-10.0f * t) * std::sin((t * 10.0f - 0.75f) * c4) + 1.0f;
+        return t <= 0.0f ? 0.0f : (t >= 1.0f ? 1.0f : v);
+    }
+}
+
+// Animation implementation
+Animation::Animation(Widget* target, const std::string& property,
+                     double endValue, double duration, EasingType easing)
+    : target(target ? target->getHandle() : WidgetHandle()),
+      accessor(PropertyAccessor::resolve(property)),
+      startValue(0), endValue(endValue), duration(duration), elapsed(0),
+      easing(easing), active(false), engine(nullptr), track(0) {}
+
+Animation::Animation(Widget& target, PropertyAccessor accessor,
+                     double endValue, double duration, EasingType easing)
+    : target(target.getHandle()), accessor(accessor),
+      startValue(0), endValue(endValue), duration(duration), elapsed(0),
+      easing(easing), active(false), engine(nullptr), track(0) {}
+
+Animation::~Animation() {
+    if (engine && track) {
+        engine->remove(track);
     }
+}
+
+Animation& Animation::setOnComplete(std::function<void()> callback) {
+    onComplete = std::move(callback);
     return *this;
 }
 
-void Window::show() {
-    if (!sdlWindow) {
-        sdlWindow = SDL_CreateWindow(
-            title.c_str(),
-            SDL_WINDOWPOS_CENTERED,
-            SDL_WINDOWPOS_CENTERED,
-            width, height,
-            SDL_WINDOW_SHOWN
-        );
-        
-        if (!sdlWindow) {
-            throw std::runtime_error("Failed to create window: " + std::string(SDL_GetError()));
-        }
-        
-        g_context.renderer = SDL_CreateRenderer(sdlWindow, -1, SDL_RENDERER_ACCELERATED);
-        if (!g_context.renderer) {
-            throw std::runtime_error("Failed to create renderer: " + std::string(SDL_GetError()));
-        }
+Animation& Animation::setEngine(AnimationEngine* engine) {
+    bool wasActive = active;
+    stop();
+    this->engine = engine;
+    if (wasActive) {
+        start();
     }
+    return *this;
+}
+
+void Animation::start() {
+    Widget* widget = target.get();
+    if (!widget || !accessor) return;
     
-    running = true;
-    render();
+    stop();
+    startValue = accessor.get(widget);
+    elapsed = 0;
+    active = true;
+    
+    if (engine) {
+        track = engine->add(widget, accessor, startValue, endValue, duration, easing, [this](bool completed) {
+            track = 0;
+            active = false;
+            if (completed && onComplete) onComplete();
+        });
+    }
 }
 
-void Window::close() {
-    running = false;
-    Event event{EventType::WindowClose, this, {}};
-    emit(event);
+void Animation::stop() {
+    if (engine && track) {
+        engine->remove(track);
+        track = 0;
+    }
+    active = false;
 }
 
-void Window::render() {
-    if (!g_context.renderer) return;
+void Animation::update(double deltaTime) {
+    // Engine-driven animations advance in AnimationEngine::update
+    if (!active || engine) return;
     
-    // Clear screen
-    SDL_SetRenderDrawColor(g_context.renderer, 
-        g_context.backgroundColor.r, 
-        g_context.backgroundColor.g, 
-        g_context.backgroundColor.b, 
-        g_context.backgroundColor.a);
-        SDL_RenderClear(g_context.renderer);
+    // The target was destroyed: cancel rather than write through a stale pointer
+    Widget* widget = target.get();
+    if (!widget) {
+        active = false;
+        return;
+    }
     
-    // Render all children
-    for (auto& child : children) {
-        child->render();
+    elapsed += deltaTime;
+    double t = duration > 0 ? std::min(elapsed / duration, 1.0) : 1.0;
+    accessor.set(widget, startValue + (endValue - startValue) * ease(t));
+    
+    if (t >= 1.0) {
+        active = false;
+        if (onComplete) onComplete();
+    }
+}
+
+double Animation::ease(double t) {
+    return ease(easing, t);
+}
+
+double Animation::ease(EasingType easing, double t) {
+    float f = static_cast<float>(t);
+    switch (easing) {
+        case EaseIn: return curves::easeIn(f);
+        case EaseOut: return curves::easeOut(f);
+        case EaseInOut: return curves::easeInOut(f);
+        case Bounce: return curves::bounce(f);
+        case Elastic: return curves::elastic(f);
+        default: return curves::linear(f);
+    }
+}
+
+// AnimationEngine implementation
+template <typename EaseFn>
+static void advanceBlock(float* __restrict elapsed, const float* __restrict inverseDuration,
+                         const float* __restrict startValue, const float* __restrict delta,
+                         float* __restrict value, size_t count, float deltaTime, EaseFn ease) {
+    for (size_t i = 0; i < count; ++i) {
+        float e = elapsed[i] + deltaTime;
+        elapsed[i] = e;
+        float t = std::min(e * inverseDuration[i], 1.0f);
+        value[i] = startValue[i] + delta[i] * ease(t);
+    }
+}
+
+AnimationEngine::TrackId AnimationEngine::add(Widget* target, const PropertyAccessor& accessor,
+                                              double startValue, double endValue, double duration,
+                                              Animation::EasingType easing, std::function<void(bool)> onFinish) {
+    if (!target || !accessor) return 0;
+    
+    uint32_t blockIndex = easing < Animation::EasingCount ? easing : Animation::Linear;
+    Block& block = blocks[blockIndex];
+    
+    uint32_t slotNumber;
+    if (!freeSlots.empty()) {
+        slotNumber = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slots.emplace_back();
+        slots.back().generation = 0;
+        slotNumber = static_cast<uint32_t>(slots.size()); // slot index + 1
     }
     
-    // Present
-    SDL_RenderPresent(g_context.renderer);
+    Slot& slot = slots[slotNumber - 1];
+    TrackId id = (static_cast<TrackId>(slot.generation) << 32) | slotNumber;
+    slot.block = blockIndex;
+    slot.index = static_cast<uint32_t>(block.ids.size());
+    slot.live = true;
+    slot.onFinish = std::move(onFinish);
+    
+    // Clamp so a zero duration completes on the next update instead of producing NaN
+    float safeDuration = static_cast<float>(std::max(duration, 1e-6));
+    block.startValue.push_back(static_cast<float>(startValue));
+    block.delta.push_back(static_cast<float>(endValue - startValue));
+    block.elapsed.push_back(0.0f);
+    block.inverseDuration.push_back(1.0f / safeDuration);
+    block.value.push_back(static_cast<float>(startValue));
+    block.targets.push_back(target->getHandle());
+    block.setters.push_back(accessor.set);
+    block.ids.push_back(id);
+    ++trackCount;
+    
+    return id;
 }
 
-void Window::runEventLoop() {
-    g_eventLoopRunning = true;
-    SDL_Event event;
+void AnimationEngine::remove(TrackId id) {
+    if (!isActive(id)) return;
+    const Slot& slot = slots[slotIndex(id)];
+    removeAt(slot.block, slot.index);
+}
+
+bool AnimationEngine::isActive(TrackId id) const {
+    uint32_t slotNumber = static_cast<uint32_t>(id);
+    return slotNumber > 0 && slotNumber <= slots.size() && slots[slotNumber - 1].live &&
+           slots[slotNumber - 1].generation == static_cast<uint32_t>(id >> 32);
+}
+
+void AnimationEngine::removeAt(uint32_t blockIndex, uint32_t index) {
+    Block& block = blocks[blockIndex];
+    TrackId id = block.ids[index];
+    size_t last = block.ids.size() - 1;
     
-    // Track focused widget for text input
-    static Widget* focusedWidget = nullptr;
-    static std::string inputBuffer;
+    // Swap-and-pop keeps every block dense
+    if (index != last) {
+        block.startValue[index] = block.startValue[last];
+        block.delta[index] = block.delta[last];
+        block.elapsed[index] = block.elapsed[last];
+        block.inverseDuration[index] = block.inverseDuration[last];
+        block.value[index] = block.value[last];
+        block.targets[index] = block.targets[last];
+        block.setters[index] = block.setters[last];
+        block.ids[index] = block.ids[last];
+        slots[slotIndex(block.ids[index])].index = index;
+    }
+    block.startValue.pop_back();
+    block.delta.pop_back();
+    block.elapsed.pop_back();
+    block.inverseDuration.pop_back();
+    block.value.pop_back();
+    block.targets.pop_back();
+    block.setters.pop_back();
+    block.ids.pop_back();
     
-    // Track mouse state for click detection
-    static bool mouseWasPressed = false;
+    Slot& slot = slots[slotIndex(id)];
+    slot.live = false;
+    slot.onFinish = nullptr;
+    slot.generation++;
+    freeSlots.push_back(slotIndex(id) + 1);
+    --trackCount;
+}
+
+void AnimationEngine::update(double deltaTime) {
+    float dt = static_cast<float>(deltaTime);
+    finished.clear();
+    orphaned.clear();
     
-    while (g_eventLoopRunning) {
-        // Process all pending events
-        while (SDL_PollEvent(&event)) {
-            // Handle window events
-            if (event.type == SDL_QUIT) {
-                stopEventLoop();
+    for (uint32_t b = 0; b < Animation::EasingCount; ++b) {
+        Block& block = blocks[b];
+        size_t count = block.ids.size();
+        if (count == 0) continue;
+        
+        float* elapsed = block.elapsed.data();
+        const float* inverseDuration = block.inverseDuration.data();
+        const float* startValue = block.startValue.data();
+        const float* delta = block.delta.data();
+        float* value = block.value.data();
+        
+        switch (static_cast<Animation::EasingType>(b)) {
+            case Animation::EaseIn:
+                advanceBlock(elapsed, inverseDuration, startValue, delta, value, count, dt, curves::easeIn);
                 break;
+            case Animation::EaseOut:
+                advanceBlock(elapsed, inverseDuration, startValue, delta, value, count, dt, curves::easeOut);
+                break;
+            case Animation::EaseInOut:
+                advanceBlock(elapsed, inverseDuration, startValue, delta, value, count, dt, curves::easeInOut);
+                break;
+            case Animation::Bounce:
+                advanceBlock(elapsed, inverseDuration, startValue, delta, value, count, dt, curves::bounce);
+                break;
+            case Animation::Elastic:
+                advanceBlock(elapsed, inverseDuration, startValue, delta, value, count, dt, curves::elastic);
+                break;
+            default:
+                advanceBlock(elapsed, inverseDuration, startValue, delta, value, count, dt, curves::linear);
+                break;
+        }
+        
+        // Write back through the precomputed setters and collect finished tracks
+        for (size_t i = 0; i < count; ++i) {
+            Widget* target = block.targets[i].get();
+            if (!target) {
+                orphaned.push_back(block.ids[i]);
+                continue;
             }
-            
-            // Find which window the event belongs to
-            Window* targetWindow = nullptr;
-            for (Window* window : windows) {
-                if (window->sdlWindow && SDL_GetWindowID(window->sdlWindow) == event.window.windowID) {
-                    targetWindow = window;
-                    break;
-                }
-            }
-            
-            if (!targetWindow) continue;
-            
-            // Handle different event types
-            switch (event.type) {
-                case SDL_WINDOWEVENT:
-                    if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
-                        targetWindow->close();
-                    }
-                    break;
-                    
-                case SDL_MOUSEBUTTONDOWN:
-                    if (event.button.button == SDL_BUTTON_LEFT) {
-                        mouseWasPressed = true;
-                        
-                        // Find widget under mouse
-                        int mouseX = event.button.x;
-                        int mouseY = event.button.y;
-                        
-                        // Check for TextInput widgets to focus
-                        Widget* clickedWidget = findWidgetAt(targetWindow, mouseX, mouseY);
-                        if (clickedWidget) {
-                            // Update focus
-                            if (dynamic_cast<TextInput*>(clickedWidget)) {
-                                focusedWidget = clickedWidget;
-                                inputBuffer = dynamic_cast<TextInput*>(clickedWidget)->getText();
-                                SDL_StartTextInput();
-                            } else {
-                                focusedWidget = nullptr;
-                                SDL_StopTextInput();
-                            }
-                        } else {
-                            focusedWidget = nullptr;
-                            SDL_StopTextInput();
-                        }
-                    }
-                    break;
-                    
-                case SDL_MOUSEBUTTONUP:
-                    if (event.button.button == SDL_BUTTON_LEFT && mouseWasPressed) {
-                        mouseWasPressed = false;
-                        
-                        // Find widget under mouse and trigger click
-                        int mouseX = event.button.x;
-                        int mouseY = event.button.y;
-                        
-                        Widget* clickedWidget = findWidgetAt(targetWindow, mouseX, mouseY);
-                        if (Button* button = dynamic_cast<Button*>(clickedWidget)) {
-                            button->click();
-                        }
-                    }
-                    break;
-                    
-                case SDL_TEXTINPUT:
-                    if (focusedWidget && dynamic_cast<TextInput*>(focusedWidget)) {
-                        inputBuffer += event.text.text;
-                        dynamic_cast<TextInput*>(focusedWidget)->setText(inputBuffer);
-                        targetWindow->render();
-                    }
-                    break;
-                    
-                case SDL_KEYDOWN:
-                    if (focusedWidget && dynamic_cast<TextInput*>(focusedWidget)) {
-                        if (event.key.keysym.sym == SDLK_BACKSPACE && !inputBuffer.empty()) {
-                            inputBuffer.pop_back();
-                            dynamic_cast<TextInput*>(focusedWidget)->setText(inputBuffer);
-                            targetWindow->render();
-                        } else if (event.key.keysym.sym == SDLK_RETURN) {
-                            // Submit on Enter
-                            Event enterEvent{EventType::KeyPress, focusedWidget, {{"key", "enter"}}};
-                            focusedWidget->emit(enterEvent);
-                        }
-                    }
-                    break;
-                    
-                case SDL_MOUSEMOTION:
-                    // Update hover states by re-rendering
-                    targetWindow->render();
-                    break;
+            block.setters[i](target, value[i]);
+            if (elapsed[i] * inverseDuration[i] >= 1.0f) {
+                finished.push_back(block.ids[i]);
             }
         }
-        
-        // Small delay to prevent 100% CPU usage
-        SDL_Delay(16); // ~60 FPS
+    }
+    
+    // Tracks whose widget was destroyed are cancelled without completing
+    for (TrackId id : orphaned) {
+        if (!isActive(id)) continue;
+        std::function<void(bool)> callback = std::move(slots[slotIndex(id)].onFinish);
+        remove(id);
+        if (callback) callback(false);
+    }
+    
+    // Completion callbacks run last; they may start new animations
+    for (TrackId id : finished) {
+        if (!isActive(id)) continue;
+        std::function<void(bool)> callback = std::move(slots[slotIndex(id)].onFinish);
+        remove(id);
+        if (callback) callback(true);
     }
 }
 
-void Window::stopEventLoop() {
-    g_eventLoopRunning = false;
-    for (auto* window : windows) {
-        window->running = false;
+// Application implementation
+Application* Application::instance = nullptr;
+
+Application::Application() : running(false) {
+    instance = this;
+}
+
+Application::~Application() {
+    if (instance == this) {
+        instance = nullptr;
     }
 }
 
-// Helper function to find widget at coordinates
-Widget* Window::findWidgetAt(Widget* root, int x, int y) {
-    if (!root || !root->isVisible()) return nullptr;
+Application* Application::getInstance() {
+    return instance;
+}
+
+void Application::addWindow(std::unique_ptr<Window> window) {
+    windows.push_back(std::move(window));
+}
+
+void Application::addTimer(std::unique_ptr<Timer> timer) {
+    timer->setScheduler(&scheduler);
+    timers.push_back(std::move(timer));
+}
+
+void Application::addAnimation(std::unique_ptr<Animation> animation) {
+    animation->setEngine(&animationEngine);
+    animations.push_back(std::move(animation));
+}
+
+void Application::run() {
+    using Clock = TimerScheduler::Clock;
     
-    // Calculate absolute position
-    int absX = root->getX();
-    int absY = root->getY();
-    Widget* p = root->parent;
-    while (p) {
-        absX += p->getX();
-        absY += p->getY();
-        p = p->parent;
+    running = true;
+    g_eventLoopRunning = true;
+    for (auto& window : windows) {
+        window->show();
     }
     
-    // Check children first (top to bottom)
-    for (auto it = root->children.rbegin(); it != root->children.rend(); ++it) {
-        if (Widget* found = findWidgetAt(it->get(), x, y)) {
-            return found;
+    auto lastFrame = Clock::now();
+    while (running && g_eventLoopRunning) {
+        Window::processEvents();
+        
+        // Timers and animations may change any window, so they redraw everything
+        auto now = Clock::now();
+        bool changed = scheduler.getWaitTimeout(now) == 0 || !animationEngine.empty();
+        update(std::chrono::duration<double>(now - lastFrame).count());
+        lastFrame = now;
+        
+        if (changed) {
+            for (auto& window : windows) {
+                if (window->isRunning()) {
+                    window->invalidate();
+                }
+            }
         }
+        Window::renderPending();
+        
+        // Sleep until the next input event, timer deadline or frame slot; animations need frames
+        int timeout = scheduler.getWaitTimeout();
+        int renderTimeout = Window::getRenderWaitTimeout();
+        if (renderTimeout >= 0 && (timeout < 0 || renderTimeout < timeout)) {
+            timeout = renderTimeout;
+        }
+        int frameMs = std::max(1, 1000 / InputPipeline::getFrameRate());
+        if (!animationEngine.empty() && (timeout < 0 || timeout > frameMs)) {
+            timeout = frameMs;
+        }
+        SDL_WaitEventTimeout(nullptr, timeout);
     }
     
-    // Check this widget
-    if (x >= absX && x < absX + root->getWidth() &&
-        y >= absY && y < absY + root->getHeight()) {
-        return root;
-    }
-    
-    return nullptr;
+    running = false;
+}
+
+void Application::quit() {
+    running = false;
+    Window::stopEventLoop();
+}
+
+void Application::update(double deltaTime) {
+    scheduler.runExpired();
+    animationEngine.update(deltaTime);
 }
 
 } // namespace gui
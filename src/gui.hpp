@@ -5,10 +5,22 @@
 #include <functional>
 #include <memory>
 #include <unordered_map>
+#include <list>
+#include <string_view>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+#include <algorithm>
 
 // Forward declare SDL types to avoid including SDL headers in the interface
 struct SDL_Window;
 struct SDL_Renderer;
+struct SDL_Texture;
+struct SDL_Surface;
+struct SDL_Color;
+union SDL_Event;
+typedef struct _TTF_Font TTF_Font;
 
 namespace gui {
 
@@ -30,11 +42,20 @@ enum class EventType {
     WindowResize
 };
 
+// Stage of Window::dispatchEvent delivering an event to a widget's handleEvent:
+// ancestors outermost first, the source itself, then ancestors innermost first
+enum class EventPhase {
+    Capture,
+    Target,
+    Bubble
+};
+
 // Event structure
 struct Event {
     EventType type;
     Widget* source;
     std::unordered_map<std::string, std::string> data;
+    EventPhase phase = EventPhase::Target;
     
     // Helper methods for common event data
     std::string getText() const {
@@ -65,6 +86,9 @@ struct Color {
     Color(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t a = 255)
         : r(r), g(g), b(b), a(a) {}
     
+    bool operator==(const Color& other) const { return r == other.r && g == other.g && b == other.b && a == other.a; }
+    bool operator!=(const Color& other) const { return !(*this == other); }
+    
     // Predefined colors
     static Color Black() { return Color(0, 0, 0); }
     static Color White() { return Color(255, 255, 255); }
@@ -102,6 +126,141 @@ struct Style {
         fontSize(14) {}
 };
 
+// Bits naming Style fields, for widgets that override only part of their theme style
+enum StyleField : uint32_t {
+    StyleBackground = 1 << 0,
+    StyleForeground = 1 << 1,
+    StyleBorder = 1 << 2,
+    StyleHover = 1 << 3,
+    StylePressed = 1 << 4,
+    StyleDisabled = 1 << 5,
+    StyleBorderWidth = 1 << 6,
+    StylePadding = 1 << 7,
+    StyleFontFamily = 1 << 8,
+    StyleFontSize = 1 << 9,
+    StyleAllFields = (1 << 10) - 1
+};
+
+// Widget type IDs, fixed at compile time; they index a theme's compiled style table
+enum class WidgetType : uint8_t {
+    Generic,
+    Button,
+    Label,
+    TextInput,
+    TextArea,
+    TextView,
+    CheckBox,
+    RadioButton,
+    ComboBox,
+    Slider,
+    ProgressBar,
+    Container,
+    Panel,
+    Window,
+    Menu,
+    MenuBar,
+    TabControl,
+    ScrollBar,
+    ListBox,
+    TreeView,
+    Table,
+    StatusBar,
+    ToolBar,
+    ColorPicker,
+    DatePicker,
+    Count
+};
+
+const char* widgetTypeName(WidgetType type);
+bool widgetTypeFromName(const std::string& name, WidgetType& type);
+
+// Weak reference to a widget; resolves to nullptr once the widget is destroyed
+class WidgetHandle {
+private:
+    uint32_t slot;
+    uint32_t generation;
+    
+    WidgetHandle(uint32_t slot, uint32_t generation) : slot(slot), generation(generation) {}
+    friend class Widget;
+    
+public:
+    WidgetHandle() : slot(0), generation(0) {}
+    
+    Widget* get() const;
+    bool expired() const { return get() == nullptr; }
+    explicit operator bool() const { return get() != nullptr; }
+};
+
+// Gap buffer: contiguous text with a movable gap at the edit point, so
+// consecutive inserts and deletes at the cursor are O(1) amortized
+class GapBuffer {
+private:
+    std::vector<char> buffer;
+    size_t gapStart;
+    size_t gapEnd;
+    
+    void moveGap(size_t position);
+    void reserveGap(size_t count);
+    
+public:
+    GapBuffer() : gapStart(0), gapEnd(0) {}
+    explicit GapBuffer(const std::string& text);
+    
+    size_t size() const { return buffer.size() - (gapEnd - gapStart); }
+    bool empty() const { return size() == 0; }
+    char at(size_t index) const { return index < gapStart ? buffer[index] : buffer[index + gapEnd - gapStart]; }
+    
+    void insert(size_t position, const char* text, size_t length);
+    void insert(size_t position, const std::string& text) { insert(position, text.data(), text.size()); }
+    void erase(size_t position, size_t count);
+    void assign(const std::string& text);
+    void clear() { buffer.clear(); gapStart = gapEnd = 0; }
+    
+    std::string text() const { return substr(0, size()); }
+    std::string substr(size_t position, size_t count) const;
+    // Bytes stored contiguously from position, up to the gap or the end
+    const char* span(size_t position, size_t& length) const;
+};
+
+// Grapheme cluster boundaries of one line of UTF-8 text with the caret x-offset
+// of each, summed from cached glyph advances. An edit invalidates from the
+// cluster before the edit point and update() rescans only from there, until a
+// boundary lines up with one past the edit; the clusters after it are shifted
+// rather than measured again. Caret placement, hit-testing and cluster-wise
+// movement are then binary searches.
+class GraphemeIndex {
+private:
+    std::vector<size_t> starts; // byte offset of every cluster, then the end of the text
+    std::vector<int> offsets;   // caret x at each entry of starts
+    // Leading entries unaffected by edits since the last update. While stale,
+    // the entries after them lie past every edit: their bytes are already
+    // shifted, their offsets are still those of the last update.
+    size_t stableEntries;
+    bool stale;
+    
+    size_t entryAt(size_t byte) const;
+    size_t stablePrefix(size_t byte) const;
+    
+public:
+    GraphemeIndex() : starts(1, 0), offsets(1, 0), stableEntries(1), stale(true) {}
+    
+    // Records that removed bytes at position were replaced by inserted bytes
+    void edit(size_t position, size_t removed, size_t inserted);
+    void invalidateFrom(size_t byte);
+    void invalidate() { invalidateFrom(0); }
+    void update(const GapBuffer& text);
+    
+    // Queries assume update() has run since the last edit
+    size_t clusterCount() const { return starts.size() - 1; }
+    size_t clusterIndex(size_t byte) const { return entryAt(byte); }
+    size_t boundary(size_t cluster) const { return starts[std::min(cluster, starts.size() - 1)]; }
+    size_t snap(size_t byte) const { return starts[entryAt(byte)]; }
+    size_t move(size_t byte, long clusters) const;
+    int xAt(size_t byte) const { return offsets[entryAt(byte)]; }
+    size_t hitTest(int x) const;
+    int width() const { return offsets.back(); }
+};
+
 // Base widget class
 class Widget {
 protected:
@@ -110,21 +269,40 @@ protected:
     bool visible;
     bool enabled;
     bool focused;
+    bool hovered;   // on the window's hover path, maintained by its pointer tracker
+    bool dirty;     // invalidated since the last render; read by texture-cached containers
     Widget* parent;
     std::vector<std::unique_ptr<Widget>> children;
-    Style style;
+    // Absolute position as of the last render traversal; see updateRenderOrigin
+    int renderX, renderY;
+    
+private:
+    // Fields set through setStyle(); null for widgets that follow the theme
+    struct StyleOverride;
+    std::unique_ptr<StyleOverride> styleOverride;
+    uint32_t handleSlot;
     
 public:
     Widget(const std::string& id = "");
-    virtual ~Widget() = default;
+    virtual ~Widget();
+    
+    // Widgets built by UILayout::instantiate share one arena; others use the heap
+    static void* operator new(size_t size);
+    static void operator delete(void* pointer, size_t size);
     
     // Property setters with method chaining
     Widget& setPosition(int x, int y);
     Widget& setSize(int width, int height);
+    Widget& setX(int x) { return setPosition(x, y); }
+    Widget& setY(int y) { return setPosition(x, y); }
+    Widget& setWidth(int width) { return setSize(width, height); }
+    Widget& setHeight(int height) { return setSize(width, height); }
     Widget& setVisible(bool visible);
     Widget& setEnabled(bool enabled);
     Widget& setFocused(bool focused);
-    Widget& setStyle(const Style& style);
+    // Overrides the given fields of the theme style for this widget only
+    Widget& setStyle(const Style& style, uint32_t fields = StyleAllFields);
+    Widget& resetStyle();
     
     // Property getters
     std::string getId() const { return id; }
@@ -135,12 +313,24 @@ public:
     bool isVisible() const { return visible; }
     bool isEnabled() const { return enabled; }
     bool isFocused() const { return focused; }
-    const Style& getStyle() const { return style; }
+    // Under the pointer, or an ancestor of the widget that is
+    bool isHovered() const { return hovered; }
+    // The widget receives pointer input until the capture is released (see Window)
+    bool hasPointerCapture() const;
+    // Theme style for the widget type with any overrides applied
+    const Style& getStyle() const;
+    uint32_t getStyleOverrides() const;
     Widget* getParent() const { return parent; }
+    WidgetHandle getHandle() const;
     
     // Absolute position calculation
     int getAbsoluteX() const;
     int getAbsoluteY() const;
+    // The render traversal derives each widget's absolute position from its
+    // parent's, refreshed just before, instead of walking up the tree
+    void updateRenderOrigin();
+    int getRenderX() const { return renderX; }
+    int getRenderY() const { return renderY; }
     
     // Child management
     Widget& add(std::unique_ptr<Widget> child);
@@ -150,6 +340,11 @@ public:
     void removeAll();
     const std::vector<std::unique_ptr<Widget>>& getChildren() const { return children; }
     
+    // Marks the widget and its ancestors dirty and schedules a redraw of the
+    // window it is in. Setters call this; so must code changing what a widget
+    // draws behind its back.
+    void invalidate();
+    
     // Event handling
     using EventHandler = std::function<void(const Event&)>;
     Widget& on(EventType type, EventHandler handler);
@@ -157,23 +352,28 @@ public:
     
     // Virtual methods
     virtual void render() = 0;
-    virtual void update(double deltaTime) {}
-    virtual bool handleEvent(const Event& event) { return false; }
+    virtual void update(double /*deltaTime*/) {}
+    virtual bool handleEvent(const Event& /*event*/) { return false; }
+    virtual bool acceptsTextInput() const { return false; }
+    virtual WidgetType getType() const { return WidgetType::Generic; }
     
 protected:
     std::unordered_map<EventType, std::vector<EventHandler>> eventHandlers;
     void emit(const Event& event);
+    // True if this widget or an ancestor listens for the event type
+    bool hasHandlers(EventType type) const;
     
     friend class Window;
     friend class Container;
+    friend class UILayout;
 };
 
 // Button widget
 class Button : public Widget {
 private:
     std::string text;
-    bool pressed;
-    bool hover;
+    
+    friend class UILayout;
     
 public:
     Button(const std::string& text = "", const std::string& id = "");
@@ -181,6 +381,7 @@ public:
     Button& setText(const std::string& text);
     std::string getText() const { return text; }
     
+    WidgetType getType() const override { return WidgetType::Button; }
     void render() override;
     bool handleEvent(const Event& event) override;
     void click();
@@ -192,6 +393,8 @@ private:
     std::string text;
     bool autoSize;
     
+    friend class UILayout;
+    
 public:
     Label(const std::string& text = "", const std::string& id = "");
     
@@ -200,19 +403,24 @@ public:
     std::string getText() const { return text; }
     bool getAutoSize() const { return autoSize; }
     
+    WidgetType getType() const override { return WidgetType::Label; }
     void render() override;
 };
 
 // TextInput widget
 class TextInput : public Widget {
 private:
-    std::string text;
+    GapBuffer text;
+    GraphemeIndex clusters;
     std::string placeholder;
-    size_t cursorPosition;
+    size_t cursorPosition;   // byte offsets, always on cluster boundaries
     size_t selectionStart;
     size_t selectionEnd;
     bool password;
-    int maxLength;
+    int maxLength;           // in grapheme clusters
+    TTF_Font* layoutFont;    // font the cluster offsets were measured with
+    
+    friend class UILayout;
     
 public:
     TextInput(const std::string& placeholder = "", const std::string& id = "");
@@ -222,18 +430,233 @@ public:
     TextInput& setPassword(bool password);
     TextInput& setMaxLength(int maxLength);
     
-    std::string getText() const { return text; }
+    std::string getText() const { return text.text(); }
     std::string getPlaceholder() const { return placeholder; }
     bool isPassword() const { return password; }
     int getMaxLength() const { return maxLength; }
+    size_t getCursorPosition() const { return cursorPosition; }
+    size_t getSelectionStart() const { return std::min(selectionStart, selectionEnd); }
+    size_t getSelectionEnd() const { return std::max(selectionStart, selectionEnd); }
+    std::string getSelectedText() const;
+    
+    // Positions are byte offsets and are snapped to grapheme cluster boundaries
+    TextInput& setCursorPosition(size_t position);
+    TextInput& setSelection(size_t start, size_t end);
+    // Nearest cluster boundary to an x coordinate relative to the widget
+    size_t getPositionAt(int localX);
+    
+    // Editing at the cursor; typing and deleting replace the selection
+    void insertText(const std::string& str);
+    void deleteChar(bool forward);
+    void moveCursor(int steps);
     
+    WidgetType getType() const override { return WidgetType::TextInput; }
     void render() override;
     bool handleEvent(const Event& event) override;
+    bool acceptsTextInput() const override { return enabled; }
     
 private:
+    GraphemeIndex& clusterIndex();
+    void syncFont();
+    int caretX(size_t position);
+    bool eraseSelection();
+    void notifyTextChanged();
+};
+
+// Multi-line text editor. Every line is its own gap buffer, so typing costs
+// O(1) amortized; only edited lines are re-rasterized and only visible lines drawn.
+class TextArea : public Widget {
+private:
+    struct Line {
+        GapBuffer text;
+        GraphemeIndex clusters;
+        SDL_Texture* texture = nullptr;
+        int textureWidth = 0;
+        int textureHeight = 0;
+        bool dirty = true;
+    };
+    
+    std::vector<Line> lines;
+    Color lineColor;  // foreground the line textures were rasterized with
+    size_t cursorLine;
+    size_t cursorColumn;    // byte offset in the line, always on a cluster boundary
+    int preferredCaretX;    // kept across vertical moves; -1 when unset
+    int scrollY;
+    int lineHeight;
+    bool readOnly;
+    TTF_Font* layoutFont;   // font the line layout and textures were made with
+    
+    friend class UILayout;
+    
+public:
+    TextArea(const std::string& id = "");
+    ~TextArea();
+    
+    TextArea& setText(const std::string& text);
+    TextArea& setReadOnly(bool readOnly);
+    TextArea& setScrollY(int scrollY);
+    TextArea& setCursor(size_t line, size_t column);
+    
+    std::string getText() const;
+    std::string getLine(size_t index) const;
+    size_t getLineCount() const { return lines.size(); }
+    size_t getCursorLine() const { return cursorLine; }
+    size_t getCursorColumn() const { return cursorColumn; }
+    int getScrollY() const { return scrollY; }
+    bool isReadOnly() const { return readOnly; }
+    
+    // Editing at the cursor; columns are grapheme clusters
     void insertText(const std::string& str);
     void deleteChar(bool forward);
-    void moveCursor(int direction);
+    void moveCursor(int columns, int rows);
+    
+    WidgetType getType() const override { return WidgetType::TextArea; }
+    void render() override;
+    bool handleEvent(const Event& event) override;
+    bool acceptsTextInput() const override { return enabled && !readOnly; }
+    
+private:
+    GraphemeIndex& lineClusters(size_t line);
+    void syncFont();
+    void ensureCursorVisible();
+    void releaseTextures();
+    void notifyTextChanged();
+};
+
+// Read-only, line-addressable text backing large views
+class TextSource {
+public:
+    virtual ~TextSource() = default;
+    virtual size_t getLineCount() const = 0;
+    // Line contents without the line terminator
+    virtual std::string_view getLine(size_t index) const = 0;
+};
+
+// In-memory TextSource with a prebuilt line-offset index
+class StringTextSource : public TextSource {
+private:
+    std::string text;
+    std::vector<size_t> lineStarts;
+    
+public:
+    explicit StringTextSource(std::string text);
+    
+    size_t getLineCount() const override { return lineStarts.size(); }
+    std::string_view getLine(size_t index) const override;
+};
+
+// Memory-mapped TextSource for large or growing files such as logs. The index
+// keeps one offset per kLinesPerCheckpoint lines, built in parallel on open and
+// extended from the old end of file by refresh(), so watching a multi-GB log
+// costs a few bytes per hundred lines instead of a copy of the file.
+class MappedFileSource : public TextSource {
+private:
+    std::string path;
+    const char* data;
+    uint64_t size;
+    intptr_t fileHandle;
+    void* mappingHandle;
+    
+    std::vector<uint64_t> checkpoints; // start offset of every kLinesPerCheckpoint-th line
+    uint64_t newlineCount;
+    uint64_t lastLineStart;            // offset just past the last indexed newline
+    
+    // Line starts of the most recently resolved checkpoint block
+    mutable size_t cachedBlock;
+    mutable std::vector<uint64_t> cachedStarts;
+    
+public:
+    static constexpr size_t kLinesPerCheckpoint = 64;
+    
+    explicit MappedFileSource(const std::string& path);
+    ~MappedFileSource();
+    
+    MappedFileSource(const MappedFileSource&) = delete;
+    MappedFileSource& operator=(const MappedFileSource&) = delete;
+    
+    // Picks up bytes appended since the last call; a shrunk file is reindexed
+    // from scratch. Returns true if the contents changed. Views returned by
+    // getLine() before the call are invalidated when it returns true.
+    bool refresh();
+    
+    const std::string& getPath() const { return path; }
+    uint64_t getSize() const { return size; }
+    size_t getIndexMemory() const { return checkpoints.capacity() * sizeof(uint64_t); }
+    
+    size_t getLineCount() const override;
+    std::string_view getLine(size_t index) const override;
+    
+private:
+    void map(uint64_t bytes);
+    void unmap();
+    void rebuildIndex();
+    void indexRange(uint64_t begin, uint64_t end);
+};
+
+// Read-only view for multi-megabyte text. Lines are word-wrapped from cached
+// glyph advances, break positions are cached per (line content, width), and
+// rasterized rows are cached by content hash, so scrolling and resizing only
+// lay out and draw the visible rows.
+class TextView : public Widget {
+private:
+    struct ShapedRow {
+        SDL_Texture* texture;
+        int width;
+        int height;
+        std::string text;   // compared on lookup, since the key is only a hash
+        std::list<uint64_t>::iterator lruPosition;
+    };
+    
+    // Row starts of one line at one wrap width. The key is only a hash, so a
+    // hit must also match the length, width and a second hash of the line.
+    struct LineBreaks {
+        size_t length;
+        int width;
+        uint64_t check;
+        std::vector<uint32_t> starts;
+    };
+    
+    std::shared_ptr<TextSource> source;
+    size_t topLine;
+    size_t topRow;    // wrapped row within topLine
+    bool wordWrap;
+    int lineHeight;
+    
+    std::unordered_map<uint64_t, LineBreaks> breakCache;            // (content, width) -> row starts
+    std::unordered_map<uint64_t, ShapedRow> rowCache;               // content -> texture
+    std::list<uint64_t> rowLru;
+    size_t rowCacheCapacity;
+    Color rowColor;   // foreground the cached rows were rasterized with
+    TTF_Font* layoutFont;
+    
+    friend class UILayout;
+    
+public:
+    TextView(const std::string& id = "");
+    ~TextView();
+    
+    TextView& setSource(std::shared_ptr<TextSource> source);
+    TextView& setText(std::string text);
+    TextView& setWordWrap(bool wordWrap);
+    TextView& setRowCacheCapacity(size_t rows);
+    
+    void scrollToLine(size_t line);
+    void scrollRows(long rows);
+    
+    size_t getTopLine() const { return topLine; }
+    size_t getLineCount() const { return source ? source->getLineCount() : 0; }
+    bool getWordWrap() const { return wordWrap; }
+    size_t getCachedRowCount() const { return rowCache.size(); }
+    
+    WidgetType getType() const override { return WidgetType::TextView; }
+    void render() override;
+    bool handleEvent(const Event& event) override;
+    
+private:
+    const std::vector<uint32_t>& layoutLine(size_t line);
+    const ShapedRow* shapeRow(std::string_view text);
+    void syncFont();
+    void clearCaches();
 };
 
 // CheckBox widget
@@ -250,6 +673,7 @@ public:
     std::string getText() const { return text; }
     bool isChecked() const { return checked; }
     
+    WidgetType getType() const override { return WidgetType::CheckBox; }
     void render() override;
     bool handleEvent(const Event& event) override;
     void toggle();
@@ -273,6 +697,7 @@ public:
     std::string getGroup() const { return group; }
     bool isChecked() const { return checked; }
     
+    WidgetType getType() const override { return WidgetType::RadioButton; }
     void render() override;
     bool handleEvent(const Event& event) override;
     
@@ -298,6 +723,7 @@ public:
     int getSelectedIndex() const { return selectedIndex; }
     std::string getSelectedItem() const;
     
+    WidgetType getType() const override { return WidgetType::ComboBox; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
@@ -326,6 +752,7 @@ public:
     double getStep() const { return step; }
     bool isVertical() const { return vertical; }
     
+    WidgetType getType() const override { return WidgetType::Slider; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
@@ -352,6 +779,7 @@ public:
     double getValue() const { return value; }
     double getPercentage() const;
     
+    WidgetType getType() const override { return WidgetType::ProgressBar; }
     void render() override;
 };
 
@@ -371,6 +799,10 @@ private:
 public:
     VerticalLayout(int spacing = 10, int padding = 10, bool stretch = false);
     void apply(Widget* container) override;
+    
+    int getSpacing() const { return spacing; }
+    int getPadding() const { return padding; }
+    bool getStretch() const { return stretch; }
 };
 
 class HorizontalLayout : public Layout {
@@ -382,6 +814,10 @@ private:
 public:
     HorizontalLayout(int spacing = 10, int padding = 10, bool stretch = false);
     void apply(Widget* container) override;
+    
+    int getSpacing() const { return spacing; }
+    int getPadding() const { return padding; }
+    bool getStretch() const { return stretch; }
 };
 
 class GridLayout : public Layout {
@@ -402,13 +838,33 @@ private:
     std::unique_ptr<Layout> layout;
     bool autoResize;
     
+    // Render-target copy of the subtree; see setCacheAsTexture and SubtreeCache
+    struct TextureCache;
+    std::unique_ptr<TextureCache> textureCache;
+    uint32_t stableFrames;   // renders in a row with nothing below invalidated
+    
+    bool renderCached(int absX, int absY, bool changed);
+    void releaseTextureCache();
+    
+    friend class UILayout;
+    
 public:
     Container(const std::string& id = "");
+    ~Container() override;
     
     Container& setLayout(std::unique_ptr<Layout> layout);
     Container& setAutoResize(bool autoResize);
     void applyLayout();
     
+    // Draws the subtree into a texture once and blits that on later frames
+    // until a descendant is invalidated. Children are clipped to the
+    // container's bounds while it is cached. Turned off again on renderers
+    // that cannot blend the texture (see SubtreeCache).
+    Container& setCacheAsTexture(bool cache);
+    // Opted in, or promoted by the SubtreeCache heuristic
+    bool isCachedAsTexture() const { return textureCache != nullptr; }
+    
+    WidgetType getType() const override { return WidgetType::Container; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
@@ -424,6 +880,7 @@ public:
     Panel& setTitle(const std::string& title);
     std::string getTitle() const { return title; }
     
+    WidgetType getType() const override { return WidgetType::Panel; }
     void render() override;
 };
 
@@ -436,14 +893,38 @@ private:
     bool fullscreen;
     SDL_Window* sdlWindow;
     SDL_Renderer* sdlRenderer;
+    bool needsRender;
+    std::chrono::steady_clock::time_point lastRender;
+    // Pointer tracker: the hovered widget and its ancestors, outermost first
+    std::vector<WidgetHandle> hoverPath;
+    WidgetHandle pointerCapture;
+    // Focus manager: receives KeyPress; widgets taking text input also get typed text
+    WidgetHandle focusedWidget;
+    bool pointerDown;
     static std::vector<Window*> windows;
     static bool eventLoopRunning;
     
+    friend class Theme;
+    
     // Helper methods
-    static Widget* findWidgetAt(Widget* root, int x, int y);
     void processSDLEvent(const SDL_Event& sdlEvent);
+    void createNativeWindow();
+    bool updateHover(Widget* target);
+    void beginFrame();
+    void drawFrame();
+    void endFrame(double frameMs);
+    static void renderDisplayLists(const std::vector<Window*>& due);
     
 public:
+    struct FrameStats {
+        size_t frames;
+        double lastMs;       // render and present of the last frame
+        double averageMs;
+        double rasterMs;     // display list rasterization of the last frame; 0 when drawn directly
+        size_t widgetsDrawn;    // last frame
+        size_t widgetsCulled;   // skipped with their subtrees, outside the clip rect
+    };
+    
     Window(const std::string& title = "Window", int width = 800, int height = 600);
     ~Window();
     
@@ -464,16 +945,119 @@ public:
     void maximize();
     void minimize();
     
+    WidgetType getType() const override { return WidgetType::Window; }
     void render() override;
     void clear();
     void present();
+    // Widgets draw into the current window: the one last shown, rendered or
+    // made current. Needed before rendering widgets outside Window::render.
+    void makeCurrent();
     
+    // Schedules a redraw; renders happen at most once per InputPipeline frame interval
+    void invalidate();
+    bool isInvalidated() const { return needsRender; }
+    
+    // Each window has its own renderer; caches keep their textures per renderer
     SDL_Renderer* getRenderer() const { return sdlRenderer; }
+    SDL_Window* getSDLWindow() const { return sdlWindow; }
+    
+    // While a widget holds the capture it is the target of MouseMove and the
+    // button release wherever the pointer is, and stays the hovered widget.
+    // A left press captures the pressed widget until the button is released.
+    void setPointerCapture(Widget* widget);
+    void releasePointerCapture() { setPointerCapture(nullptr); }
+    Widget* getPointerCapture() const { return pointerCapture.get(); }
+    Widget* getHoveredWidget() const { return hoverPath.empty() ? nullptr : hoverPath.back().get(); }
+    
+    // Moves focus, delivering FocusLost and FocusGained; SDL text input is on
+    // while the focused widget accepts it
+    void setFocus(Widget* widget);
+    void clearFocus() { setFocus(nullptr); }
+    Widget* getFocusedWidget() const { return focusedWidget.get(); }
+    
+    // Hit testing: topmost visible widget under window coordinates
+    static Widget* findWidgetAt(Widget* root, int x, int y);
+    
+    // Routes an event to event.source through the capture, target and bubble
+    // phases, stopping at the first handleEvent that returns true, whose window
+    // is then invalidated. Unhandled events are emitted from the source.
+    static bool dispatchEvent(Event& event);
     
     static void runEventLoop();
     static void stopEventLoop();
     static void processEvents();
     static Window* getActiveWindow();
+    
+    // Renders invalidated windows whose frame slot is due
+    static void renderPending();
+    // Milliseconds until the next invalidated window may render, -1 if none is
+    static int getRenderWaitTimeout();
+    
+    FrameStats getFrameStats() const { return frameStats; }
+    
+    // Parallel rendering: each frame is recorded on the UI thread into a
+    // library-owned display list, the lists of all windows due in
+    // renderPending are rasterized into their frame surfaces on render
+    // workers, and the UI thread uploads and presents the windows together.
+    // Events and widget code stay on the UI thread. Widgets must draw through
+    // the library; direct SDL renderer calls from render() are not recorded.
+    static void setParallelRendering(bool enabled);
+    static bool isParallelRendering();
+    // Rasterization time summed over windows divided by the wall time of the
+    // parallel phase, averaged over frames with more than one window due
+    static double getParallelScaling();
+    
+private:
+    // Display list, frame surface and streaming texture; see setParallelRendering
+    struct FrameTarget;
+    std::unique_ptr<FrameTarget> frameTarget;
+    FrameStats frameStats;
+};
+
+// Input pipeline. Pointer motion is coalesced: each window receives at most
+// one MouseMove ("x", "y") per processEvents call with the latest position,
+// and the positions folded into it are kept as history for widgets that
+// draw strokes. Each window tracks the hovered widget path; widgets entering
+// or leaving it get MouseEnter and MouseLeave, which do not bubble, and a
+// window is only redrawn for motion when the path changes or a widget
+// handles the MouseMove. Consecutive SDL_TEXTINPUT events reach the focused
+// widget as one KeyPress with the whole run in "text". Event handling only
+// invalidates windows; each one renders at most once per frame interval,
+// which defaults to the display refresh rate.
+class InputPipeline {
+public:
+    struct MotionSample {
+        int x;
+        int y;
+        uint32_t timestamp;   // SDL ticks
+    };
+    
+    struct Stats {
+        size_t eventsReceived;    // SDL events polled
+        size_t motionReceived;
+        size_t motionDelivered;   // MouseMove events after coalescing
+        size_t textReceived;
+        size_t textDelivered;     // batched KeyPress text events
+        size_t hoverTransitions;  // MouseEnter and MouseLeave events
+        size_t eventsRouted;      // Window::dispatchEvent calls
+        size_t dispatches;        // handleEvent calls across all phases
+        size_t renderRequests;    // invalidations
+        size_t framesRendered;
+    };
+    
+    // Off by default; when on, getMotionHistory() holds every sample folded
+    // into the MouseMove being delivered, oldest first
+    static void setMotionHistory(bool enabled);
+    static const std::vector<MotionSample>& getMotionHistory();
+    
+    // Caps redraws per window; 0 follows the display refresh rate (60 Hz if unknown)
+    static void setFrameRate(int fps);
+    static int getFrameRate();
+    
+    static Stats getStats();
+    static void resetStats();
+    // One line per counter, for logs
+    static std::string formatStats();
 };
 
 // Dialog boxes
@@ -497,6 +1081,332 @@ public:
                     Type type = Info, Buttons buttons = OK);
 };
 
+struct LayoutRecord;
+
+// Declarative screens. A JSON description is compiled into a compact binary
+// form: one fixed-size record per widget in tree order plus a deduplicated
+// string table. instantiate() allocates the whole tree from one arena, freed
+// with its last widget, constructs it in one pass and applies every container
+// layout once at the end.
+//
+//   {"type": "Container", "id": "login", "width": 300, "height": 200,
+//    "layout": {"type": "vertical", "spacing": 4, "padding": 8, "stretch": true},
+//    "children": [{"type": "Label", "text": "User"},
+//                 {"type": "TextInput", "id": "user", "placeholder": "name"},
+//                 {"type": "Button", "id": "ok", "text": "Sign in"}]}
+//
+// Node keys: type (Container, Button, Label, TextInput, TextArea, TextView or
+// ListBox), id, text, placeholder, items, x, y, width, height, visible,
+// enabled, readOnly, password, layout and children. The top level is one node
+// or an array of nodes.
+//
+// capture() snapshots a live tree into the same form, including text,
+// cursor and selection, scroll positions and container layouts, so a
+// workspace saved at exit is restored by instantiate() at the next start.
+// Views and lists over a mapped file record its path; lists over any other
+// TextSource record no items.
+class UILayout {
+private:
+    std::vector<char> data;             // header, records and string table as saved
+    std::vector<std::string> strings;   // string table, materialized once per load
+    
+    bool index();
+    static UILayout captureRoots(const std::vector<const Widget*>& roots);
+    bool restoreRoots(const std::vector<Widget*>& roots) const;
+    void applyRecord(const LayoutRecord& record, Widget& widget) const;
+    
+public:
+    // Throws std::runtime_error with the line number on malformed descriptions
+    static UILayout compile(const std::string& json);
+    
+    // Snapshot of parent's descendants. Widgets of other types (and their
+    // subtrees) are skipped, as are custom Layout subclasses; their
+    // containers keep the captured child geometry.
+    static UILayout capture(const Widget& parent);
+    // Snapshot of one widget and its subtree
+    static UILayout captureWidget(const Widget& widget);
+    
+    bool load(const std::string& file);
+    bool save(const std::string& file) const;
+    
+    size_t getWidgetCount() const;
+    
+    // Builds the described widgets under parent; returns the first top-level widget
+    Widget* instantiate(Widget& parent) const;
+    
+    // Writes captured state back onto an existing tree of the same shape,
+    // such as one rebuilt by the code that built the captured tree, which
+    // keeps its event handlers. Stops at the first widget whose type differs
+    // from the snapshot and returns false.
+    bool restore(Widget& parent) const;
+    bool restoreWidget(Widget& widget) const;
+};
+
+struct ImageEntry;
+
+// Reference-counted handle to an image held by the ImageCache. The texture is
+// null until the image has been decoded and uploaded, so callers draw a
+// placeholder meanwhile. Images with live handles are never evicted.
+class Image {
+private:
+    std::shared_ptr<ImageEntry> entry;
+    
+    explicit Image(std::shared_ptr<ImageEntry> entry) : entry(std::move(entry)) {}
+    friend class ImageCache;
+    
+public:
+    Image() = default;
+    
+    SDL_Texture* getTexture() const;
+    bool isReady() const { return getTexture() != nullptr; }
+    bool isFailed() const;
+    bool isNull() const { return !entry; }
+    int getWidth() const;
+    int getHeight() const;
+    const std::string& getPath() const;
+};
+
+// Textures keyed by renderer, path and requested size. Files are decoded on a
+// background thread and pump() uploads the results on the UI thread in
+// batches; the event loop pumps and redraws once images land. Unreferenced
+// images are evicted least recently used first when the cache exceeds its
+// memory budget.
+class ImageCache {
+public:
+    struct Stats {
+        size_t images;         // cached entries, including pending ones
+        size_t pending;        // queued or decoding
+        size_t referenced;     // held by at least one Image
+        size_t textureBytes;   // uploaded pixels at 4 bytes each
+        size_t budgetBytes;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+    
+    static constexpr size_t kDefaultBudget = 64u << 20;
+    static constexpr size_t kUploadsPerPump = 16;
+    
+    // Returns immediately; width and height of 0 keep the file's own size
+    static Image request(SDL_Renderer* renderer, const std::string& path, int width = 0, int height = 0);
+    // Decodes on the calling thread if the image is not ready yet
+    static Image load(SDL_Renderer* renderer, const std::string& path, int width = 0, int height = 0);
+    
+    // Uploads up to maxUploads decoded images; returns how many became ready
+    static size_t pump(size_t maxUploads = kUploadsPerPump);
+    
+    static void setBudget(size_t bytes);
+    static size_t getBudget();
+    static void trim();
+    // Destroys every texture created for a renderer that is going away
+    static void releaseRenderer(SDL_Renderer* renderer);
+    
+    static Stats getStats();
+};
+
+// Render-target textures of cached containers (Container::setCacheAsTexture).
+// A container whose subtree renders unchanged for the promotion frame count,
+// and holds more than the promotion widget count, is cached automatically
+// while the textures fit in the memory budget; one that then keeps changing
+// is dropped again. The defaults only pick large, long-idle subtrees.
+// Opted-in containers are always cached and count against the same budget.
+// Renderers without custom blend modes draw every subtree directly.
+class SubtreeCache {
+public:
+    struct Stats {
+        size_t textures;
+        size_t promoted;       // textures owned by the heuristic
+        size_t textureBytes;   // 4 bytes per pixel
+        size_t budgetBytes;
+        uint64_t hits;         // blits of an up-to-date texture
+        uint64_t redraws;      // subtrees drawn into their texture
+        uint64_t promotions;
+        uint64_t demotions;
+    };
+    
+    static constexpr size_t kDefaultBudget = 32u << 20;
+    static constexpr uint32_t kDefaultPromoteFrames = 120;
+    static constexpr size_t kDefaultPromoteWidgets = 64;
+    
+    static void setBudget(size_t bytes);
+    static size_t getBudget();
+    // A frame count of 0 turns automatic promotion off
+    static void setPromotion(uint32_t frames, size_t minWidgets);
+    // Redraws every cached subtree, for changes widgets are not told about
+    static void invalidateAll();
+    
+    static Stats getStats();
+    static void resetStats();
+    // One line per counter, for logs
+    static std::string formatStats();
+};
+
+// Small images packed into shared atlas pages with a skyline packer, so a row
+// of toolbar or menu icons is drawn from one texture in a single batched call.
+// Icons are keyed by path and pixel size and packed on first use; pages can be
+// saved to a binary atlas file at build time and loaded at startup instead of
+// decoding every icon.
+class IconAtlas {
+public:
+    struct Region {
+        int page;
+        int x, y;
+        int width, height;
+    };
+    
+    struct Draw {
+        const Region* region;
+        int x, y;
+    };
+    
+    static constexpr int kPageSize = 512;
+    static constexpr int kPadding = 1;   // keeps filtering from bleeding between icons
+    
+    IconAtlas();
+    ~IconAtlas();
+    
+    IconAtlas(const IconAtlas&) = delete;
+    IconAtlas& operator=(const IconAtlas&) = delete;
+    
+    // Atlas shared by the built-in widgets
+    static IconAtlas& shared();
+    
+    // Packs the icon on first use; null if it cannot be loaded or does not fit a page
+    const Region* get(const std::string& path, int size);
+    const Region* find(const std::string& path, int size) const;
+    
+    // Submits every queued icon, one call per page touched
+    void draw(SDL_Renderer* renderer, const std::vector<Draw>& draws);
+    
+    // Binary atlas file: pages and regions. Pages read from a file are not
+    // packed into further; new icons start a fresh page. load() and clear()
+    // invalidate regions handed out earlier, so load before widgets draw.
+    bool save(const std::string& file) const;
+    bool load(const std::string& file);
+    
+    // Destroys the page textures of a renderer that is going away
+    void releaseRenderer(SDL_Renderer* renderer);
+    void clear();
+    
+    size_t getPageCount() const { return pages.size(); }
+    size_t getIconCount() const { return regions.size(); }
+    
+private:
+    struct Page;
+    
+    std::vector<std::unique_ptr<Page>> pages;
+    std::unordered_map<std::string, Region> regions; // page -1 marks an icon that failed to load
+    
+    SDL_Texture* pageTexture(SDL_Renderer* renderer, Page& page);
+};
+
+// Shared TTF_Font handles keyed by family, point size and style flags. A
+// family resolves to a font file once, through registered files, search
+// paths and a fontconfig-style fallback list (Arial -> Liberation Sans ->
+// DejaVu Sans, ...). Each handle gets its own glyph metrics cache, so widgets
+// with different fonts do not evict each other's measurements.
+class FontManager {
+public:
+    // Same values as TTF_STYLE_*
+    enum StyleFlags {
+        Normal = 0,
+        Bold = 1,
+        Italic = 2,
+        Underline = 4
+    };
+    
+    struct Stats {
+        size_t fonts;          // open handles
+        size_t families;       // families resolved so far
+        double resolveMs;      // time spent probing font files
+        double loadMs;         // time spent in TTF_OpenFont
+        double startupMs;      // default font and generic fallbacks at initialization
+    };
+    
+    static constexpr const char* kDefaultFamily = "Arial";
+    static constexpr int kDefaultSize = 14;
+    
+    // Null until SDL_ttf is initialized or if no candidate file exists
+    static TTF_Font* get(const std::string& family, int size, int style = Normal);
+    
+    // Font file to use for a family, checked before the search paths
+    static void registerFamily(const std::string& family, const std::string& path);
+    // Directory searched before the platform font directories
+    static void addSearchPath(const std::string& directory);
+    // File a family resolves to; empty if nothing matched
+    static const std::string& resolve(const std::string& family);
+    
+    static void releaseAll();
+    static Stats getStats();
+};
+
+// Prebuilt glyphs: a versioned cache file holds rasterized glyph pages and
+// advance metrics for one font file (identified by a content hash, which is
+// only recomputed when the font's size or modification time changed), point
+// size and style. Loaded files are memory-mapped; the glyph table is read in
+// place and pages are uploaded to textures straight from the mapping, so text
+// whose characters are all cached is measured and drawn without FreeType.
+// Strings with other characters fall back to SDL_ttf.
+class GlyphCache {
+public:
+    struct Stats {
+        size_t files;          // mapped cache files
+        size_t glyphs;         // glyphs across them
+        size_t mappedBytes;
+        size_t boundFonts;     // open fonts served from a file
+        size_t cachedRuns;     // strings drawn or measured from cached glyphs
+        size_t fallbackRuns;   // strings that needed SDL_ttf
+    };
+    
+    static constexpr int kPageSize = 512;
+    
+    // Rasterizes printable ASCII and Latin-1 plus the characters of `characters` (UTF-8,
+    // e.g. every locale's strings) for a family, size and FontManager style
+    // flags, and writes the cache file. Initializes SDL if needed.
+    static bool build(const std::string& file, const std::string& family, int size,
+                      const std::string& characters = "", int style = 0);
+    
+    // Maps a cache file; fonts opened with a matching file, size and style use it
+    static bool load(const std::string& file);
+    static void unloadAll();
+    
+    // Destroys the page textures of a renderer that is going away
+    static void releaseRenderer(SDL_Renderer* renderer);
+    
+    static Stats getStats();
+};
+
+// Startup pipeline. The first window initializes SDL video on the UI thread
+// and hands SDL_ttf initialization, font resolution and glyph prewarming to a
+// loader thread, so they overlap window and renderer creation, which happen
+// in the Window constructor (the window stays hidden until show()). The first text
+// measurement or frame waits for the loader. With a glyph cache file set, the
+// loader maps it for the default font, or builds it there if it is missing
+// or stale so the next launch skips rasterization.
+class Startup {
+public:
+    struct Report {
+        double sdlInitMs;        // SDL_Init on the UI thread
+        double fontLoadMs;       // TTF_Init, fallback resolution and default font (loader thread)
+        double glyphPrewarmMs;   // metrics for the prewarm character set (loader thread)
+        bool glyphCacheHit;      // prewarm metrics came from the cache file
+        double windowCreateMs;   // first window and renderer
+        double fontWaitMs;       // UI thread blocked on the loader
+        double firstFrameMs;     // process start to the first present
+        bool firstFrameDone;
+    };
+    
+    // Both take effect for the next startup, so set them before the first window
+    // (see GlyphCache for the file format)
+    static void setGlyphCacheFile(const std::string& path);
+    // UTF-8 text whose characters are prewarmed on top of ASCII and Latin-1
+    static void setPrewarmCharacters(const std::string& text);
+    
+    static Report getReport();
+    // One line per phase, for logs
+    static std::string formatReport();
+};
+
 // Utility functions
 namespace utils {
     // Create widgets with fluent interface
@@ -505,7 +1415,8 @@ namespace utils {
         return std::make_unique<T>(std::forward<Args>(args)...);
     }
     
-    // Load image
+    // Load image through the ImageCache; the texture stays owned by the cache
+    // and pinned until the renderer is released
     SDL_Texture* loadImage(SDL_Renderer* renderer, const std::string& path);
     
     // Text utilities
@@ -516,17 +1427,29 @@ namespace utils {
     Color fromSDLColor(const SDL_Color& color);
 }
 
+class TimerScheduler;
+
 // Timer class for animations and delayed actions
 class Timer {
 private:
     std::function<void()> callback;
     double interval;
     double elapsed;
-        bool repeating;
+    bool repeating;
     bool active;
     
+    // Scheduler-driven timers fire at absolute deadlines instead of accumulating deltaTime
+    TimerScheduler* scheduler;
+    std::chrono::steady_clock::time_point deadline;
+    size_t heapIndex;
+    
+    friend class TimerScheduler;
+    
 public:
     Timer(double interval, std::function<void()> callback, bool repeating = false);
+    ~Timer();
+    
+    Timer& setScheduler(TimerScheduler* scheduler);
     
     void start();
     void stop();
@@ -534,10 +1457,104 @@ public:
     void update(double deltaTime);
     
     bool isActive() const { return active; }
+    bool isRepeating() const { return repeating; }
     double getInterval() const { return interval; }
-    double getElapsed() const { return elapsed; }
+    double getElapsed() const;
+    std::chrono::steady_clock::time_point getDeadline() const { return deadline; }
+};
+
+// Min-heap of timer deadlines on the monotonic clock.
+// Per-frame cost is O(expired * log n); idle timers are never touched.
+class TimerScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+private:
+    std::vector<Timer*> heap;
+    
+    void siftUp(size_t index);
+    void siftDown(size_t index);
+    void swapEntries(size_t a, size_t b);
+    void removeAt(size_t index);
+    
+public:
+    TimerScheduler() = default;
+    TimerScheduler(const TimerScheduler&) = delete;
+    TimerScheduler& operator=(const TimerScheduler&) = delete;
+    ~TimerScheduler();
+    
+    void schedule(Timer* timer, Clock::time_point deadline);
+    void cancel(Timer* timer);
+    
+    // Fires every timer whose deadline is <= now, returns the number fired
+    size_t runExpired(Clock::time_point now = Clock::now());
+    
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+    
+    // Clock::time_point::max() when nothing is scheduled
+    Clock::time_point nextDeadline() const;
+    // Milliseconds the event loop may sleep, -1 for "until the next event"
+    int getWaitTimeout(Clock::time_point now = Clock::now()) const;
+};
+
+class AnimationEngine;
+
+// Precomputed getter/setter pair for an animatable widget property
+struct PropertyAccessor {
+    double (*get)(const Widget*);
+    void (*set)(Widget*, double);
+    
+    explicit operator bool() const { return get && set; }
+    
+    // Resolves "x", "y", "width" or "height"; unknown names yield an empty accessor
+    static PropertyAccessor resolve(const std::string& property);
+};
+
+namespace detail {
+    template <typename Getter>
+    struct GetterTraits;
+    
+    template <typename W, typename T>
+    struct GetterTraits<T (W::*)() const> {
+        using widget_type = W;
+        using value_type = std::decay_t<T>;
+    };
+}
+
+// Compile-time property descriptor built from a widget's getter/setter pair,
+// e.g. Prop<&Slider::getValue, &Slider::setValue>. Dispatch is resolved by the
+// compiler; no property names are looked up at runtime.
+template <auto Getter, auto Setter>
+struct Prop {
+    using widget_type = typename detail::GetterTraits<decltype(Getter)>::widget_type;
+    using value_type = typename detail::GetterTraits<decltype(Getter)>::value_type;
+    
+    static value_type get(const widget_type& widget) { return (widget.*Getter)(); }
+    static void set(widget_type& widget, value_type value) { (widget.*Setter)(value); }
+    
+    // Type-erased forms used by the batched animation engine
+    static double getValue(const Widget* widget) {
+        return static_cast<double>(get(static_cast<const widget_type&>(*widget)));
+    }
+    static void setValue(Widget* widget, double value) {
+        if constexpr (std::is_integral_v<value_type>) {
+            set(static_cast<widget_type&>(*widget), static_cast<value_type>(std::lround(value)));
+        } else {
+            set(static_cast<widget_type&>(*widget), static_cast<value_type>(value));
+        }
+    }
+    static PropertyAccessor accessor() { return {&getValue, &setValue}; }
 };
 
+// Geometry properties shared by every widget
+namespace props {
+    struct X : Prop<&Widget::getX, &Widget::setX> { static constexpr const char* name = "x"; };
+    struct Y : Prop<&Widget::getY, &Widget::setY> { static constexpr const char* name = "y"; };
+    struct Width : Prop<&Widget::getWidth, &Widget::setWidth> { static constexpr const char* name = "width"; };
+    struct Height : Prop<&Widget::getHeight, &Widget::setHeight> { static constexpr const char* name = "height"; };
+}
+
 // Animation support
 class Animation {
 public:
@@ -547,12 +1564,13 @@ public:
         EaseOut,
         EaseInOut,
         Bounce,
-        Elastic
+        Elastic,
+        EasingCount
     };
     
 private:
-    Widget* target;
-    std::string property; // "x", "y", "width", "height", "opacity"
+    WidgetHandle target;
+    PropertyAccessor accessor;
     double startValue;
     double endValue;
     double duration;
@@ -561,11 +1579,26 @@ private:
     std::function<void()> onComplete;
     bool active;
     
+    // Engine-driven animations are a single track in a batched AnimationEngine
+    AnimationEngine* engine;
+    uint64_t track;   // AnimationEngine::TrackId
+    
 public:
     Animation(Widget* target, const std::string& property, 
               double endValue, double duration, EasingType easing = Linear);
+    Animation(Widget& target, PropertyAccessor accessor,
+              double endValue, double duration, EasingType easing = Linear);
+    ~Animation();
+    
+    // Typed construction, e.g. Animation::create<props::X>(button, 200, 0.3)
+    template <typename P>
+    static std::unique_ptr<Animation> create(typename P::widget_type& target, double endValue,
+                                             double duration, EasingType easing = Linear) {
+        return std::make_unique<Animation>(target, P::accessor(), endValue, duration, easing);
+    }
     
     Animation& setOnComplete(std::function<void()> callback);
+    Animation& setEngine(AnimationEngine* engine);
     
     void start();
     void stop();
@@ -573,16 +1606,72 @@ public:
     
     bool isActive() const { return active; }
     
+    static double ease(EasingType easing, double t);
+    
 private:
     double ease(double t);
 };
 
+// Batched animation tracks stored as structure-of-arrays, one block per easing curve.
+// Each block advances in a single branch-free pass the compiler can vectorize,
+// then writes values back through the tracks' precomputed property setters.
+class AnimationEngine {
+public:
+    // Slot index + 1 in the low half and the slot's generation in the high
+    // half, so an id from a removed track never matches the slot's next track.
+    // 0 is never a valid track.
+    using TrackId = uint64_t;
+    
+private:
+    struct Block {
+        std::vector<float> startValue;
+        std::vector<float> delta;
+        std::vector<float> elapsed;
+        std::vector<float> inverseDuration;
+        std::vector<float> value;
+        std::vector<WidgetHandle> targets;
+        std::vector<void (*)(Widget*, double)> setters;
+        std::vector<TrackId> ids;
+    };
+    
+    struct Slot {
+        uint32_t block;
+        uint32_t index;
+        uint32_t generation;   // bumped each time the slot is freed
+        bool live;
+        // Called with true on completion, false when the target was destroyed
+        std::function<void(bool)> onFinish;
+    };
+    
+    Block blocks[Animation::EasingCount];
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::vector<TrackId> finished;
+    std::vector<TrackId> orphaned;
+    size_t trackCount = 0;
+    
+    static uint32_t slotIndex(TrackId id) { return static_cast<uint32_t>(id) - 1; }
+    void removeAt(uint32_t block, uint32_t index);
+    
+public:
+    TrackId add(Widget* target, const PropertyAccessor& accessor, double startValue, double endValue,
+                double duration, Animation::EasingType easing, std::function<void(bool)> onFinish = nullptr);
+    void remove(TrackId id);
+    bool isActive(TrackId id) const;
+    
+    void update(double deltaTime);
+    
+    size_t size() const { return trackCount; }
+    bool empty() const { return trackCount == 0; }
+};
+
 // Menu system
 class MenuItem {
 private:
     std::string text;
     std::string id;
     std::string shortcut;
+    std::string icon;
     bool enabled;
     bool checkable;
     bool checked;
@@ -594,6 +1683,7 @@ public:
     
     MenuItem& setText(const std::string& text);
     MenuItem& setShortcut(const std::string& shortcut);
+    MenuItem& setIcon(const std::string& iconPath);
     MenuItem& setEnabled(bool enabled);
     MenuItem& setCheckable(bool checkable);
     MenuItem& setChecked(bool checked);
@@ -603,6 +1693,7 @@ public:
     const std::string& getText() const { return text; }
     const std::string& getId() const { return id; }
     const std::string& getShortcut() const { return shortcut; }
+    const std::string& getIcon() const { return icon; }
     bool isEnabled() const { return enabled; }
     bool isCheckable() const { return checkable; }
     bool isChecked() const { return checked; }
@@ -615,7 +1706,6 @@ public:
 class Menu : public Widget {
 private:
     std::vector<std::unique_ptr<MenuItem>> items;
-    bool visible;
     int highlightedIndex;
     
 public:
@@ -626,9 +1716,16 @@ public:
     
     void show(int x, int y);
     void hide();
+    bool isOpen() const { return visible; }
+    size_t getItemCount() const { return items.size(); }
     
+    WidgetType getType() const override { return WidgetType::Menu; }
     void render() override;
     bool handleEvent(const Event& event) override;
+    
+private:
+    int itemHeight() const;
+    void activate(size_t index);
 };
 
 class MenuBar : public Widget {
@@ -641,34 +1738,70 @@ public:
     
     MenuBar& addMenu(const std::string& title, std::unique_ptr<Menu> menu);
     
+    WidgetType getType() const override { return WidgetType::MenuBar; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
 
-// TabControl widget
+// TabControl widget. Pages are given built or as factories that build them
+// on first activation. Only the active page is a child of the control, so
+// inactive pages are never rendered, laid out or hit-tested. With page
+// eviction on, factory pages left inactive for a while are destroyed once
+// the built inactive pages exceed a widget budget; their state is kept as a
+// UILayout snapshot and written back when the factory rebuilds the page.
 class TabControl : public Widget {
+public:
+    using PageFactory = std::function<std::unique_ptr<Widget>()>;
+    
 private:
     struct Tab {
         std::string title;
-        std::unique_ptr<Widget> content;
+        std::unique_ptr<Widget> content;   // the page while it is built and inactive
+        PageFactory factory;
+        UILayout snapshot;                 // state of an evicted page
         bool closable;
+        int stripWidth;                    // tab header width, -1 until measured
+        size_t widgetCount;                // page size when last deactivated
+        std::chrono::steady_clock::time_point lastActive;
     };
     
     std::vector<Tab> tabs;
     int activeTabIndex;
+    int tabHeight;
+    bool evictionEnabled;
+    std::chrono::steady_clock::duration evictionIdle;
+    size_t evictionBudget;
     
 public:
     TabControl(const std::string& id = "");
     
     TabControl& addTab(const std::string& title, std::unique_ptr<Widget> content, bool closable = false);
+    TabControl& addLazyTab(const std::string& title, PageFactory factory, bool closable = false);
     TabControl& removeTab(int index);
     TabControl& setActiveTab(int index);
     
+    // Evicts factory pages inactive for at least idleSeconds, least recently
+    // used first, while built inactive pages hold more than widgetBudget widgets
+    TabControl& setPageEviction(double idleSeconds, size_t widgetBudget);
+    TabControl& disablePageEviction();
+    void evictIdlePages();
+    
     int getTabCount() const { return tabs.size(); }
     int getActiveTabIndex() const { return activeTabIndex; }
+    std::string getTabTitle(int index) const;
+    // Null while the page is not built
+    Widget* getPage(int index) const;
+    size_t getBuiltPageCount() const;
     
+    WidgetType getType() const override { return WidgetType::TabControl; }
     void render() override;
     bool handleEvent(const Event& event) override;
+    
+private:
+    void showPage(int index);
+    void fitPage(Widget* page);
+    int measureTab(size_t index);
+    int getTabAt(int localX);
 };
 
 // ScrollBar widget
@@ -691,6 +1824,7 @@ public:
     double getValue() const { return value; }
     double getPageSize() const { return pageSize; }
     
+    WidgetType getType() const override { return WidgetType::ScrollBar; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
@@ -719,29 +1853,42 @@ public:
 class ListBox : public Widget {
 private:
     std::vector<std::string> items;
+    std::shared_ptr<TextSource> source; // replaces items when set, one item per line
     int selectedIndex;
     int scrollOffset;
     int itemHeight;
     bool multiSelect;
     std::vector<int> selectedIndices;
+    TTF_Font* layoutFont;
+    
+    friend class UILayout;
     
 public:
     ListBox(const std::string& id = "");
     
     ListBox& addItem(const std::string& item);
     ListBox& setItems(const std::vector<std::string>& items);
+    ListBox& setSource(std::shared_ptr<TextSource> source);
     ListBox& setSelectedIndex(int index);
     ListBox& setMultiSelect(bool multiSelect);
     ListBox& clearSelection();
+    void scrollTo(int index);
     
+    size_t getItemCount() const { return source ? source->getLineCount() : items.size(); }
+    std::string_view getItem(size_t index) const;
+    const std::shared_ptr<TextSource>& getSource() const { return source; }
     std::vector<std::string> getItems() const { return items; }
     int getSelectedIndex() const { return selectedIndex; }
     std::string getSelectedItem() const;
     std::vector<int> getSelectedIndices() const { return selectedIndices; }
     std::vector<std::string> getSelectedItems() const;
     
+    WidgetType getType() const override { return WidgetType::ListBox; }
     void render() override;
     bool handleEvent(const Event& event) override;
+    
+private:
+    void syncFont();
 };
 
 // TreeView widget
@@ -795,6 +1942,7 @@ public:
     TreeNode* getSelectedNode() const { return selectedNode; }
     TreeNode* findNode(const std::string& id);
     
+    WidgetType getType() const override { return WidgetType::TreeView; }
     void render() override;
     bool handleEvent(const Event& event) override;
     
@@ -849,6 +1997,7 @@ public:
     int getSelectedRow() const { return selectedRow; }
     std::vector<std::string> getRow(int index) const;
     
+    WidgetType getType() const override { return WidgetType::Table; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
@@ -870,6 +2019,7 @@ public:
     StatusBar& addPanel(const std::string& text = "", int width = -1);
     StatusBar& setPanelText(int index, const std::string& text);
     
+    WidgetType getType() const override { return WidgetType::StatusBar; }
     void render() override;
 };
 
@@ -883,11 +2033,16 @@ private:
         bool enabled;
         bool toggle;
         bool pressed;
+        bool separator;
+        const IconAtlas::Region* region; // packed into the shared atlas on first draw
+        Image image;                     // fallback for icons the atlas cannot hold
+        bool iconResolved;
     };
     
     std::vector<Tool> tools;
     int toolSize;
     bool showTooltips;
+    int hoveredTool;   // follows MouseMove; -1 when the pointer is elsewhere
     
 public:
     ToolBar(const std::string& id = "toolbar");
@@ -898,6 +2053,13 @@ public:
     ToolBar& setToolSize(int size);
     ToolBar& setShowTooltips(bool show);
     
+    size_t getToolCount() const { return tools.size(); }
+    bool isToolPressed(size_t index) const { return index < tools.size() && tools[index].pressed; }
+    // Tool under an x coordinate relative to the toolbar, or -1
+    int getToolAt(int localX) const;
+    void activate(size_t index);
+    
+    WidgetType getType() const override { return WidgetType::ToolBar; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
@@ -930,6 +2092,7 @@ public:
     
     Color getColor() const { return color; }
     
+    WidgetType getType() const override { return WidgetType::ColorPicker; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
@@ -951,35 +2114,153 @@ public:
     void getDate(int& year, int& month, int& day) const;
     std::string getDateString(const std::string& format = "YYYY-MM-DD") const;
     
+    WidgetType getType() const override { return WidgetType::DatePicker; }
     void render() override;
     bool handleEvent(const Event& event) override;
 };
 
-// Global theme management
+// Global theme management. A theme is compiled into a flat table with one
+// resolved style per widget type; copies share the table until modified, so
+// switching the global theme swaps a pointer and only windows containing
+// widgets whose resolved style changed are invalidated.
 class Theme {
 private:
-    std::unordered_map<std::string, Style> styles;
+    struct Table;
+    std::shared_ptr<Table> table;
     std::string name;
     
+    friend class Widget;
+    
 public:
+    // Starts with the default style for every type; types never set follow
+    // the Generic entry
     Theme(const std::string& name);
     
+    Theme& setStyle(WidgetType widgetType, const Style& style);
     Theme& setStyle(const std::string& widgetType, const Style& style);
+    const Style& getStyle(WidgetType widgetType) const;
     const Style* getStyle(const std::string& widgetType) const;
+    const std::string& getName() const { return name; }
     
     static void setGlobalTheme(const Theme& theme);
     static const Theme* getGlobalTheme();
     
+    // Style of a widget type under the global theme
+    static const Style& resolve(WidgetType widgetType);
+    
     // Predefined themes
     static Theme Light();
     static Theme Dark();
     static Theme Blue();
 };
 
+// Frame profiler: scoped CPU timings collected into per-frame ring buffers.
+// Compiled in unless GUI_ENABLE_PROFILER is 0; while disabled a scope costs one branch.
+#ifndef GUI_ENABLE_PROFILER
+#define GUI_ENABLE_PROFILER 1
+#endif
+
+class Profiler {
+public:
+    struct Sample {
+        const char* name;      // static string, e.g. "render" or "drawText"
+        WidgetHandle widget;   // widget being rendered, if any
+        uint64_t startNs;
+        uint64_t durationNs;
+        uint64_t selfNs;       // duration minus nested scopes
+        uint32_t depth;
+    };
+    
+    struct Frame {
+        uint64_t index;
+        uint64_t startNs;
+        uint64_t durationNs;   // wall time since the previous frame ended
+        uint64_t busyNs;       // time spent inside top-level scopes
+        uint64_t firstSample;  // monotonic sample sequence number
+        uint64_t sampleCount;
+    };
+    
+    struct WidgetTiming {
+        std::string label;
+        double averageMs;      // self time per frame
+        uint64_t calls;
+    };
+    
+    static constexpr size_t kFrameHistory = 240;
+    static constexpr size_t kSampleCapacity = 1 << 16;
+    static constexpr uint32_t kMaxDepth = 64;
+    
+private:
+    static inline bool enabled = false;
+    static inline bool overlayVisible = false;
+    
+public:
+    static void setEnabled(bool enabled);
+    static bool isEnabled() { return enabled; }
+    static void setOverlayVisible(bool visible) { overlayVisible = visible; }
+    static bool isOverlayVisible() { return overlayVisible; }
+    
+    static uint64_t now();
+    static void beginScope();
+    static void endScope(const char* name, const Widget* widget, uint64_t startNs);
+    
+    // Closes the current frame; called once per presented window frame
+    static void endFrame();
+    
+    // Completed frames still held by the ring buffer, oldest first
+    static std::vector<Frame> getFrames();
+    // Widgets with the highest self time over the last frameWindow frames
+    static std::vector<WidgetTiming> getSlowestWidgets(size_t count, size_t frameWindow = kFrameHistory);
+    
+    // Writes the recorded samples in Chrome trace-event JSON (chrome://tracing, Perfetto)
+    static bool exportChromeTrace(const std::string& path);
+    static void clear();
+};
+
+// RAII timer recorded into the current profiler frame
+class ProfileScope {
+private:
+    const char* name;
+    const Widget* widget;
+    uint64_t startNs;
+    bool active;
+    
+public:
+    explicit ProfileScope(const char* name, const Widget* widget = nullptr)
+        : name(name), widget(widget), startNs(0), active(Profiler::isEnabled()) {
+        if (active) {
+            Profiler::beginScope();
+            startNs = Profiler::now();
+        }
+    }
+    
+    ~ProfileScope() {
+        if (active) {
+            Profiler::endScope(name, widget, startNs);
+        }
+    }
+    
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#if GUI_ENABLE_PROFILER
+#define GUI_PROFILE_CONCAT_IMPL(a, b) a##b
+#define GUI_PROFILE_CONCAT(a, b) GUI_PROFILE_CONCAT_IMPL(a, b)
+#define GUI_PROFILE_SCOPE(name) ::gui::ProfileScope GUI_PROFILE_CONCAT(guiProfileScope, __LINE__)(name)
+#define GUI_PROFILE_WIDGET(name, widget) ::gui::ProfileScope GUI_PROFILE_CONCAT(guiProfileScope, __LINE__)(name, widget)
+#else
+#define GUI_PROFILE_SCOPE(name) ((void)0)
+#define GUI_PROFILE_WIDGET(name, widget) ((void)0)
+#endif
+
 // Application class for managing the GUI application
 class Application {
 private:
     static Application* instance;
+    // Declared before the timers and animations they drive so they outlive them
+    TimerScheduler scheduler;
+    AnimationEngine animationEngine;
     std::vector<std::unique_ptr<Window>> windows;
     std::vector<std::unique_ptr<Timer>> timers;
     std::vector<std::unique_ptr<Animation>> animations;
@@ -990,6 +2271,8 @@ public:
     ~Application();
     
     static Application* getInstance();
+    TimerScheduler& getScheduler() { return scheduler; }
+    AnimationEngine& getAnimationEngine() { return animationEngine; }
     
     void addWindow(std::unique_ptr<Window> window);
     void addTimer(std::unique_ptr<Timer> timer);